@@ -21,6 +21,7 @@
 #include "config.h"
 
 static struct list_head cli_history_head;
+static int cli_history_len;
 
 void clear_screen(void)
 {
@@ -57,19 +58,56 @@ static int mygetkey_timeout(clock_t *kbd_to, clock_t *tto)
     return key;
 }
 
+/* The next older history entry after c, or NULL */
+static struct cli_command *history_next(struct cli_command *c)
+{
+    if (list_is_last(&c->list, &cli_history_head))
+	return NULL;
+
+    return list_entry(c->list.next, typeof(*c), list);
+}
+
+/* Find the newest entry from c on that contains pat */
+static struct cli_command *history_search(struct cli_command *c,
+					  const char *pat, const char **at)
+{
+    for (; c; c = history_next(c)) {
+	*at = strstr(c->command, pat);
+	if (*at)
+	    return c;
+    }
+
+    return NULL;
+}
+
+/* Longest search string; the history is searched for up to this much */
+#define SEARCH_MAX	128
+
+/*
+ * The search is incremental: match[i] is the entry found for the first
+ * i characters of the search string.  Entries newer than match[i] don't
+ * contain that, so they can't contain a longer string either, and a new
+ * character only needs searching from match[i] on; once nothing is
+ * found, nothing will be for any longer string.  Backspace goes back to
+ * the previous match without searching at all.
+ */
 static const char * cmd_reverse_search(int *cursor, clock_t *kbd_to,
 				       clock_t *tto)
 {
     int key;
     int i = 0;
-    char buf[MAX_CMDLINE_LEN];
-    const char *p = NULL;
-    struct cli_command *last_found;
-    struct cli_command *last_good = NULL;
-
-    last_found = list_entry(cli_history_head.next, typeof(*last_found), list);
-
-    memset(buf, 0, MAX_CMDLINE_LEN);
+    char buf[SEARCH_MAX + 1];
+    struct cli_command *match[SEARCH_MAX + 1];
+    int offset[SEARCH_MAX + 1];
+    bool failed[SEARCH_MAX + 1];
+    struct cli_command *c;
+    const char *p;
+
+    match[0] = list_empty(&cli_history_head) ? NULL :
+	list_entry(cli_history_head.next, typeof(*c), list);
+    offset[0] = 0;
+    failed[0] = false;
+    buf[0] = '\0';
 
     printf("\033[1G\033[1;36m(reverse-i-search)`': \033[0m");
     while (1) {
@@ -78,45 +116,54 @@ static const char * cmd_reverse_search(int *cursor, clock_t *kbd_to,
 	if (key == KEY_CTRL('C')) {
 	    return NULL;
 	} else if (key == KEY_CTRL('R')) {
-	    if (i == 0)
-		continue; /* User typed nothing yet */
+	    if (i == 0 || failed[i])
+		continue; /* Nothing to search for */
 	    /* User typed 'CTRL-R' again, so try the next */
-	    last_found = list_entry(last_found->list.next, typeof(*last_found), list);
+	    c = history_search(history_next(match[i]), buf, &p);
+	    if (!c)
+		continue;
+	    match[i] = c;
+	    offset[i] = p - c->command;
+	} else if (key == KEY_BACKSPACE || key == KEY_DEL) {
+	    if (i == 0)
+		continue;
+	    buf[--i] = '\0';
 	} else if (key >= ' ' && key <= 'z') {
-	        buf[i++] = key;
+	    if (i == SEARCH_MAX)
+		continue;
+	    buf[i++] = key;
+	    buf[i] = '\0';
+
+	    match[i] = match[i - 1];
+	    offset[i] = offset[i - 1];
+	    failed[i] = failed[i - 1];
+	    if (!failed[i]) {
+		c = history_search(match[i], buf, &p);
+		if (c) {
+		    match[i] = c;
+		    offset[i] = p - c->command;
+		} else {
+		    failed[i] = true;
+		}
+	    }
 	} else {
 	    /* Treat other input chars as terminal */
 	    break;
 	}
 
-	while (last_found) {
-	    p = strstr(last_found->command, buf);
-	    if (p)
-	        break;
-
-	    if (list_is_last(&last_found->list, &cli_history_head))
-		break;
-
-	    last_found = list_entry(last_found->list.next, typeof(*last_found), list);
-	}
-
-	if (!p && !last_good) {
-	    return NULL;
-	} else if (!p) {
-	    continue;
-	} else {
-	    last_good = last_found;
-            *cursor = p - last_good->command;
-	}
-
 	printf("\033[?7l\033[?25l");
 	/* Didn't handle the line wrap case here */
-	printf("\033[1G\033[1;36m(reverse-i-search)\033[0m`%s': %s",
-		buf, last_good->command ? : "");
+	printf("\033[1G\033[1;36m(%sreverse-i-search)\033[0m`%s': %s",
+	       failed[i] ? "failing " : "", buf,
+	       (i && match[i]) ? match[i]->command : "");
 	printf("\033[K\r");
     }
 
-    return last_good ? last_good->command : NULL;
+    if (!i || !match[i])
+	return NULL;
+
+    *cursor = offset[i];
+    return match[i]->command;
 }
 
 
@@ -464,10 +511,21 @@ const char *edit_cmdline(const char *input, int top /*, int width */ ,
     /* Add the command to the history if its length is larger than 0 */
     len = strlen(ret);
     if (len > 0) {
+	/* Keep the last MAX_CMD_HISTORY commands, so searches stay short */
+	if (cli_history_len >= MAX_CMD_HISTORY) {
+	    comm_counter = list_entry(cli_history_head.prev,
+				      typeof(*comm_counter), list);
+	    list_del(&comm_counter->list);
+	    free(comm_counter->command);
+	    free(comm_counter);
+	    cli_history_len--;
+	}
+
 	comm_counter = malloc(sizeof(struct cli_command));
 	comm_counter->command = malloc(sizeof(char) * (len + 1));
 	strcpy(comm_counter->command, ret);
 	list_add(&(comm_counter->list), &cli_history_head);
+	cli_history_len++;
     }
 
     return len ? ret : NULL;
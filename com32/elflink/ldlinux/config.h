@@ -37,6 +37,39 @@ extern const char *default_cmd;	//"default" command line
 extern const char *onerror;	//"onerror" command line
 extern const char *ontimeout;	//"ontimeout" command line
 
+/*
+ * Compiled config cache, as written by utils/mkcfgcache: the main config
+ * file with all its INCLUDE and MENU INCLUDE files inlined and comments
+ * dropped. It lives next to the config file, with the extension
+ * replaced by CFGCACHE_SUFFIX, and is only used if the main config file
+ * still has the size and checksum recorded in it, and each included
+ * file still has its recorded size.  Little endian.
+ */
+#define CFGCACHE_MAGIC		0x43474643	/* "CFGC" */
+#define CFGCACHE_VERSION	2
+#define CFGCACHE_SUFFIX		".cfc"
+#define CFGCACHE_ABSENT		0xffffffff	/* Include file didn't exist */
+
+struct cfgcache_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;	/* sizeof(struct cfgcache_header) */
+    uint32_t size;		/* Total file size */
+    uint32_t src_size;		/* Size of the main config file... */
+    uint32_t src_sum;		/* ...and its FNV-1a hash */
+    uint32_t text_offset;	/* The flattened config */
+    uint32_t text_size;
+    uint32_t files_offset;	/* Array of struct cfgcache_file */
+    uint32_t files_count;
+} __attribute__ ((packed));
+
+/* An INCLUDE or MENU INCLUDE file the cache was made from */
+struct cfgcache_file {
+    uint32_t name_offset;	/* Null-terminated name, as in the config */
+    uint32_t size;		/* or CFGCACHE_ABSENT */
+    uint32_t sum;		/* FNV-1a hash, for tools; not checked at boot */
+} __attribute__ ((packed));
+
 extern void cat_help_file(int key);
 extern struct menu_entry *find_label(const char *str);
 extern void print_labels(const char *prefix, size_t len);
@@ -21,7 +21,9 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 	void *kernel_data;
 	size_t kernel_len, cmdline_len;
 	bool opt_quiet = false;
-	char *initrd_name, *cmdline;
+	char *initrd_name, *cmdline, *p;
+	struct loadfile_req *reqs = NULL;
+	int i, nreqs;
 
 	dprintf("okernel = %s, ocmdline = %s", okernel, ocmdline);
 
@@ -51,31 +53,31 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 	if (strstr(cmdline, "quiet"))
 		opt_quiet = true;
 
-	if (!opt_quiet)
-		printf("Loading %s... ", kernel_name);
+	/*
+	 * The kernel and the initrds are all loaded at once; collect
+	 * their names first.
+	 */
+	nreqs = 1;
+	temp = strstr(cmdline, "initrd=");
+	if (temp) {
+		for (p = temp; *p && *p != ' '; p++)
+			if (*p == ',')
+				nreqs++;
+		nreqs++;
+	}
 
-	if (loadfile(kernel_name, &kernel_data, &kernel_len)) {
-		if (opt_quiet)
-			printf("Loading %s ", kernel_name);
-		printf("failed: ");
+	reqs = calloc(nreqs, sizeof *reqs);
+	if (!reqs) {
+		printf("Failed to allocate space for initrd\n");
 		goto bail;
 	}
+	reqs[0].name = kernel_name;
 
-	if (!opt_quiet)
-		printf("ok\n");
-
-	/* Find and load initramfs */
-	temp = strstr(cmdline, "initrd=");
 	if (temp) {
-		/* Initialize the initramfs chain */
-		initramfs = initramfs_init();
-		if (!initramfs)
-			goto bail;
-
 		temp += 6; /* strlen("initrd") */
+		i = 1;
 		do {
 		    size_t n = 0;
-		    char *p;
 
 		    temp++;	/* Skip = or , */
 
@@ -92,24 +94,51 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 		    }
 
 		    snprintf(initrd_name, n + 1, "%s", temp);
+		    reqs[i++].name = initrd_name;
 		    temp += n;
+		} while (*temp == ',');
+	}
+
+	if (!opt_quiet) {
+		printf("Loading %s", kernel_name);
+		for (i = 1; i < nreqs; i++)
+			printf(" %s", reqs[i].name);
+		printf("... ");
+	}
 
-		    if (!opt_quiet)
-			printf("Loading %s...", initrd_name);
+	/* Load the initrds straight to where they will be booted */
+	if (nreqs > 1)
+		loadfiles_reserve(reqs + 1, nreqs - 1, 4,
+				  INITRAMFS_ADDR_MAX + 1);
+
+	if (loadfiles(reqs, nreqs)) {
+		for (i = 0; !reqs[i].err; i++)
+			;
+		if (!opt_quiet)
+			printf("\n");
+		printf("Loading %s failed: ", reqs[i].name);
+		goto bail;
+	}
 
-		    if (initramfs_load_archive(initramfs, initrd_name)) {
-			if (opt_quiet)
-			    printf("Loading %s ", initrd_name);
-			free(initrd_name);
-			printf("failed: ");
-			goto bail;
-		    }
+	if (!opt_quiet) {
+		printf("ok\n");
+		loadfiles_report(reqs, nreqs);
+	}
 
-		    free(initrd_name);
+	kernel_data = reqs[0].data;
+	kernel_len = reqs[0].len;
 
-		    if (!opt_quiet)
-			printf("ok\n");
-		} while (*temp == ',');
+	if (nreqs > 1) {
+		/* Initialize the initramfs chain */
+		initramfs = initramfs_init();
+		if (!initramfs)
+			goto bail;
+
+		for (i = 1; i < nreqs; i++) {
+			if (initramfs_add_data(initramfs, reqs[i].data,
+					       reqs[i].len, reqs[i].len, 4))
+				goto bail;
+		}
 	}
 
 	/* This should not return... */
@@ -119,5 +148,11 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 bail:
 	free(cmdline);
 	printf("%s\n", strerror(errno));
+	if (reqs) {
+		loadfiles_free(reqs, nreqs);
+		for (i = 1; i < nreqs; i++)
+			free((char *)reqs[i].name);
+		free(reqs);
+	}
 	return 1;
 }
@@ -13,6 +13,7 @@
 
 #include <sys/io.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -104,6 +105,7 @@ unsigned int kbdtimeout = 0;
 static int has_ui = 0;		/* DEFAULT only counts if UI is found */
 extern const char *globaldefault;
 static bool menusave = false;	/* True if there is any "menu save" */
+static bool lazymenu = false;	/* True after "menu lazy" */
 
 /* Linked list of all entires, hidden or not; used by unlabel() */
 static struct menu_entry *all_entries;
@@ -122,6 +124,49 @@ static const struct messages messages[MSG_COUNT] = {
                       if ( __p ) memcpy(__p, __x, __n); \
                       __p; })
 
+/*
+ * Hash tables of menus and entries by label, mirroring the lookups
+ * through menu_list and all_entries: the most recent menu with a given
+ * label wins, and the first entry.
+ */
+#define MENU_HASH_SIZE	256
+#define LABEL_HASH_SIZE	1024
+
+static struct menu *menu_table[MENU_HASH_SIZE];
+static struct menu_entry *label_table[LABEL_HASH_SIZE];
+
+/*
+ * The labels in label_table, sorted, for completing a prefix on the
+ * command line.  Rebuilt when next needed after a label is added.
+ */
+static struct menu_entry **label_index;
+static int label_index_count;
+static bool label_index_stale;
+
+static void hash_menu(struct menu *m)
+{
+    struct menu **head;
+
+    head = &menu_table[label_hash(m->label, strlen(m->label)) % MENU_HASH_SIZE];
+    m->label_next = *head;
+    *head = m;
+}
+
+static void hash_entry(struct menu_entry *me)
+{
+    struct menu_entry **pp;
+
+    pp = &label_table[label_hash(me->label, strlen(me->label)) %
+		      LABEL_HASH_SIZE];
+    for (; *pp; pp = &(*pp)->label_next) {
+	if (!strcmp((*pp)->label, me->label))
+	    return;
+    }
+
+    *pp = me;
+    label_index_stale = true;
+}
+
 /*
  * Search the list of all menus for a specific label
  */
@@ -129,7 +174,8 @@ static struct menu *find_menu(const char *label)
 {
     struct menu *m;
 
-    for (m = menu_list; m; m = m->next) {
+    m = menu_table[label_hash(label, strlen(label)) % MENU_HASH_SIZE];
+    for (; m; m = m->label_next) {
 	if (!strcmp(label, m->label))
 	    return m;
     }
@@ -216,6 +262,8 @@ static struct menu *new_menu(struct menu *parent,
 
 	m->ontimeout = refstr_get(parent->ontimeout);
 	m->onerror = refstr_get(parent->onerror);
+	m->ontimeout_resolved = parent->ontimeout_resolved;
+	m->onerror_resolved = parent->onerror_resolved;
 	m->menu_master_passwd = refstr_get(parent->menu_master_passwd);
 	m->menu_background = refstr_get(parent->menu_background);
 
@@ -240,6 +288,9 @@ static struct menu *new_menu(struct menu *parent,
     m->next = menu_list;
     menu_list = m;
 
+    if (label)
+	hash_menu(m);
+
     return m;
 }
 
@@ -393,6 +444,9 @@ static void record(struct menu *m, struct labeldata *ld, const char *append)
 	    me->passwd = NULL;
 	}
 
+	if (me->label)
+	    hash_entry(me);
+
 	if (ld->menulabel)
 	    consider_for_hotkey(m, me);
 
@@ -458,7 +512,13 @@ static struct menu *begin_submenu(const char *tag)
 	tag = NULL;
 
     me = new_entry(current_menu);
-    me->displayname = refstrdup(tag);
+    /*
+     * MENU TITLE checks whether this still is the very same string to
+     * tell if MENU LABEL was given, so it mustn't be an interned copy
+     * that a MENU LABEL with the same text would share.
+     */
+    if (tag)
+	rsprintf(&me->displayname, "%s", tag);
     return new_menu(current_menu, me, refstr_get(me->displayname));
 }
 
@@ -467,22 +527,89 @@ static struct menu *end_submenu(void)
     return current_menu->parent ? current_menu->parent : current_menu;
 }
 
+static bool load_lazy_menus(void);
+
+static int compare_labels(const void *a, const void *b)
+{
+    const struct menu_entry *ma = *(const struct menu_entry **)a;
+    const struct menu_entry *mb = *(const struct menu_entry **)b;
+
+    return strcmp(ma->label, mb->label);
+}
+
+static void build_label_index(void)
+{
+    struct menu_entry *me, **index;
+    int i, n = 0;
+
+    for (i = 0; i < LABEL_HASH_SIZE; i++) {
+	for (me = label_table[i]; me; me = me->label_next)
+	    n++;
+    }
+
+    index = realloc(label_index, n * sizeof *index);
+    if (!index && n)
+	return;			/* Keep it stale; print_labels copes */
+
+    label_index = index;
+    label_index_count = n;
+    n = 0;
+    for (i = 0; i < LABEL_HASH_SIZE; i++) {
+	for (me = label_table[i]; me; me = me->label_next)
+	    label_index[n++] = me;
+    }
+
+    qsort(label_index, label_index_count, sizeof *label_index,
+	  compare_labels);
+    label_index_stale = false;
+}
+
 void print_labels(const char *prefix, size_t len)
 {
     struct menu_entry *me;
+    int lo, hi, mid;
+
+    load_lazy_menus();
+
+    if (label_index_stale)
+	build_label_index();
 
     printf("\n");
-    for (me = all_entries; me; me = me->next ) {
-	if (!me->label)
-	    continue;
+    if (label_index_stale) {
+	/* No memory for the index; do it the slow way */
+	for (me = all_entries; me; me = me->next ) {
+	    if (!me->label)
+		continue;
+
+	    if (!strncmp(prefix, me->label, len))
+		printf(" %s", me->label);
+	}
+	printf("\n");
+	return;
+    }
 
-	if (!strncmp(prefix, me->label, len))
-	    printf(" %s", me->label);
+    /* The first label not sorting before the prefix */
+    lo = 0;
+    hi = label_index_count;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (strncmp(label_index[mid]->label, prefix, len) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    /* Those with the prefix follow it */
+    for (; lo < label_index_count; lo++) {
+	me = label_index[lo];
+	if (strncmp(prefix, me->label, len))
+	    break;
+	printf(" %s", me->label);
     }
     printf("\n");
 }
 
-struct menu_entry *find_label(const char *str)
+static struct menu_entry *lookup_label(const char *str)
 {
     const char *p;
     struct menu_entry *me;
@@ -495,7 +622,8 @@ struct menu_entry *find_label(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
+    me = label_table[label_hash(str, pos) % LABEL_HASH_SIZE];
+    for (; me; me = me->label_next) {
 	if (!strncmp(str, me->label, pos) && !me->label[pos])
 	    return me;
     }
@@ -503,31 +631,40 @@ struct menu_entry *find_label(const char *str)
     return NULL;
 }
 
+/*
+ * Find the entry for a label, parsing any submenus deferred by MENU
+ * LAZY if it isn't found in what has been parsed so far.
+ */
+struct menu_entry *find_label(const char *str)
+{
+    struct menu_entry *me;
+
+    me = lookup_label(str);
+    if (!me && load_lazy_menus())
+	me = lookup_label(str);
+
+    return me;
+}
+
 static const char *unlabel(const char *str)
 {
     /* Convert a CLI-style command line to an executable command line */
     const char *p;
     const char *q;
     struct menu_entry *me;
-    int pos;
 
+    me = lookup_label(str);
+    if (!me)
+	return str;
+
+    /* Found matching label */
     p = str;
     while (*p && !my_isspace(*p))
 	p++;
 
-    /* p now points to the first byte beyond the kernel name */
-    pos = p - str;
-
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos]) {
-	    /* Found matching label */
-	    rsprintf(&q, "%s%s", me->cmdline, p);
-	    refstr_put(str);
-	    return q;
-	}
-    }
-
-    return str;
+    rsprintf(&q, "%s%s", me->cmdline, p);
+    refstr_put(str);
+    return q;
 }
 
 static const char *__refdup_word(char *p, char **ref)
@@ -812,6 +949,49 @@ bail:
 
 static void parse_config_file(FILE * f);
 
+/*
+ * The body of a submenu which hasn't been parsed yet: either the text
+ * of a MENU BEGIN block or the file named by MENU INCLUDE, along with
+ * the parser state in effect where it was defined.  Bodies are parsed
+ * in the order they were defined, once a label isn't found without
+ * them.
+ */
+struct menu_body {
+    struct menu_body *next;
+    struct menu *menu;
+    char *text;
+    size_t len;
+    const char *file;
+    const char *append;
+    uint32_t sysappends;
+};
+
+static struct menu_body *lazy_bodies;
+static struct menu_body **lazy_bodies_end = &lazy_bodies;
+
+static void defer_menu(struct menu *m, char *text, size_t len,
+		       const char *file)
+{
+    struct menu_body *b = malloc(sizeof *b);
+
+    if (!b) {
+	free(text);
+	return;
+    }
+
+    b->next = NULL;
+    b->menu = m;
+    b->text = text;
+    b->len = len;
+    b->file = refstr_get(file);
+    b->append = refstr_get(append);
+    b->sysappends = SysAppends;
+    m->body = b;
+
+    *lazy_bodies_end = b;
+    lazy_bodies_end = &b->next;
+}
+
 static void do_include_menu(char *str, struct menu *m)
 {
     const char *file;
@@ -823,6 +1003,15 @@ static void do_include_menu(char *str, struct menu *m)
     file = refdup_word(&p);
     p = skipspace(p);
 
+    if (*p && lazymenu) {
+	/* Don't even open the file until the submenu is needed */
+	record(m, &ld, append);
+	m = current_menu = begin_submenu(p);
+	defer_menu(m, NULL, 0, file);
+	m = current_menu = end_submenu();
+	goto put;
+    }
+
     fd = open(file, O_RDONLY);
     if (fd < 0)
 	goto put;
@@ -873,7 +1062,97 @@ put:
     refstr_put(file);
 }
 
-static void parse_config_file(FILE * f)
+/*
+ * Where parse_config() reads lines from: a file, or a buffer in memory
+ * (the main config file, or the text of a compiled config cache).
+ */
+struct config_input {
+    FILE *f;
+    const char *p, *end;
+};
+
+static char *config_gets(char *line, int size, struct config_input *in)
+{
+    const char *nl;
+    size_t len;
+
+    if (in->f)
+	return fgets(line, size, in->f);
+
+    if (in->p >= in->end)
+	return NULL;
+
+    /* Like fgets(), up to and including the newline */
+    nl = memchr(in->p, '\n', in->end - in->p);
+    len = (nl ? nl + 1 : in->end) - in->p;
+    if (len > (size_t)size - 1)
+	len = size - 1;
+
+    memcpy(line, in->p, len);
+    line[len] = '\0';
+    in->p += len;
+    return line;
+}
+
+/*
+ * Copy the lines of a MENU BEGIN block, up to the matching MENU END,
+ * so that the submenu can be parsed later.  Nested blocks and TEXT ...
+ * ENDTEXT are skipped the same way parse_config() would read them.
+ */
+static char *read_menu_block(struct config_input *in, size_t *lenp)
+{
+    char line[MAX_LINE], *p, *q;
+    char *text = NULL;
+    size_t len = 0, size = 0, n;
+    int depth = 0;
+    bool in_text = false, nomem = false;
+
+    while (config_gets(line, sizeof line, in)) {
+	p = skipspace(line);
+
+	if (in_text) {
+	    if (looking_at(p, "endtext"))
+		in_text = false;
+	} else if (looking_at(p, "text")) {
+	    in_text = true;
+	} else if (looking_at(p, "menu")) {
+	    p = skipspace(p + 4);
+	    if (looking_at(p, "begin")) {
+		depth++;
+	    } else if (looking_at(p, "end")) {
+		if (!depth--)
+		    break;
+	    }
+	}
+
+	if (nomem)
+	    continue;
+
+	n = strlen(line);
+	if (len + n > size) {
+	    size = max(size * 2, len + n + 256);
+	    q = realloc(text, size);
+	    if (!q) {
+		nomem = true;	/* The submenu will come up empty */
+		continue;
+	    }
+	    text = q;
+	}
+	memcpy(text + len, line, n);
+	len += n;
+    }
+
+    if (nomem) {
+	free(text);
+	text = NULL;
+	len = 0;
+    }
+
+    *lenp = len;
+    return text;
+}
+
+static void parse_config(struct config_input *in)
 {
     char line[MAX_LINE], *p, *ep, ch;
     enum kernel_type type;
@@ -881,7 +1160,7 @@ static void parse_config_file(FILE * f)
     int fkeyno;
     struct menu *m = current_menu;
 
-    while (fgets(line, sizeof line, f)) {
+    while (config_gets(line, sizeof line, in)) {
 	p = strchr(line, '\r');
 	if (p)
 	    *p = '\0';
@@ -951,6 +1230,7 @@ static void parse_config_file(FILE * f)
 	    } else if (looking_at(p, "onerror")) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
+		m->onerror_resolved = false;
 		onerrorlen = strlen(m->onerror);
 		refstr_put(onerror);
 		onerror = refstrdup(m->onerror);
@@ -966,6 +1246,8 @@ static void parse_config_file(FILE * f)
 		p = skipspace(ep);
 		refstr_put(m->menu_background);
 		m->menu_background = refdup_word(&p);
+	    } else if (looking_at(p, "lazy")) {
+		lazymenu = true;
 	    } else if ((ep = looking_at(p, "hidden"))) {
 		hiddenmenu = 1;
 	    } else if ((ep = is_message_name(p, &msgnr))) {
@@ -1069,6 +1351,13 @@ static void parse_config_file(FILE * f)
 	    } else if (looking_at(p, "begin")) {
 		record(m, &ld, append);
 		m = current_menu = begin_submenu(skipspace(p + 5));
+		if (lazymenu) {
+		    size_t len;
+		    char *text = read_menu_block(in, &len);
+
+		    defer_menu(m, text, len, NULL);
+		    m = current_menu = end_submenu();
+		}
 	    } else if (looking_at(p, "end")) {
 		record(m, &ld, append);
 		m = current_menu = end_submenu();
@@ -1123,7 +1412,7 @@ static void parse_config_file(FILE * f)
 	    if (looking_at(p, "help"))
 		cmd = TEXT_HELP;
 
-	    while (fgets(line, sizeof line, f)) {
+	    while (config_gets(line, sizeof line, in)) {
 		p = skipspace(line);
 		if (looking_at(p, "endtext"))
 		    break;
@@ -1297,6 +1586,7 @@ static void parse_config_file(FILE * f)
 	} else if (looking_at(p, "onerror")) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
+		m->onerror_resolved = false;
 		onerrorlen = strlen(m->onerror);
 		refstr_put(onerror);
 		onerror = refstrdup(m->onerror);
@@ -1310,6 +1600,9 @@ static void parse_config_file(FILE * f)
 		uint16_t port, flow;
 		uint32_t baud;
 
+		/* Don't lose what's queued for the old settings */
+		serial_flush();
+
 		p = skipspace(p + 6);
 		port = strtoul(p, &p, 0);
 
@@ -1393,9 +1686,11 @@ static void parse_config_file(FILE * f)
 		io_delay();
 
 		/* Disable FIFO if unusable */
+		SerialTxFifo = 16;
 		if (inb(port + 2) < 0x0C0) {
 			outb(0, port + 2);
 			io_delay();
+			SerialTxFifo = 1;
 		}
 
 		/* Assert bits in MCR */
@@ -1433,10 +1728,182 @@ static void parse_config_file(FILE * f)
     }
 }
 
+static void parse_config_file(FILE * f)
+{
+    struct config_input in = { .f = f };
+
+    parse_config(&in);
+}
+
+/* Read the rest of f into a malloc()ed buffer */
+static char *read_config_data(FILE *f, size_t *len)
+{
+    char *data = NULL, *p;
+    size_t size = 0, alloc = 0;
+
+    do {
+	alloc += 16384;
+	p = realloc(data, alloc);
+	if (!p) {
+	    free(data);
+	    return NULL;
+	}
+	data = p;
+	size += fread(data + size, 1, alloc - size, f);
+    } while (size == alloc);
+
+    *len = size;
+    return data;
+}
+
+static uint32_t config_checksum(const char *p, size_t len)
+{
+    uint32_t h = 2166136261u;	/* FNV-1a */
+
+    while (len--) {
+	h ^= (uint8_t)*p++;
+	h *= 16777619;
+    }
+
+    return h;
+}
+
+/*
+ * Open the compiled config cache that goes with the config file called
+ * name, if there is one.
+ */
+static FILE *open_config_cache(const char *name)
+{
+    char cache[FILENAME_MAX];
+    char *p;
+
+    if (strlen(name) + sizeof CFGCACHE_SUFFIX > sizeof cache)
+	return NULL;
+
+    strcpy(cache, name);
+    p = strrchr(cache, '/');
+    p = strrchr(p ? p : cache, '.');
+    if (p)
+	*p = '\0';
+    strcat(cache, CFGCACHE_SUFFIX);
+
+    return fopen(cache, "r");
+}
+
+/*
+ * Check that an included file still has the size recorded in the
+ * cache.  Only the size: checking the contents would mean reading
+ * every include, which is what the cache is there to avoid.
+ */
+static bool config_cache_file_ok(const char *data, size_t len,
+				 const struct cfgcache_file *cf)
+{
+    const char *name;
+    struct stat st;
+    bool ok;
+    int fd;
+
+    if (cf->name_offset >= len ||
+	!memchr(data + cf->name_offset, '\0', len - cf->name_offset))
+	return false;
+
+    name = data + cf->name_offset;
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+	return cf->size == CFGCACHE_ABSENT;
+
+    /* A file of unknown length can't be checked */
+    ok = !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size == cf->size;
+    close(fd);
+
+    if (!ok)
+	dprintf("Config cache: %s has changed\n", name);
+    return ok;
+}
+
+/*
+ * Read a compiled config cache, and check that it was made from the
+ * main config file src and the include files it names. Returns the
+ * cache data, with *text and *end bounding the flattened config in it,
+ * or NULL if it can't be used.
+ */
+static char *load_config_cache(FILE *f, const char *src, size_t srclen,
+			       const char **text, const char **end)
+{
+    const struct cfgcache_header *hdr;
+    const struct cfgcache_file *cf;
+    char *data;
+    size_t len;
+    uint32_t i;
+
+    data = read_config_data(f, &len);
+    if (!data)
+	return NULL;
+
+    hdr = (const struct cfgcache_header *)data;
+    if (len < sizeof *hdr || hdr->magic != CFGCACHE_MAGIC ||
+	hdr->version != CFGCACHE_VERSION ||
+	hdr->header_size != sizeof *hdr || hdr->size != len ||
+	hdr->text_offset > len || hdr->text_size > len - hdr->text_offset ||
+	hdr->files_offset > len ||
+	hdr->files_count > (len - hdr->files_offset) / sizeof *cf)
+	goto bad;
+
+    if (hdr->src_size != srclen ||
+	hdr->src_sum != config_checksum(src, srclen)) {
+	dprintf("Config cache is stale\n");
+	goto bad;
+    }
+
+    cf = (const struct cfgcache_file *)(data + hdr->files_offset);
+    for (i = 0; i < hdr->files_count; i++) {
+	if (!config_cache_file_ok(data, len, &cf[i]))
+	    goto bad;
+    }
+
+    *text = data + hdr->text_offset;
+    *end = *text + hdr->text_size;
+    return data;
+
+bad:
+    free(data);
+    return NULL;
+}
+
+/*
+ * The main config file is read whole so that it can be checked against
+ * the compiled cache; if the cache is good, its text is parsed instead,
+ * which spares following the includes.
+ */
+static void parse_main_config_file(FILE *f, FILE *cache)
+{
+    struct config_input in = { .f = f };
+    char *data, *cdata = NULL;
+    size_t len;
+
+    data = read_config_data(f, &len);
+    if (data) {
+	in.f = NULL;
+	in.p = data;
+	in.end = data + len;
+
+	if (cache)
+	    cdata = load_config_cache(cache, data, len, &in.p, &in.end);
+    }
+
+    if (cache)
+	fclose(cache);
+
+    parse_config(&in);
+
+    free(cdata);
+    free(data);
+}
+
 static int parse_main_config(const char *filename)
 {
 	const char *mode = "r";
-	FILE *f;
+	FILE *f, *cache;
 	int fd;
 
 	if (!filename)
@@ -1447,6 +1914,9 @@ static int parse_main_config(const char *filename)
 	if (fd < 0)
 		return fd;
 
+	/* Before the chdir, as the name may be relative */
+	cache = open_config_cache(filename ? filename : ConfigName);
+
 	if (config_cwd[0]) {
 		if (chdir(config_cwd) < 0)
 			printf("Failed to chdir to %s\n", config_cwd);
@@ -1454,7 +1924,7 @@ static int parse_main_config(const char *filename)
 	}
 
 	f = fdopen(fd, mode);
-	parse_config_file(f);
+	parse_main_config_file(f, cache);
 
 	/*
 	 * Update ConfigName so that syslinux_config_file() returns
@@ -1468,12 +1938,11 @@ static int parse_main_config(const char *filename)
 	return 0;
 }
 
-static void resolve_gotos(void)
+static void resolve_gotos(struct menu_entry *me)
 {
-    struct menu_entry *me;
     struct menu *m;
 
-    for (me = all_entries; me; me = me->next) {
+    for (; me; me = me->next) {
 	if (me->action == MA_GOTO_UNRES || me->action == MA_EXIT_UNRES) {
 	    m = find_menu(me->cmdline);
 	    refstr_put(me->cmdline);
@@ -1488,6 +1957,99 @@ static void resolve_gotos(void)
     }
 }
 
+/*
+ * Per-menu initialization, once the labels are known.  ONTIMEOUT and
+ * ONERROR are left alone if they were inherited already resolved and
+ * not set again since; refstrings are interned, so the pointers alone
+ * cannot tell.
+ */
+static void finish_menu(struct menu *m)
+{
+    m->curentry = m->defentry;	/* All menus start at their defaults */
+
+    if (m->ontimeout && !m->ontimeout_resolved)
+	m->ontimeout = unlabel(m->ontimeout);
+    if (m->onerror && !m->onerror_resolved)
+	m->onerror = unlabel(m->onerror);
+    m->ontimeout_resolved = m->onerror_resolved = true;
+}
+
+/*
+ * Parse the body of a submenu deferred by MENU LAZY.  The struct
+ * menu_body itself is freed when load_lazy_menus() takes it off
+ * lazy_bodies.
+ */
+void load_menu(struct menu *m)
+{
+    struct menu_body *b = m->body;
+    struct menu_entry **first = all_entries_end;
+    struct menu *old_list = menu_list, *nm;
+    const char *saved_append = append;
+    uint32_t saved_sysappends = SysAppends;
+
+    if (!b)
+	return;
+    m->body = NULL;
+
+    /* The parser state as it was where the submenu was defined */
+    append = b->append;
+    SysAppends = b->sysappends;
+    current_menu = m;
+
+    if (b->text) {
+	struct config_input in = { .p = b->text, .end = b->text + b->len };
+	parse_config(&in);
+    } else if (b->file) {
+	FILE *f = fopen(b->file, "r");
+
+	if (f) {
+	    parse_config_file(f);
+	    fclose(f);
+	}
+    }
+
+    record(current_menu, &ld, append);
+
+    refstr_put(append);
+    append = saved_append;
+    SysAppends = saved_sysappends;
+
+    resolve_gotos(*first);
+
+    finish_menu(m);
+    for (nm = menu_list; nm != old_list; nm = nm->next)
+	finish_menu(nm);
+
+    free(b->text);
+    b->text = NULL;
+    refstr_put(b->file);
+    b->file = NULL;
+}
+
+/*
+ * Parse all the submenus deferred so far, including any deferred in
+ * turn by them.  Returns true if there were any.
+ */
+static bool load_lazy_menus(void)
+{
+    struct menu_body *b;
+    bool loaded = false;
+
+    while ((b = lazy_bodies)) {
+	lazy_bodies = b->next;
+	if (!lazy_bodies)
+	    lazy_bodies_end = &lazy_bodies;
+
+	if (b->menu->body == b) {
+	    load_menu(b->menu);
+	    loaded = true;
+	}
+	free(b);
+    }
+
+    return loaded;
+}
+
 void parse_configs(char **argv)
 {
     const char *filename;
@@ -1500,6 +2062,14 @@ void parse_configs(char **argv)
     /* feng: reset current menu_list and entry list */
     menu_list = NULL;
     all_entries = NULL;
+    all_entries_end = &all_entries;
+    memset(menu_table, 0, sizeof menu_table);
+    memset(label_table, 0, sizeof label_table);
+    label_index_count = 0;
+    label_index_stale = false;
+    lazy_bodies = NULL;
+    lazy_bodies_end = &lazy_bodies;
+    lazymenu = false;
 
     /* Initialize defaults for the root and hidden menus */
     hide_menu = new_menu(NULL, NULL, refstrdup(".hidden"));
@@ -1528,13 +2098,13 @@ void parse_configs(char **argv)
     record(current_menu, &ld, append);
 
     /* Common postprocessing */
-    resolve_gotos();
+    resolve_gotos(all_entries);
 
     /* Handle global default */
     //if (has_ui && globaldefault) {
     if (globaldefault) {
 	dprintf("gloabldefault = %s", globaldefault);
-	me = find_label(globaldefault);
+	me = lookup_label(globaldefault);
 	if (me && me->menu != hide_menu) {
 	    me->menu->defentry = me->entry;
 	    start_menu = me->menu;
@@ -1550,7 +2120,7 @@ void parse_configs(char **argv)
 	if (lbl && len) {
 	    lstr = refstr_alloc(len);
 	    memcpy(lstr, lbl, len);	/* refstr_alloc() adds the final null */
-	    me = find_label(lstr);
+	    me = lookup_label(lstr);
 	    if (me && me->menu != hide_menu) {
 		me->menu->defentry = me->entry;
 		start_menu = me->menu;
@@ -1560,12 +2130,6 @@ void parse_configs(char **argv)
     }
 
     /* Final per-menu initialization, with all labels known */
-    for (m = menu_list; m; m = m->next) {
-	m->curentry = m->defentry;	/* All menus start at their defaults */
-
-	if (m->ontimeout)
-	    m->ontimeout = unlabel(m->ontimeout);
-	if (m->onerror)
-	    m->onerror = unlabel(m->onerror);
-    }
+    for (m = menu_list; m; m = m->next)
+	finish_menu(m);
 }
@@ -14,13 +14,146 @@
  * refstr.c
  *
  * Simple reference-counted strings
+ *
+ * Strings made by refstrdup() and refstrndup() are interned: equal
+ * strings share one copy, so the kernel names, APPEND lines and so on
+ * that a configuration repeats many times over are only stored once.
+ * Interned strings are carved out of larger chunks rather than each
+ * being a malloc() block of its own; a chunk is freed when the last
+ * string in it is, so discarding a configuration releases its strings
+ * in bulk.  refstr_alloc() buffers are for the caller to fill in, and
+ * are not interned.
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
-#include <sys/module.h>
+#include <stdint.h>
 #include "refstr.h"
+#include <sys/module.h>
+
+/* Set in the reference count of an interned string */
+#define REFSTR_POOLED		0x80000000U
+
+#define REFSTR_HASH_SIZE	1024
+#define REFSTR_CHUNK_SIZE	4096
+
+struct refstr_chunk {
+    unsigned int live;		/* Strings in use in this chunk */
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct refstr_pooled {
+    struct refstr_pooled *next;	/* Hash chain */
+    struct refstr_chunk *chunk;
+    unsigned int hash;
+    unsigned int ref;		/* Must be last, see refstr_get() */
+    char str[];
+};
+
+static struct refstr_pooled *refstr_table[REFSTR_HASH_SIZE];
+static struct refstr_chunk *refstr_chunk;	/* Chunk being filled */
+
+static unsigned int refstr_hash(const char *str, size_t len)
+{
+    uint32_t h = 2166136261u;	/* FNV-1a */
+
+    while (len--) {
+	h ^= (uint8_t)*str++;
+	h *= 16777619;
+    }
+
+    return h;
+}
+
+static struct refstr_chunk *new_chunk(size_t size)
+{
+    struct refstr_chunk *c = malloc(sizeof *c + size);
+
+    if (c) {
+	c->live = 0;
+	c->used = 0;
+	c->size = size;
+    }
+    return c;
+}
+
+static struct refstr_pooled *pool_alloc(size_t len)
+{
+    struct refstr_chunk *c = refstr_chunk;
+    struct refstr_pooled *p;
+    size_t need;
+
+    need = (sizeof *p + len + 1 + sizeof(void *) - 1) &
+	~(sizeof(void *) - 1);
+
+    if (need > REFSTR_CHUNK_SIZE / 4) {
+	/* Big strings get a chunk of their own */
+	c = new_chunk(need);
+    } else if (!c || c->size - c->used < need) {
+	c = new_chunk(REFSTR_CHUNK_SIZE - sizeof *c);
+	if (c) {
+	    if (refstr_chunk && !refstr_chunk->live)
+		free(refstr_chunk);
+	    refstr_chunk = c;
+	}
+    }
+
+    if (!c)
+	return NULL;
+
+    p = (struct refstr_pooled *)(c->data + c->used);
+    c->used += need;
+    c->live++;
+    p->chunk = c;
+    return p;
+}
+
+static void pool_release(struct refstr_pooled *p)
+{
+    struct refstr_pooled **pp = &refstr_table[p->hash % REFSTR_HASH_SIZE];
+    struct refstr_chunk *c = p->chunk;
+
+    while (*pp != p)
+	pp = &(*pp)->next;
+    *pp = p->next;
+
+    if (!--c->live) {
+	if (c == refstr_chunk)
+	    c->used = 0;	/* Start over */
+	else
+	    free(c);
+    }
+}
+
+/* Return a new reference to the interned copy of len bytes of str */
+static const char *refstr_intern(const char *str, size_t len)
+{
+    unsigned int hash = refstr_hash(str, len);
+    struct refstr_pooled **head = &refstr_table[hash % REFSTR_HASH_SIZE];
+    struct refstr_pooled *p;
+
+    for (p = *head; p; p = p->next) {
+	if (p->hash == hash && !strncmp(p->str, str, len) && !p->str[len])
+	    return refstr_get(p->str);
+    }
+
+    p = pool_alloc(len);
+    if (!p)
+	return NULL;
+
+    p->hash = hash;
+    p->ref = REFSTR_POOLED | 1;
+    memcpy(p->str, str, len);
+    p->str[len] = '\0';
+
+    p->next = *head;
+    *head = p;
+    return p->str;
+}
 
 /* Allocate space for a refstring of len bytes, plus final null */
 /* The final null is inserted in the string; the rest is uninitialized. */
@@ -37,31 +170,18 @@ char *refstr_alloc(size_t len)
 
 const char *refstrndup(const char *str, size_t len)
 {
-    char *r;
-
     if (!str)
 	return NULL;
 
-    len = strnlen(str, len);
-    r = refstr_alloc(len);
-    if (r)
-	memcpy(r, str, len);
-    return r;
+    return refstr_intern(str, strnlen(str, len));
 }
 
 const char *refstrdup(const char *str)
 {
-    char *r;
-    size_t len;
-
     if (!str)
 	return NULL;
 
-    len = strlen(str);
-    r = refstr_alloc(len);
-    if (r)
-	memcpy(r, str, len);
-    return r;
+    return refstr_intern(str, strlen(str));
 }
 
 int vrsprintf(const char **bufp, const char *fmt, va_list ap)
@@ -100,7 +220,11 @@ void refstr_put(const char *r)
     if (r) {
 	ref = (unsigned int *)r - 1;
 
-	if (!--*ref)
-	    free(ref);
+	if (!(--*ref & ~REFSTR_POOLED)) {
+	    if (*ref & REFSTR_POOLED)
+		pool_release(container_of(ref, struct refstr_pooled, ref));
+	    else
+		free(ref);
+	}
     }
 }
@@ -19,11 +19,29 @@
 
 enum { MCFG_TABLE_FOUND = 1 };
 
+#define MAX_MCFG_ENTRIES 16
+
+/* Reserved bytes between the header and the first allocation entry */
+#define MCFG_RESERVED_SIZE 8
+
+/* PCI Express memory mapped configuration space base address allocation */
+typedef struct {
+    uint64_t base_address;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__ ((packed)) s_mcfg_entry;
+
 typedef struct {
     uint64_t *address;
     s_acpi_description_header header;
-    /* What's inside ? */
     bool valid;
+    s_mcfg_entry entry[MAX_MCFG_ENTRIES];
+    uint8_t entry_count;
 } s_mcfg;
 
+void parse_mcfg(s_mcfg * mcfg);
+int mcfg_set_pci_ecam(s_mcfg * mcfg);
+
 #endif
@@ -239,6 +239,7 @@ bool parse_header(uint64_t *address, s_acpi *acpi) {
 		m->valid = true;
 		m->address = address;
 		memcpy(&m->header, &adh, sizeof(adh));
+		parse_mcfg(m);
 	    } else if (memcmp(adh.signature, SLIC, sizeof(SLIC) - 1) == 0) {
 		DEBUG_PRINT(("SLIC table found\n"));
 		s_slic *s = &acpi->slic;
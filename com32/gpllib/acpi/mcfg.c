@@ -0,0 +1,55 @@
+/*
+ * acpi/mcfg.c
+ *
+ * Parse the PCI Express memory mapped configuration space (MCFG) table,
+ * and hand its windows over to the PCI library.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <dprintf.h>
+#include <sys/pci.h>
+#include "acpi/acpi.h"
+
+void parse_mcfg(s_mcfg * m)
+{
+    uint8_t *q;
+    uint32_t len;
+
+    q = (uint8_t *)m->address;
+    len = m->header.length;
+    q += ACPI_HEADER_SIZE + MCFG_RESERVED_SIZE;
+
+    m->entry_count = 0;
+    while (q + sizeof(s_mcfg_entry) <= (uint8_t *)m->address + len &&
+	   m->entry_count < MAX_MCFG_ENTRIES) {
+	s_mcfg_entry *e = &m->entry[m->entry_count];
+	cp_struct(e);
+	dprintf("MCFG: segment %04x buses %02x-%02x at 0x%llx\n",
+		e->segment, e->start_bus, e->end_bus, e->base_address);
+	m->entry_count++;
+    }
+}
+
+/*
+ * Use the MCFG windows for PCI configuration space accesses.
+ * Returns the number of windows the PCI library could use.
+ */
+int mcfg_set_pci_ecam(s_mcfg * m)
+{
+    struct pci_ecam_region regions[MAX_MCFG_ENTRIES];
+    int i;
+
+    if (!m->valid)
+	return 0;
+
+    for (i = 0; i < m->entry_count; i++) {
+	regions[i].base = m->entry[i].base_address;
+	regions[i].segment = m->entry[i].segment;
+	regions[i].start_bus = m->entry[i].start_bus;
+	regions[i].end_bus = m->entry[i].end_bus;
+    }
+
+    return pci_set_ecam_regions(regions, m->entry_count);
+}
@@ -553,6 +553,10 @@ void detect_pci(struct s_hardware *hardware)
 
     hardware->nb_pci_devices = 0;
 
+    /* Use memory-mapped configuration space when ACPI describes it */
+    if (hardware->is_acpi_valid)
+	mcfg_set_pci_ecam(&hardware->acpi.mcfg);
+
     /* Scanning to detect pci buses and devices */
     hardware->pci_domain = pci_scan();
 
@@ -125,6 +125,13 @@ void *lzalloc(size_t);
 void lfree(void *);
 char *lstrdup(const char *);
 
+/*
+ * Allocate a buffer as high as possible, for data which is to be
+ * handed over where it is (see <syslinux/loadfile.h>).  Returns NULL
+ * if the firmware can't do that.
+ */
+void *malloc_high(size_t, size_t, uintptr_t);
+
 /*
  * These functions convert between linear pointers in the range
  * 0..0xFFFFF and real-mode style SEG:OFFS pointers.  Note that a
@@ -63,6 +63,7 @@ struct menu_entry {
     const char *background;
     struct menu *submenu;
     struct menu_entry *next;	/* Linked list of all labels across menus */
+    struct menu_entry *label_next;	/* Hash chain by label */
     int entry;			/* Entry number inside menu */
     enum menu_action action;
     unsigned char hotkey;
@@ -141,6 +142,7 @@ struct fkey_help {
 
 struct menu {
     struct menu *next;		/* Linked list of all menus */
+    struct menu *label_next;	/* Hash chain by label */
     const char *label;		/* Goto label for this menu */
     struct menu *parent;
     struct menu_entry *parent_entry;	/* Entry for self in parent */
@@ -166,12 +168,16 @@ struct menu {
     const char *title;
     const char *ontimeout;
     const char *onerror;
+    bool ontimeout_resolved;	/* ONTIMEOUT went through unlabel() */
+    bool onerror_resolved;	/* ONERROR went through unlabel() */
     const char *menu_master_passwd;
     const char *menu_background;
 
     struct color_table *color_table;
 
     struct fkey_help fkeyhelp[12];
+
+    struct menu_body *body;	/* Not parsed yet, see MENU LAZY */
 };
 
 extern struct menu *root_menu, *start_menu, *hide_menu, *menu_list;
@@ -188,11 +194,23 @@ extern clock_t kbdtimeout;
 extern const char *hide_key[KEY_MAX];
 
 void parse_configs(char **argv);
+void load_menu(struct menu *m);
 int draw_background(const char *filename);
 void set_resolution(int x, int y);
 void start_console(void);
 void local_cursor_enable(bool);
 
+/* Hash of the first len bytes of a label, for the label and menu tables */
+static inline unsigned int label_hash(const char *str, size_t len)
+{
+    unsigned int h = 0;
+
+    while (len--)
+	h = h * 31 + (unsigned char)*str++;
+
+    return h;
+}
+
 static inline int my_isspace(char c)
 {
     return (unsigned char)c <= ' ' || (unsigned char)c == '\x7f';
@@ -225,6 +243,13 @@ extern const int message_base_color;
 extern const char *current_background;
 void set_background(const char *new_background);
 
+/* screen.c */
+void screen_reset(void);
+void screen_putchar(int ch);
+void screen_puts(const char *s);
+void screen_printf(const char *fmt, ...);
+void screen_flush(void);
+
 /* drain.c */
 void drain_keyboard(void);
 
@@ -0,0 +1,48 @@
+#ifndef _SYS_MODBUNDLE_H
+#define _SYS_MODBUNDLE_H
+
+/*
+ * Module bundle, as produced by utils/mkmodbundle: several ELF modules
+ * packed in one file so that a set of modules can be fetched with a
+ * single read.  Everything is little endian.
+ *
+ * The file starts with a struct modbundle_header, followed by the
+ * entries, a string table holding the module names, and the module
+ * images themselves, each aligned to MODBUNDLE_ALIGN bytes.
+ *
+ * The entries are in load order: every module comes after the modules
+ * named in its DT_NEEDED entries.
+ *
+ * A bundle is made for one core build, named by its build ID (the DATE
+ * string the core was built with, as shown in its banner).  The core
+ * ignores bundles made for any other build, since their modules are
+ * likely older than the files installed with it.
+ */
+
+#include <inttypes.h>
+
+#define MODBUNDLE_MAGIC		0x444d4243	/* "CBMD" */
+#define MODBUNDLE_VERSION	2
+#define MODBUNDLE_ALIGN		16
+
+/* Opened by the core, from PATH, before it loads LDLINUX */
+#define MODBUNDLE_FILE		"modules.cbd"
+
+struct modbundle_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;	/* sizeof(struct modbundle_header) */
+    uint32_t size;		/* Total file size */
+    uint32_t count;		/* Number of entries */
+    uint32_t strtab_offset;
+    uint32_t strtab_size;
+    uint32_t build_id;		/* Offset in the string table */
+} __attribute__ ((packed));
+
+struct modbundle_entry {
+    uint32_t name;		/* Offset in the string table */
+    uint32_t offset;		/* Of the image, from the start of the file */
+    uint32_t size;		/* Of the image */
+} __attribute__ ((packed));
+
+#endif /* _SYS_MODBUNDLE_H */
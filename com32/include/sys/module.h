@@ -84,6 +84,7 @@ typedef void (*module_ctor_t) (void);
  *  the modules currently loaded.
  */
 struct atexit;
+struct module_sym;
 struct elf_module {
 	char				name[MODULE_NAME_SIZE]; 		// The module name
 
@@ -112,12 +113,16 @@ struct elf_module {
 	Elf_Word			syment_size;	// The size of a symbol entry
 	Elf_Word			symtable_size;	// The size of the symbol table
 
+	struct module_sym	*sym_index;	// Our entries in the global symbol index
+	int				nr_sym_index;
 
 	union {
 		// Transient - Data available while the module is loading
 		struct {
-			FILE		*_file;		// The file object of the open file
-			Elf_Off	_cr_offset;	// The current offset in the open file
+			char		*_image;	// The whole module file
+			size_t		_image_size;
+			Elf_Off	_cr_offset;	// The current offset in the image
+			int		_image_bundled;	// _image is in the module bundle
 		} l;
 
 		// Process execution data
@@ -155,6 +160,33 @@ extern struct elf_module *unload_modules_since(const char *name);
 
 extern FILE *findpath(char *name);
 
+/**
+ * module_bundle_open - use a module bundle made by utils/mkmodbundle.
+ * @name:	the file name of the bundle.
+ * @build_id:	the build ID of the running core.
+ *
+ * While the bundle is open, the modules it contains are loaded from it
+ * rather than from their own files. A bundled module that fails to load
+ * is retried from its own file. The bundle is closed again by
+ * spawn_load() once it has loaded LDLINUX and the program LDLINUX loads
+ * next (the UI or DEFAULT module), with the modules they need.
+ * Returns the number of bundled modules, or -1 if the bundle is missing,
+ * invalid or made for another core build.
+ */
+extern int module_bundle_open(const char *name, const char *build_id);
+
+/**
+ * module_bundle_close - stop using the module bundle and free it.
+ */
+extern void module_bundle_close(void);
+
+/**
+ * module_bundle_loaded - note that spawn_load() has loaded a program.
+ *
+ * Closes the bundle once the programs it is meant for are loaded.
+ */
+extern void module_bundle_loaded(void);
+
 
 /**
  * Names of symbols with special meaning (treated as special cases at linking)
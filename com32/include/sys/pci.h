@@ -13,6 +13,7 @@
 #define PCI_CLASS_NAME_SIZE	256
 #define MAX_KERNEL_MODULES_PER_PCI_DEVICE 10
 #define MAX_PCI_CLASSES		256
+#define MAX_PCI_ECAM_REGIONS	 16
 
 typedef uint32_t pciaddr_t;
 
@@ -70,6 +71,15 @@ struct pci_bus {
 /* PCI domain structure */
 struct pci_domain {
     struct pci_bus *bus[MAX_PCI_BUSES];
+    uint16_t segment;		/* PCI segment group of this domain */
+};
+
+/* A memory-mapped (ECAM/MMCONFIG) configuration space window */
+struct pci_ecam_region {
+    uint64_t base;		/* Address of bus 0 (not start_bus), dev 0, func 0 */
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
 };
 
 /* Iterate over a PCI domain */
@@ -141,7 +151,11 @@ void pci_writeb(uint8_t, pciaddr_t);
 void pci_writew(uint16_t, pciaddr_t);
 void pci_writel(uint32_t, pciaddr_t);
 
+int pci_set_ecam_regions(const struct pci_ecam_region *regions, int count);
+uint16_t pci_set_segment(uint16_t segment);
+
 struct pci_domain *pci_scan(void);
+struct pci_domain *pci_scan_segment(uint16_t segment);
 void free_pci_domain(struct pci_domain *domain);
 struct match *find_pci_device(const struct pci_domain *pci_domain,
 			      struct match *list);
@@ -0,0 +1,59 @@
+#ifndef _SYS_PCIDB_H
+#define _SYS_PCIDB_H
+
+/*
+ * Binary PCI identification database, as produced by utils/mkpcidb from
+ * pci.ids and/or modules.alias.  Everything is little endian.
+ *
+ * The file starts with a struct pcidb_header, followed by the tables and
+ * a string table.  Each table is an array of struct pcidb_entry sorted by
+ * their id[] fields, compared as a tuple; unused ids are zero.  Names are
+ * byte offsets of NUL-terminated strings in the string table.
+ *
+ *   PCIDB_VENDOR	id = { vendor }
+ *   PCIDB_DEVICE	id = { vendor, device }
+ *   PCIDB_SUBSYS	id = { vendor, device, subvendor, subdevice }
+ *   PCIDB_CLASS	id = { class }
+ *   PCIDB_SUBCLASS	id = { class, subclass }
+ *   PCIDB_ALIAS	id = { vendor, device, subvendor, subdevice }
+ *
+ * In PCIDB_ALIAS, a subvendor or subdevice of 0xffff matches any value,
+ * and there can be several entries (modules) for the same ids.
+ */
+
+#include <inttypes.h>
+
+#define PCIDB_MAGIC	0x42444350	/* "PCDB" */
+#define PCIDB_VERSION	1
+
+enum pcidb_table_id {
+    PCIDB_VENDOR,
+    PCIDB_DEVICE,
+    PCIDB_SUBSYS,
+    PCIDB_CLASS,
+    PCIDB_SUBCLASS,
+    PCIDB_ALIAS,
+    PCIDB_NR_TABLES
+};
+
+struct pcidb_table {
+    uint32_t offset;		/* From the start of the file */
+    uint32_t count;		/* Number of entries */
+} __attribute__ ((packed));
+
+struct pcidb_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;	/* sizeof(struct pcidb_header) */
+    uint32_t size;		/* Total file size */
+    uint32_t strtab_offset;
+    uint32_t strtab_size;
+    struct pcidb_table table[PCIDB_NR_TABLES];
+} __attribute__ ((packed));
+
+struct pcidb_entry {
+    uint16_t id[4];
+    uint32_t name;		/* Offset in the string table */
+} __attribute__ ((packed));
+
+#endif /* _SYS_PCIDB_H */
@@ -44,6 +44,7 @@ struct mem_ops {
 	void *(*malloc)(size_t, enum heap, size_t);
 	void *(*realloc)(void *, size_t);
 	void (*free)(void *);
+	void *(*malloc_high)(size_t, size_t, uintptr_t, size_t);
 };
 
 struct initramfs;
@@ -62,6 +63,8 @@ struct firmware {
 			  struct setup_data *, char *);
 	struct vesa_ops *vesa;
 	struct mem_ops *mem;
+	/* Run func on each of args concurrently; NULL if not supported */
+	int (*run_threads)(void (*)(void *), void **, int);
 };
 
 extern struct firmware *firmware;
@@ -53,6 +53,9 @@ struct initramfs {
 };
 #define INITRAMFS_MAX_ALIGN	4096
 
+/* Highest initramfs address every kernel accepts (boot protocol < 2.03) */
+#define INITRAMFS_ADDR_MAX	0x37ffffff
+
 struct setup_data_header {
 	uint64_t next;
 	uint32_t type;
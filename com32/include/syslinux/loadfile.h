@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 /* loadfile() returns the true size of the file, but will guarantee valid,
    zero-padded memory out to this boundary. */
@@ -12,4 +13,20 @@ int loadfile(const char *, void **, size_t *);
 int zloadfile(const char *, void **, size_t *);
 int floadfile(FILE *, void **, size_t *, const void *, size_t);
 
+/* One file of a loadfiles() batch */
+struct loadfile_req {
+    const char *name;		/* In: file to load */
+    void *data;			/* Out: as for loadfile() */
+    size_t len;
+    int err;			/* Out: errno, or 0 on success */
+    uint32_t ms;		/* Out: time the load took */
+    FILE *f;			/* Private: opened by loadfiles_reserve() */
+    void *reserved;		/* Private: loadfiles_reserve() buffer */
+};
+
+int loadfiles(struct loadfile_req *, int);
+void *loadfiles_reserve(struct loadfile_req *, int, size_t, uintptr_t);
+void loadfiles_report(const struct loadfile_req *, int);
+void loadfiles_free(struct loadfile_req *, int);
+
 #endif
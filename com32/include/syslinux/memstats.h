@@ -0,0 +1,49 @@
+#ifndef _SYSLINUX_MEMSTATS_H
+#define _SYSLINUX_MEMSTATS_H
+
+/*
+ * Accounting for the core heaps, see com32/modules/meminfo.c for a
+ * user.  Sizes include the arena headers.  Only the BIOS allocator
+ * keeps these; under EFI the counters stay 0.
+ */
+
+#include <stddef.h>
+
+enum syslinux_heap {
+    SYSLINUX_HEAP_MAIN,
+    SYSLINUX_HEAP_LOWMEM,
+};
+
+struct syslinux_heap_stats {
+    size_t used_bytes;
+    size_t used_blocks;
+    size_t peak_bytes;		/* High water mark of used_bytes */
+    size_t free_bytes;
+    size_t free_blocks;
+    size_t largest_free;	/* Biggest allocation which can succeed */
+    unsigned long mallocs;
+    unsigned long frees;
+    unsigned long failures;	/* Allocations which returned NULL */
+};
+
+/*
+ * An owner is whoever a block was allocated for: the core, a COMBOOT
+ * image (low memory), or the module which was running at the time.
+ */
+struct syslinux_mem_owner {
+    size_t tag;
+    const char *name;		/* Valid until the module is unloaded */
+    size_t bytes;		/* Both heaps */
+    size_t blocks;
+    size_t peak;
+};
+
+/* Who new allocations are charged to; set by the module loader */
+size_t __mem_get_tag_global(void);
+void __mem_set_tag_global(size_t tag);
+
+int syslinux_heap_stats(enum syslinux_heap heap,
+			struct syslinux_heap_stats *stats);
+int syslinux_mem_owners(struct syslinux_mem_owner *owners, int max);
+
+#endif /* _SYSLINUX_MEMSTATS_H */
@@ -0,0 +1,116 @@
+/*
+ * pci/ecam.c
+ *
+ * Memory-mapped (PCI Express ECAM, a.k.a. MMCONFIG) configuration space
+ * access. The windows are normally described by the ACPI MCFG table and
+ * registered by the caller; without them, only segment 0 is reachable,
+ * through the legacy configuration mechanisms.
+ */
+
+#include <string.h>
+#include "pci/pci.h"
+
+uint16_t __pci_cfg_segment;
+int __pci_ecam_count;
+
+static struct pci_ecam_region ecam_regions[MAX_PCI_ECAM_REGIONS];
+
+/*
+ * Register the ECAM windows to use for configuration accesses. Windows
+ * which are not addressable from 32-bit protected mode are skipped.
+ * Returns the number of windows retained.
+ */
+int pci_set_ecam_regions(const struct pci_ecam_region *regions, int count)
+{
+    const struct pci_ecam_region *r;
+    uint64_t end;
+    int n = 0;
+
+    for (r = regions; r < regions + count && n < MAX_PCI_ECAM_REGIONS; r++) {
+	if (r->end_bus < r->start_bus)
+	    continue;
+
+	/* The base is that of bus 0, whatever bus the window starts at */
+	end = r->base + ((uint64_t)(r->end_bus + 1) << 20);
+	if (!r->base || end > 0x100000000ULL)
+	    continue;
+
+	ecam_regions[n++] = *r;
+    }
+
+    __pci_ecam_count = n;
+    return n;
+}
+
+/*
+ * Select the segment group subsequent configuration accesses go to.
+ * Returns the previously selected segment.
+ */
+uint16_t pci_set_segment(uint16_t segment)
+{
+    uint16_t old = __pci_cfg_segment;
+
+    __pci_cfg_segment = segment;
+    return old;
+}
+
+static const struct pci_ecam_region *ecam_find(uint16_t segment,
+					       unsigned int bus)
+{
+    const struct pci_ecam_region *r;
+
+    for (r = ecam_regions; r < ecam_regions + __pci_ecam_count; r++) {
+	if (r->segment == segment &&
+	    bus >= r->start_bus && bus <= r->end_bus)
+	    return r;
+    }
+
+    return NULL;
+}
+
+/*
+ * Map a configuration address of the current segment to its ECAM
+ * location, or return NULL if no window covers it.
+ */
+void *__pci_ecam_ptr(pciaddr_t a)
+{
+    const struct pci_ecam_region *r;
+    unsigned int bus = pci_bus(a);
+
+    if (!__pci_ecam_count)
+	return NULL;
+
+    r = ecam_find(__pci_cfg_segment, bus);
+    if (!r)
+	return NULL;
+
+    return (void *)(uintptr_t)(r->base +
+			       (bus << 20) +
+			       (pci_dev(a) << 15) +
+			       (pci_func(a) << 12) +
+			       (a & 0xff));
+}
+
+/*
+ * Get the range of buses decoded by the ECAM windows of a segment.
+ * Returns 0 if the segment has no window.
+ */
+int __pci_ecam_bus_range(uint16_t segment, unsigned int *start,
+			 unsigned int *end)
+{
+    const struct pci_ecam_region *r;
+    int found = 0;
+
+    for (r = ecam_regions; r < ecam_regions + __pci_ecam_count; r++) {
+	if (r->segment != segment)
+	    continue;
+
+	if (!found || r->start_bus < *start)
+	    *start = r->start_bus;
+	if (!found || r->end_bus > *end)
+	    *end = r->end_bus;
+	found = 1;
+    }
+
+    return found;
+}
@@ -8,8 +8,36 @@
 
 #include <sys/pci.h>
 #include <sys/cpu.h>
+#include <sys/pcidb.h>
+#include <stdbool.h>
 
 extern enum pci_config_type __pci_cfg_type;
 extern uint32_t __pci_read_write_bios(uint32_t call, uint32_t v, pciaddr_t a);
 
+extern uint16_t __pci_cfg_segment;
+extern int __pci_ecam_count;
+extern void *__pci_ecam_ptr(pciaddr_t a);
+extern int __pci_ecam_bus_range(uint16_t segment, unsigned int *start,
+				unsigned int *end);
+
+struct pcidb {
+    const struct pcidb_header *hdr;
+    const char *strtab;
+    uint32_t size;
+};
+
+extern struct pcidb *pcidb_load(const char *path);
+extern void pcidb_free(struct pcidb *db);
+extern const struct pcidb_entry *pcidb_find(const struct pcidb *db,
+					    enum pcidb_table_id table,
+					    const uint16_t *id, int nids);
+extern const struct pcidb_entry *pcidb_next(const struct pcidb *db,
+					    enum pcidb_table_id table,
+					    const struct pcidb_entry *e,
+					    int nids);
+extern const char *pcidb_name(const struct pcidb *db,
+			      const struct pcidb_entry *e);
+extern uint32_t pcidb_count(const struct pcidb *db,
+			    enum pcidb_table_id table);
+
 #endif /* PCI_PCI_H */
@@ -0,0 +1,163 @@
+/*
+ * pci/pcidb.c
+ *
+ * Loader and lookups for the binary PCI identification database
+ * (see <sys/pcidb.h>). The whole file is read in one go and searched
+ * in place, instead of parsing pci.ids or modules.alias line by line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslinux/zio.h>
+#include <dprintf.h>
+#include "pci/pci.h"
+
+static bool pcidb_valid(const struct pcidb *db)
+{
+    const struct pcidb_header *hdr = db->hdr;
+    const struct pcidb_table *t;
+    int i;
+
+    if (hdr->strtab_offset > db->size ||
+	hdr->strtab_size > db->size - hdr->strtab_offset ||
+	!hdr->strtab_size || db->strtab[hdr->strtab_size - 1])
+	return false;
+
+    for (i = 0; i < PCIDB_NR_TABLES; i++) {
+	t = &hdr->table[i];
+	if (t->offset > db->size ||
+	    t->count > (db->size - t->offset) / sizeof(struct pcidb_entry))
+	    return false;
+    }
+
+    return true;
+}
+
+/*
+ * Load a binary database. Returns NULL if the file can't be opened or
+ * doesn't hold a valid database, in which case the caller should fall
+ * back to parsing it as text.
+ */
+struct pcidb *pcidb_load(const char *path)
+{
+    struct pcidb_header hdr;
+    struct pcidb *db;
+    char *data;
+    FILE *f;
+
+    f = zfopen(path, "r");
+    if (!f)
+	return NULL;
+
+    if (fread(&hdr, 1, sizeof hdr, f) != sizeof hdr ||
+	hdr.magic != PCIDB_MAGIC || hdr.version != PCIDB_VERSION ||
+	hdr.header_size != sizeof hdr || hdr.size < sizeof hdr)
+	goto close;
+
+    db = malloc(sizeof *db + hdr.size);
+    if (!db)
+	goto close;
+
+    data = (char *)(db + 1);
+    memcpy(data, &hdr, sizeof hdr);
+    if (fread(data + sizeof hdr, 1, hdr.size - sizeof hdr, f) !=
+	hdr.size - sizeof hdr)
+	goto free;
+
+    db->hdr = (const struct pcidb_header *)data;
+    db->size = hdr.size;
+    db->strtab = data + hdr.strtab_offset;
+
+    if (!pcidb_valid(db))
+	goto free;
+
+    fclose(f);
+    dprintf("pcidb: loaded %s (%u bytes)\n", path, hdr.size);
+    return db;
+
+free:
+    free(db);
+close:
+    fclose(f);
+    return NULL;
+}
+
+void pcidb_free(struct pcidb *db)
+{
+    free(db);
+}
+
+static int pcidb_cmp(const struct pcidb_entry *e, const uint16_t *id,
+		     int nids)
+{
+    int i;
+
+    for (i = 0; i < nids; i++) {
+	if (e->id[i] != id[i])
+	    return e->id[i] < id[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Find the first entry of the given table whose leading nids ids equal
+ * id[]. Entries sharing these ids follow it; use pcidb_next() to walk
+ * them.
+ */
+const struct pcidb_entry *pcidb_find(const struct pcidb *db,
+				     enum pcidb_table_id table,
+				     const uint16_t *id, int nids)
+{
+    const struct pcidb_table *t = &db->hdr->table[table];
+    const struct pcidb_entry *base;
+    uint32_t lo = 0, hi = t->count, mid;
+
+    base = (const struct pcidb_entry *)((const char *)db->hdr + t->offset);
+
+    /* Lower bound */
+    while (lo < hi) {
+	mid = lo + ((hi - lo) >> 1);
+	if (pcidb_cmp(&base[mid], id, nids) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    if (lo < t->count && !pcidb_cmp(&base[lo], id, nids))
+	return &base[lo];
+
+    return NULL;
+}
+
+const struct pcidb_entry *pcidb_next(const struct pcidb *db,
+				     enum pcidb_table_id table,
+				     const struct pcidb_entry *e, int nids)
+{
+    const struct pcidb_table *t = &db->hdr->table[table];
+    const struct pcidb_entry *end;
+    uint16_t id[4];
+
+    end = (const struct pcidb_entry *)((const char *)db->hdr + t->offset) +
+	t->count;
+
+    memcpy(id, e->id, sizeof id);
+    if (e + 1 < end && !pcidb_cmp(e + 1, id, nids))
+	return e + 1;
+
+    return NULL;
+}
+
+const char *pcidb_name(const struct pcidb *db, const struct pcidb_entry *e)
+{
+    if (e->name >= db->hdr->strtab_size)
+	return "";
+
+    return db->strtab + e->name;
+}
+
+uint32_t pcidb_count(const struct pcidb *db, enum pcidb_table_id table)
+{
+    return db->hdr->table[table].count;
+}
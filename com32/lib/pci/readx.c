@@ -3,6 +3,14 @@
 TYPE BWL(pci_read) (pciaddr_t a)
 {
     TYPE r;
+    volatile TYPE *p;
+
+    p = __pci_ecam_ptr(a);
+    if (p)
+	return *p;
+
+    if (__pci_cfg_segment)
+	return (TYPE) ~ 0;	/* Other segments are only reachable via ECAM */
 
     for (;;) {
 	switch (__pci_cfg_type) {
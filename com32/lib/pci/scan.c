@@ -43,6 +43,8 @@
 #include <syslinux/zio.h>
 #include <dprintf.h>
 
+#include "pci/pci.h"
+
 #define MAX_LINE 512
 
 /* removing any \n found in a string */
@@ -61,6 +63,104 @@ static int hex_to_int(char *hexa)
     return strtoul(hexa, NULL, 16);
 }
 
+/* Assign vendor & product names from a binary database */
+static void pcidb_get_names(struct pci_domain *domain, const struct pcidb *db)
+{
+    const struct pcidb_entry *e;
+    struct pci_device *dev;
+    uint16_t id[4];
+
+    for_each_pci_func(dev, domain) {
+	id[0] = dev->vendor;
+	id[1] = dev->product;
+	id[2] = dev->sub_vendor;
+	id[3] = dev->sub_product;
+
+	e = pcidb_find(db, PCIDB_VENDOR, id, 1);
+	if (!e)
+	    continue;
+	strlcpy(dev->dev_info->vendor_name, pcidb_name(db, e),
+		PCI_VENDOR_NAME_SIZE - 1);
+
+	/* The subsystem name is more precise than the product one */
+	e = pcidb_find(db, PCIDB_SUBSYS, id, 4);
+	if (!e)
+	    e = pcidb_find(db, PCIDB_DEVICE, id, 2);
+	if (e)
+	    strlcpy(dev->dev_info->product_name, pcidb_name(db, e),
+		    PCI_PRODUCT_NAME_SIZE - 1);
+    }
+}
+
+/* Assign class names from a binary database */
+static void pcidb_get_class_names(struct pci_domain *domain,
+				  const struct pcidb *db)
+{
+    const struct pcidb_entry *e;
+    struct pci_device *dev;
+    uint16_t id[2];
+
+    for_each_pci_func(dev, domain) {
+	id[0] = dev->class[2];
+	id[1] = dev->class[1];
+
+	e = pcidb_find(db, PCIDB_CLASS, id, 1);
+	if (!e)
+	    continue;
+	/* Same layout as what the pci.ids parser produces */
+	snprintf(dev->dev_info->class_name, PCI_CLASS_NAME_SIZE - 1,
+		 "%02x  %s", id[0], pcidb_name(db, e));
+	strlcpy(dev->dev_info->category_name, pcidb_name(db, e),
+		PCI_CLASS_NAME_SIZE - 1);
+
+	e = pcidb_find(db, PCIDB_SUBCLASS, id, 2);
+	if (e)
+	    strlcpy(dev->dev_info->class_name, pcidb_name(db, e),
+		    PCI_CLASS_NAME_SIZE - 1);
+    }
+}
+
+/* Assign kernel modules from the aliases of a binary database */
+static void pcidb_get_module_names(struct pci_domain *domain,
+				   const struct pcidb *db)
+{
+    const struct pcidb_entry *e;
+    struct pci_device *dev;
+    const char *module_name;
+    uint16_t id[2];
+    bool found;
+    int i;
+
+    for_each_pci_func(dev, domain) {
+	id[0] = dev->vendor;
+	id[1] = dev->product;
+
+	for (e = pcidb_find(db, PCIDB_ALIAS, id, 2); e;
+	     e = pcidb_next(db, PCIDB_ALIAS, e, 2)) {
+	    if ((e->id[2] & dev->sub_vendor) != dev->sub_vendor ||
+		(e->id[3] & dev->sub_product) != dev->sub_product)
+		continue;
+
+	    module_name = pcidb_name(db, e);
+	    found = false;
+	    for (i = 0; i < dev->dev_info->linux_kernel_module_count; i++) {
+		if (strstr(dev->dev_info->linux_kernel_module[i],
+			   module_name)) {
+		    found = true;
+		    break;
+		}
+	    }
+
+	    if (!found && dev->dev_info->linux_kernel_module_count <
+		MAX_KERNEL_MODULES_PER_PCI_DEVICE) {
+		strlcpy(dev->dev_info->linux_kernel_module
+			[dev->dev_info->linux_kernel_module_count++],
+			module_name, LINUX_KERNEL_MODULE_SIZE);
+	    }
+	}
+    }
+}
+
 /* Try to match any pci device to the appropriate kernel module */
 /* it uses the modules.pcimap from the boot device */
 int get_module_name_from_pcimap(struct pci_domain *domain,
@@ -179,6 +279,7 @@ int get_class_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
     char sub_class_id_str[5];
     FILE *f;
     struct pci_device *dev;
+    struct pcidb *db;
     bool class_mode = false;
 
     /* Intializing the vendor/product name for each pci device to "unknown" */
@@ -193,6 +294,14 @@ int get_class_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
 	strlcpy(dev->dev_info->class_name, "unknown", 7);
     }
 
+    /* Prefer the binary database, if that's what we've been given */
+    db = pcidb_load(pciids_path);
+    if (db) {
+	pcidb_get_class_names(domain, db);
+	pcidb_free(db);
+	return 0;
+    }
+
     /* Opening the pci.ids from the boot device */
     f = zfopen(pciids_path, "r");
     if (!f)
@@ -274,6 +383,7 @@ int get_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
     char sub_vendor_id[5];
     FILE *f;
     struct pci_device *dev;
+    struct pcidb *db;
     bool skip_to_next_vendor = false;
     uint16_t int_vendor_id;
     uint16_t int_product_id;
@@ -293,6 +403,14 @@ int get_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
 	strlcpy(dev->dev_info->product_name, "unknown", 7);
     }
 
+    /* Prefer the binary database, if that's what we've been given */
+    db = pcidb_load(pciids_path);
+    if (db) {
+	pcidb_get_names(domain, db);
+	pcidb_free(db);
+	return 0;
+    }
+
     /* Opening the pci.ids from the boot device */
     f = zfopen(pciids_path, "r");
     if (!f)
@@ -448,114 +566,217 @@ struct match *find_pci_device(const struct pci_domain *domain,
     return NULL;
 }
 
-/* scanning the pci bus to find pci devices */
-struct pci_domain *pci_scan(void)
+/*
+ * Check whether the configuration space of a segment can be accessed, and
+ * return the range of buses it may contain.
+ */
+static bool pci_segment_usable(uint16_t segment, unsigned int *start,
+			       unsigned int *end)
+{
+    int cfgtype;
+
+    if (__pci_ecam_bus_range(segment, start, end))
+	return true;
+
+    if (segment)
+	return false;		/* Non-zero segments need ECAM */
+
+    cfgtype = pci_set_config_type(PCI_CFG_AUTO);
+
+    dprintf("PCI configuration type %d\n", cfgtype);
+
+    *start = 0;
+    *end = MAX_PCI_BUSES - 1;
+    return cfgtype != PCI_CFG_NONE;
+}
+
+struct pci_scan_state {
+    struct pci_domain *domain;
+    uint16_t segment;
+    uint8_t scanned[MAX_PCI_BUSES / 8];	/* Buses already probed */
+    uint8_t claimed[MAX_PCI_BUSES / 8];	/* Buses behind a known bridge */
+};
+
+static inline bool bus_test(const uint8_t *map, unsigned int bus)
+{
+    return map[bus >> 3] & (1 << (bus & 7));
+}
+
+static inline void bus_set(uint8_t *map, unsigned int bus)
+{
+    map[bus >> 3] |= 1 << (bus & 7);
+}
+
+/*
+ * Probe all the functions of a bus, then descend into the buses found
+ * behind its PCI-to-PCI and CardBus bridges.
+ */
+static int pci_scan_bus(struct pci_scan_state *st, unsigned int nbus)
 {
-    struct pci_domain *domain = NULL;
     struct pci_bus *bus = NULL;
     struct pci_slot *slot = NULL;
     struct pci_device *func = NULL;
-    unsigned int nbus, ndev, nfunc, maxfunc;
+    unsigned int ndev, nfunc, maxfunc, sec, sub, b;
     uint32_t did, sid, rcid;
     uint8_t hdrtype;
     pciaddr_t a;
-    int cfgtype;
 
-    cfgtype = pci_set_config_type(PCI_CFG_AUTO);
+    if (bus_test(st->scanned, nbus))
+	return 0;
 
-    dprintf("PCI configuration type %d\n", cfgtype);
+    bus_set(st->scanned, nbus);
+    bus_set(st->claimed, nbus);
 
-    if (cfgtype == PCI_CFG_NONE)
-	return NULL;
+    dprintf("Probing bus 0x%02x... \n", nbus);
 
-    dprintf("Scanning PCI Buses\n");
+    for (ndev = 0; ndev < MAX_PCI_DEVICES; ndev++) {
+	maxfunc = 1;		/* Assume a single-function device */
+	slot = NULL;
 
-    for (nbus = 0; nbus < MAX_PCI_BUSES; nbus++) {
-	dprintf("Probing bus 0x%02x... \n", nbus);
-	bus = NULL;
+	for (nfunc = 0; nfunc < maxfunc; nfunc++) {
+	    a = pci_mkaddr(nbus, ndev, nfunc, 0);
+	    did = pci_readl(a);
 
-	for (ndev = 0; ndev < MAX_PCI_DEVICES; ndev++) {
-	    maxfunc = 1;	/* Assume a single-function device */
-	    slot = NULL;
+	    if (did == 0xffffffff || did == 0xffff0000 ||
+		did == 0x0000ffff || did == 0x00000000)
+		continue;
 
-	    for (nfunc = 0; nfunc < maxfunc; nfunc++) {
-		a = pci_mkaddr(nbus, ndev, nfunc, 0);
-		did = pci_readl(a);
+	    hdrtype = pci_readb(a + 0x0e);
 
-		if (did == 0xffffffff || did == 0xffff0000 ||
-		    did == 0x0000ffff || did == 0x00000000)
-		    continue;
+	    if (hdrtype & 0x80)
+		maxfunc = MAX_PCI_FUNC;	/* Multifunction device */
 
-		hdrtype = pci_readb(a + 0x0e);
+	    rcid = pci_readl(a + 0x08);
+	    sid = pci_readl(a + 0x2c);
 
-		if (hdrtype & 0x80)
-		    maxfunc = MAX_PCI_FUNC;	/* Multifunction device */
+	    if (!st->domain) {
+		st->domain = zalloc(sizeof *st->domain);
+		if (!st->domain)
+		    return -1;
+		st->domain->segment = st->segment;
+	    }
+	    if (!bus) {
+		bus = zalloc(sizeof *bus);
+		if (!bus)
+		    return -1;
+		st->domain->bus[nbus] = bus;
+	    }
+	    if (!slot) {
+		slot = zalloc(sizeof *slot);
+		if (!slot)
+		    return -1;
+		bus->slot[ndev] = slot;
+	    }
+	    func = zalloc(sizeof *func);
+	    if (!func)
+		return -1;
 
-		rcid = pci_readl(a + 0x08);
-		sid = pci_readl(a + 0x2c);
+	    slot->func[nfunc] = func;
 
-		if (!domain) {
-		    domain = zalloc(sizeof *domain);
-		    if (!domain)
-			goto bail;
-		}
-		if (!bus) {
-		    bus = zalloc(sizeof *bus);
-		    if (!bus)
-			goto bail;
-		    domain->bus[nbus] = bus;
-		}
-		if (!slot) {
-		    slot = zalloc(sizeof *slot);
-		    if (!slot)
-			goto bail;
-		    bus->slot[ndev] = slot;
-		}
-		func = zalloc(sizeof *func);
-		if (!func)
-		    goto bail;
+	    func->vid_did = did;
+	    func->svid_sdid = sid;
+	    func->rid_class = rcid;
 
-		slot->func[nfunc] = func;
+	    dprintf
+		("Scanning: BUS %02x DID %08x (%04x:%04x) SID %08x RID %02x\n",
+		 nbus, did, did >> 16, (did << 16) >> 16, sid, rcid & 0xff);
 
-		func->vid_did = did;
-		func->svid_sdid = sid;
-		func->rid_class = rcid;
+	    if ((hdrtype & 0x7f) != 1 && (hdrtype & 0x7f) != 2)
+		continue;
 
-		dprintf
-		    ("Scanning: BUS %02x DID %08x (%04x:%04x) SID %08x RID %02x\n",
-		     nbus, did, did >> 16, (did << 16) >> 16, sid, rcid & 0xff);
-	    }
+	    /* Bridge: the buses it forwards to can only be found below it */
+	    sec = pci_readb(a + 0x19);
+	    sub = pci_readb(a + 0x1a);
+	    if (sec <= nbus || sub < sec)
+		continue;	/* Not configured */
+
+	    for (b = sec; b <= sub; b++)
+		bus_set(st->claimed, b);
+
+	    if (pci_scan_bus(st, sec))
+		return -1;
 	}
     }
 
-    return domain;
+    return 0;
+}
+
+/*
+ * Scan a PCI segment group to find pci devices.
+ *
+ * Rather than probing every possible bus, the hierarchy is walked from the
+ * first bus through the secondary bus numbers of the bridges. Only buses
+ * which no bridge forwards to are then probed, to find peer root buses
+ * (further host bridges, CPU uncore buses) which sit behind no bridge.
+ */
+struct pci_domain *pci_scan_segment(uint16_t segment)
+{
+    struct pci_scan_state st;
+    unsigned int nbus, start, end;
+    uint16_t old_segment;
+
+    old_segment = pci_set_segment(segment);
+
+    if (!pci_segment_usable(segment, &start, &end)) {
+	pci_set_segment(old_segment);
+	return NULL;
+    }
+
+    dprintf("Scanning PCI Buses %02x-%02x of segment %04x\n",
+	    start, end, segment);
+
+    memset(&st, 0, sizeof st);
+    st.segment = segment;
+
+    for (nbus = start; nbus <= end; nbus++) {
+	if (bus_test(st.claimed, nbus))
+	    continue;
+
+	if (pci_scan_bus(&st, nbus))
+	    goto bail;
+    }
+
+    pci_set_segment(old_segment);
+    return st.domain;
 
 bail:
-    free_pci_domain(domain);
+    pci_set_segment(old_segment);
+    free_pci_domain(st.domain);
     return NULL;
 }
 
+/* scanning the pci bus to find pci devices */
+struct pci_domain *pci_scan(void)
+{
+    return pci_scan_segment(0);
+}
+
 /* gathering additional configuration*/
 void gather_additional_pci_config(struct pci_domain *domain)
 {
     struct pci_device *dev;
     pciaddr_t pci_addr;
-    int cfgtype;
+    unsigned int start, end;
+    uint16_t old_segment;
 
-    cfgtype = pci_set_config_type(PCI_CFG_AUTO);
-    if (cfgtype == PCI_CFG_NONE)
-	return;
+    old_segment = pci_set_segment(domain->segment);
+
+    if (!pci_segment_usable(domain->segment, &start, &end))
+	goto out;
 
     for_each_pci_func3(dev, domain, pci_addr) {
 	if (!dev->dev_info) {
 	    dev->dev_info = zalloc(sizeof *dev->dev_info);
 	    if (!dev->dev_info) {
-		return;
+		goto out;
 	    }
 	}
 	dev->dev_info->irq = pci_readb(pci_addr + 0x3c);
 	dev->dev_info->latency = pci_readb(pci_addr + 0x0d);
     }
+
+out:
+    pci_set_segment(old_segment);
 }
 
 void free_pci_domain(struct pci_domain *domain)
@@ -603,6 +824,7 @@ int get_module_name_from_alias(struct pci_domain *domain, char *modules_alias_pa
   char sub_product_id[16];
   FILE *f;
   struct pci_device *dev=NULL;
+  struct pcidb *db;
   int valid_lines=0;
 
   /* Intializing the linux_kernel_module for each pci device to "unknown" */
@@ -620,6 +842,15 @@ int get_module_name_from_alias(struct pci_domain *domain, char *modules_alias_pa
     }
   }
 
+  /* Prefer the binary database, if that's what we've been given */
+  db=pcidb_load(modules_alias_path);
+  if (db) {
+    int rv = pcidb_count(db, PCIDB_ALIAS) ? 0 : -ENOMODULESALIAS;
+    pcidb_get_module_names(domain, db);
+    pcidb_free(db);
+    return rv;
+  }
+
   /* Opening the modules.pcimap (of a linux kernel) from the boot device */
   f=zfopen(modules_alias_path, "r");
   if (!f)
@@ -2,6 +2,17 @@
 
 void BWL(pci_write)(TYPE v, pciaddr_t a)
 {
+    volatile TYPE *p;
+
+    p = __pci_ecam_ptr(a);
+    if (p) {
+	*p = v;
+	return;
+    }
+
+    if (__pci_cfg_segment)
+	return;			/* Other segments are only reachable via ECAM */
+
     for (;;) {
 	switch (__pci_cfg_type) {
 	case PCI_CFG_AUTO:
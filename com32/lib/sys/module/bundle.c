@@ -0,0 +1,154 @@
+/*
+ * bundle.c
+ *
+ * Module bundles (see <sys/modbundle.h>). While a bundle is open,
+ * image_load() takes the images of the modules it holds from memory
+ * instead of looking each of them up in PATH and reading it on its own.
+ *
+ * The core opens the bundle just before loading LDLINUX. It serves
+ * LDLINUX and the first program LDLINUX loads after it, normally the UI
+ * or DEFAULT module, along with the modules each needs; it is closed
+ * once those are in, so that it can't shadow the files on disk later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dprintf.h>
+
+#include <sys/module.h>
+#include <sys/modbundle.h>
+
+#include "common.h"
+
+#define BUNDLE_PROGRAMS	2	/* LDLINUX, then the UI or DEFAULT module */
+
+static struct {
+	char *data;
+	const struct modbundle_header *hdr;
+	const struct modbundle_entry *entry;
+	const char *strtab;
+	int programs;		/* Programs loaded while open */
+} bundle;
+
+static int bundle_valid(const char *data, size_t size)
+{
+	const struct modbundle_header *hdr = (const void *)data;
+	const struct modbundle_entry *e;
+	uint32_t i;
+
+	if (size < sizeof *hdr ||
+	    hdr->magic != MODBUNDLE_MAGIC || hdr->version != MODBUNDLE_VERSION ||
+	    hdr->header_size != sizeof *hdr || hdr->size != size)
+		return 0;
+
+	if (hdr->count > (size - sizeof *hdr) / sizeof *e ||
+	    hdr->strtab_offset > size ||
+	    hdr->strtab_size > size - hdr->strtab_offset ||
+	    !hdr->strtab_size || data[hdr->strtab_offset + hdr->strtab_size - 1] ||
+	    hdr->build_id >= hdr->strtab_size)
+		return 0;
+
+	e = (const struct modbundle_entry *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++, e++) {
+		if (e->name >= hdr->strtab_size || e->offset > size ||
+		    e->size > size - e->offset)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Open the module bundle called name, replacing any bundle that was
+ * already open. Returns the number of modules in it, or -1 if there is
+ * no such file, it isn't a valid bundle or it was made for another
+ * build than build_id; modules are then loaded from their own files,
+ * as usual.
+ */
+int module_bundle_open(const char *name, const char *build_id)
+{
+	const struct modbundle_header *hdr;
+	char *data;
+	size_t size;
+	FILE *f;
+	int res;
+
+	module_bundle_close();
+
+	f = findpath((char *)name);
+	if (!f)
+		return -1;
+
+	res = image_read_file(f, &data, &size);
+	fclose(f);
+	if (res)
+		return -1;
+
+	if (!bundle_valid(data, size)) {
+		dprintf("%s is not a valid module bundle\n", name);
+		free(data);
+		return -1;
+	}
+
+	hdr = (const struct modbundle_header *)data;
+	if (strcmp(data + hdr->strtab_offset + hdr->build_id, build_id)) {
+		dprintf("%s is for build %s, not %s\n", name,
+			data + hdr->strtab_offset + hdr->build_id, build_id);
+		free(data);
+		return -1;
+	}
+
+	bundle.data = data;
+	bundle.hdr = (const struct modbundle_header *)data;
+	bundle.entry = (const struct modbundle_entry *)(bundle.hdr + 1);
+	bundle.strtab = data + bundle.hdr->strtab_offset;
+
+	dprintf("%s: %u bundled modules\n", name, bundle.hdr->count);
+	return bundle.hdr->count;
+}
+
+void module_bundle_close(void)
+{
+	free(bundle.data);
+	memset(&bundle, 0, sizeof bundle);
+}
+
+/*
+ * Called by spawn_load() once a program and the modules it needs have
+ * been loaded; closes the bundle after the last program it serves.
+ */
+void module_bundle_loaded(void)
+{
+	if (bundle.data && ++bundle.programs >= BUNDLE_PROGRAMS)
+		module_bundle_close();
+}
+
+/*
+ * Find the image of the module called name in the open bundle. Only the
+ * last path component of name is compared, the way DT_NEEDED entries
+ * are looked up.
+ */
+void *module_bundle_find(const char *name, size_t *size)
+{
+	const struct modbundle_entry *e;
+	const char *p;
+	uint32_t i;
+
+	if (!bundle.data)
+		return NULL;
+
+	p = strrchr(name, '/');
+	if (p)
+		name = p + 1;
+
+	for (i = 0, e = bundle.entry; i < bundle.hdr->count; i++, e++) {
+		if (!strcmp(bundle.strtab + e->name, name)) {
+			if (size)
+				*size = e->size;
+			return bundle.data + e->offset;
+		}
+	}
+
+	return NULL;
+}
@@ -6,9 +6,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <elf.h>
 #include <string.h>
 #include <fs.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <stdbool.h>
 
 #include <linux/list.h>
 #include <sys/module.h>
@@ -57,6 +63,154 @@ void print_elf_symbols(struct elf_module *module) {
 }
 #endif //ELF_DEBUG
 
+/*
+ * PATH lookup cache
+ *
+ * Each PATH directory remembers the names the filesystem reported as
+ * not found in it (ENOENT; not timeouts or other errors) and, where the filesystem can list directories (local disks, HTTP
+ * indexes), the names it holds. findpath() then skips directories that
+ * can't have the file, instead of paying a failed open (a TFTP error
+ * round trip over PXE) each time. The cache is flushed whenever PATH or
+ * the current directory changes, as tracked by path_generation.
+ */
+#define PATH_CACHE_HASH	64
+
+struct path_cache_name {
+	struct path_cache_name *next;
+	bool present;		/* From a listing, rather than a failed open */
+	char name[];
+};
+
+struct path_cache_dir {
+	struct path_cache_dir *next;
+	const struct path_entry *entry;
+	bool listed;		/* names holds everything in the directory */
+	struct path_cache_name *names[PATH_CACHE_HASH];
+};
+
+static struct path_cache_dir *path_cache;
+static unsigned int path_cache_generation;
+
+static unsigned int path_cache_hash(const char *name)
+{
+	unsigned int h = 0;
+
+	/* Case-insensitive, as listed names are compared that way */
+	while (*name)
+		h = h * 31 + tolower((unsigned char)*name++);
+
+	return h % PATH_CACHE_HASH;
+}
+
+static void path_cache_add(struct path_cache_dir *dir, const char *name,
+			   bool present)
+{
+	struct path_cache_name *n;
+	unsigned int h = path_cache_hash(name);
+
+	n = malloc(sizeof *n + strlen(name) + 1);
+	if (!n)
+		return;
+
+	n->present = present;
+	strcpy(n->name, name);
+	n->next = dir->names[h];
+	dir->names[h] = n;
+}
+
+static void path_cache_flush(void)
+{
+	struct path_cache_dir *dir, *dnext;
+	struct path_cache_name *n, *nnext;
+	int i;
+
+	for (dir = path_cache; dir; dir = dnext) {
+		dnext = dir->next;
+		for (i = 0; i < PATH_CACHE_HASH; i++) {
+			for (n = dir->names[i]; n; n = nnext) {
+				nnext = n->next;
+				free(n);
+			}
+		}
+		free(dir);
+	}
+
+	path_cache = NULL;
+	path_cache_generation = path_generation;
+}
+
+/*
+ * Seed a directory with its listing, if the filesystem can give us one.
+ * An empty listing is taken as "can't list" rather than "empty".
+ */
+static void path_cache_list(struct path_cache_dir *dir)
+{
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir->entry->str);
+	if (!d)
+		return;
+
+	while ((de = readdir(d))) {
+		path_cache_add(dir, de->d_name, true);
+		dir->listed = true;
+	}
+
+	closedir(d);
+}
+
+static struct path_cache_dir *path_cache_dir(const struct path_entry *entry)
+{
+	struct path_cache_dir *dir;
+
+	if (path_cache_generation != path_generation)
+		path_cache_flush();
+
+	for (dir = path_cache; dir; dir = dir->next) {
+		if (dir->entry == entry)
+			return dir;
+	}
+
+	dir = zalloc(sizeof *dir);
+	if (!dir)
+		return NULL;
+
+	dir->entry = entry;
+	path_cache_list(dir);
+
+	dir->next = path_cache;
+	path_cache = dir;
+	return dir;
+}
+
+/*
+ * Could name be in the directory of the given PATH entry?
+ */
+static bool path_cache_maybe(struct path_cache_dir *dir, const char *name)
+{
+	struct path_cache_name *n;
+
+	if (!dir)
+		return true;
+
+	for (n = dir->names[path_cache_hash(name)]; n; n = n->next) {
+		if (n->present) {
+			if (!strcasecmp(n->name, name))
+				return true;
+		} else if (!strcmp(n->name, name))
+			return false;
+	}
+
+	/*
+	 * A listing shows long names only, so don't trust it to rule
+	 * out what could be an 8.3 alias.  It also only covers the top
+	 * of the directory, and says nothing about a name in one of
+	 * its subdirectories.
+	 */
+	return !dir->listed || strchr(name, '~') || strchr(name, '/');
+}
+
 FILE *findpath(char *name)
 {
 	struct path_entry *entry;
@@ -68,8 +222,15 @@ FILE *findpath(char *name)
 		return f;
 
 	list_for_each_entry(entry, &PATH, list) {
+		struct path_cache_dir *dir = path_cache_dir(entry);
 		bool slash = false;
 
+		if (!path_cache_maybe(dir, name)) {
+			dprintf("findpath: no \"%s\" in \"%s\"\n",
+				name, entry->str);
+			continue;
+		}
+
 		/* Ensure we have a '/' separator */
 		if (entry->str[strlen(entry->str) - 1] != '/')
 			slash = true;
@@ -81,6 +242,13 @@ FILE *findpath(char *name)
 		f = fopen(path, "rb");
 		if (f)
 			return f;
+
+		/*
+		 * Only remember files the filesystem says aren't there;
+		 * a timeout or server error may not happen next time.
+		 */
+		if (dir && errno == ENOENT)
+			path_cache_add(dir, name, false);
 	}
 
 	return NULL;
@@ -90,73 +258,133 @@ FILE *findpath(char *name)
  * Image files manipulation routines
  */
 
-int image_load(struct elf_module *module)
+/*
+ * The module file is read into memory whole, with as few reads as
+ * possible (one, if the file size is known), and then parsed in place.
+ * Over the network that saves a round trip per small read, and it lets
+ * the ELF parser seek anywhere.
+ *
+ * On success *data is a malloc()ed copy of the rest of the file f, and
+ * *len is its length.
+ */
+#define IMAGE_CHUNK	65536
+
+int image_read_file(FILE *f, char **data, size_t *len)
 {
-	module->u.l._file = findpath(module->name);
+	struct stat st;
+	char *image = NULL, *p;
+	size_t size = 0, alloc;
+
+	if (!fstat(fileno(f), &st) && S_ISREG(st.st_mode) && st.st_size) {
+		image = malloc(st.st_size);
+		if (!image)
+			return -1;
+
+		if (fread(image, 1, st.st_size, f) != (size_t)st.st_size) {
+			free(image);
+			return -1;
+		}
+		size = st.st_size;
+	} else {
+		/* Unknown length: grow the buffer as we go */
+		alloc = 0;
+		do {
+			alloc += IMAGE_CHUNK;
+			p = realloc(image, alloc);
+			if (!p) {
+				free(image);
+				return -1;
+			}
+			image = p;
 
-	if (module->u.l._file == NULL) {
-		dprintf("Could not open object file '%s'\n", module->name);
-		goto error;
+			size += fread(image + size, 1, alloc - size, f);
+		} while (size == alloc);
 	}
 
+	*data = image;
+	*len = size;
+	return 0;
+}
+
+int image_load(struct elf_module *module, int use_bundle)
+{
+	FILE *f;
+	int res;
+
+	module->u.l._image = NULL;
+	module->u.l._image_size = 0;
 	module->u.l._cr_offset = 0;
+	module->u.l._image_bundled = 0;
 
-	return 0;
+	if (use_bundle) {
+		module->u.l._image = module_bundle_find(module->name,
+						&module->u.l._image_size);
+		if (module->u.l._image) {
+			module->u.l._image_bundled = 1;
+			return 0;
+		}
+	}
 
-error:
-	if (module->u.l._file != NULL) {
-		fclose(module->u.l._file);
-		module->u.l._file = NULL;
+	f = findpath(module->name);
+	if (f == NULL) {
+		dprintf("Could not open object file '%s'\n", module->name);
+		return -1;
 	}
 
-	return -1;
+	res = image_read_file(f, &module->u.l._image, &module->u.l._image_size);
+	fclose(f);
+
+	if (res)
+		dprintf("Could not read object file '%s'\n", module->name);
+
+	return res;
 }
 
 
 int image_unload(struct elf_module *module) {
-	if (module->u.l._file != NULL) {
-		fclose(module->u.l._file);
-		module->u.l._file = NULL;
-
-	}
+	if (!module->u.l._image_bundled)
+		free(module->u.l._image);
+	module->u.l._image = NULL;
+	module->u.l._image_size = 0;
 	module->u.l._cr_offset = 0;
+	module->u.l._image_bundled = 0;
 
 	return 0;
 }
 
+/*
+ * Returns a pointer to size bytes of the image at offset, or NULL if
+ * they are not all in the file.
+ */
+void *image_ptr(Elf_Off offset, size_t size, struct elf_module *module) {
+	if (offset > module->u.l._image_size ||
+	    size > module->u.l._image_size - offset)
+		return NULL;
+
+	return module->u.l._image + offset;
+}
+
 int image_read(void *buff, size_t size, struct elf_module *module) {
-	size_t result = fread(buff, size, 1, module->u.l._file);
+	void *p = image_ptr(module->u.l._cr_offset, size, module);
 
-	if (result < 1)
+	if (!p)
 		return -1;
 
+	memcpy(buff, p, size);
 	module->u.l._cr_offset += size;
 	return 0;
 }
 
 int image_skip(size_t size, struct elf_module *module) {
-	void *skip_buff = NULL;
-	size_t result;
-
-	if (size == 0)
-		return 0;
-
-	skip_buff = malloc(size);
-	result = fread(skip_buff, size, 1, module->u.l._file);
-	free(skip_buff);
-
-	if (result < 1)
-		return -1;
-
-	module->u.l._cr_offset += size;
-	return 0;
+	return image_seek(module->u.l._cr_offset + size, module);
 }
 
 int image_seek(Elf_Off offset, struct elf_module *module) {
-	if (offset < module->u.l._cr_offset) // Cannot seek backwards
+	if (offset > module->u.l._image_size)
 		return -1;
 
-	return image_skip(offset - module->u.l._cr_offset, module);
+	module->u.l._cr_offset = offset;
+	return 0;
 }
 
 
@@ -311,6 +539,189 @@ int clear_dependency(struct elf_module *req, struct elf_module *dep) {
 	return 0;
 }
 
+/*
+ * The global symbol index: a hash table of the symbols defined by every
+ * loaded module, so that a lookup costs the same however many modules
+ * there are.  Each bucket chain lists the symbols of the most recently
+ * loaded module first, just like the module list, so walking it gives
+ * the same STB_GLOBAL/STB_WEAK precedence as walking the modules.
+ */
+#define SYM_INDEX_BITS	10
+#define SYM_INDEX_SIZE	(1 << SYM_INDEX_BITS)
+
+struct module_sym {
+	struct module_sym	*next;		// Next in the bucket
+	struct elf_module	*module;	// The defining module
+	Elf_Sym			*sym;
+	unsigned long		hash;
+};
+
+static struct module_sym *sym_index[SYM_INDEX_SIZE];
+
+// Cleared if a module couldn't be indexed, for want of memory
+static bool sym_index_valid = true;
+
+/*
+ * The number of entries in the dynamic symbol table.  The core image
+ * only has a GNU hash table to tell, by way of its longest chain.
+ */
+static unsigned int module_nr_symbols(struct elf_module *module)
+{
+	Elf_Word *cr_word, *gnu_buckets, *gnu_chain;
+	Elf_Word nbucket, symbias, i, last;
+
+	if (module->symtable_size)
+		return module->symtable_size / module->syment_size;
+
+	if (module->hash_table)
+		return module->hash_table[1];	// nchain
+
+	if (!module->ghash_table)
+		return 0;
+
+	cr_word = module->ghash_table;
+	nbucket = cr_word[0];
+	symbias = cr_word[1];
+	gnu_buckets = cr_word + 4 + MODULE_ELF_CLASS_SIZE / 32 * cr_word[2];
+	gnu_chain = gnu_buckets + nbucket;
+
+	last = 0;
+	for (i = 0; i < nbucket; i++) {
+		if (gnu_buckets[i] > last)
+			last = gnu_buckets[i];
+	}
+
+	if (last < symbias)
+		return symbias;
+
+	while (!(gnu_chain[last - symbias] & 1))
+		last++;
+
+	return last + 1;
+}
+
+static inline bool sym_is_definition(Elf_Sym *sym)
+{
+	if (sym->st_shndx == SHN_UNDEF || !sym->st_name)
+		return false;
+
+	switch (ELF32_ST_BIND(sym->st_info)) {
+	case STB_GLOBAL:
+	case STB_WEAK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Add the symbols defined by a module to the index; call this right
+ * when it goes on the module list.
+ */
+int module_index_symbols(struct elf_module *module)
+{
+	unsigned int i, nsyms, n;
+	struct module_sym *ms;
+	Elf_Sym *sym;
+
+	nsyms = module_nr_symbols(module);
+
+	for (i = 1, n = 0; i < nsyms; i++) {
+		if (sym_is_definition(symbol_get_entry(module, i)))
+			n++;
+	}
+
+	module->sym_index = NULL;
+	module->nr_sym_index = 0;
+	if (!n)
+		return 0;
+
+	ms = malloc(n * sizeof *ms);
+	if (!ms) {
+		sym_index_valid = false;
+		return -1;
+	}
+
+	module->sym_index = ms;
+	module->nr_sym_index = n;
+
+	for (i = 1; i < nsyms; i++) {
+		sym = symbol_get_entry(module, i);
+		if (!sym_is_definition(sym))
+			continue;
+
+		ms->module = module;
+		ms->sym = sym;
+		ms->hash = elf_gnu_hash((const unsigned char *)
+					module->str_table + sym->st_name);
+		ms->next = sym_index[ms->hash & (SYM_INDEX_SIZE - 1)];
+		sym_index[ms->hash & (SYM_INDEX_SIZE - 1)] = ms;
+		ms++;
+	}
+
+	return 0;
+}
+
+void module_unindex_symbols(struct elf_module *module)
+{
+	struct module_sym *ms, **pp;
+	int i;
+
+	for (i = 0; i < module->nr_sym_index; i++) {
+		ms = &module->sym_index[i];
+		pp = &sym_index[ms->hash & (SYM_INDEX_SIZE - 1)];
+
+		while (*pp && *pp != ms)
+			pp = &(*pp)->next;
+		if (*pp)
+			*pp = ms->next;
+	}
+
+	free(module->sym_index);
+	module->sym_index = NULL;
+	module->nr_sym_index = 0;
+}
+
+/*
+ * Look a symbol up in the index.  Returns the definition which wins
+ * (the first STB_GLOBAL one, else the first STB_WEAK one) and, if the
+ * counters are given, how many definitions of each kind there are.
+ */
+static Elf_Sym *sym_index_find(const char *name, struct elf_module **module,
+			       int *strong_count, int *weak_count)
+{
+	unsigned long h = elf_gnu_hash((const unsigned char *)name);
+	struct module_sym *ms, *strong = NULL, *weak = NULL;
+
+	for (ms = sym_index[h & (SYM_INDEX_SIZE - 1)]; ms; ms = ms->next) {
+		if (ms->hash != h ||
+		    strcmp(name, ms->module->str_table + ms->sym->st_name))
+			continue;
+
+		if (ELF32_ST_BIND(ms->sym->st_info) == STB_GLOBAL) {
+			if (!strong)
+				strong = ms;
+			if (!strong_count)
+				break;
+			(*strong_count)++;
+		} else {
+			if (!weak)
+				weak = ms;
+			if (weak_count)
+				(*weak_count)++;
+		}
+	}
+
+	if (!strong)
+		strong = weak;
+	if (!strong)
+		return NULL;
+
+	if (module != NULL)
+		*module = strong->module;
+	return strong->sym;
+}
+
 int check_symbols(struct elf_module *module)
 {
 	unsigned int i;
@@ -329,21 +740,26 @@ int check_symbols(struct elf_module *module)
 		strong_count = 0;
 		weak_count = (ELF32_ST_BIND(crt_sym->st_info) == STB_WEAK);
 
-		for_each_module(crt_module)
-		{
-			ref_sym = module_find_symbol(crt_name, crt_module);
-
-			// If we found a definition for our symbol...
-			if (ref_sym != NULL && ref_sym->st_shndx != SHN_UNDEF)
+		if (sym_index_valid) {
+			ref_sym = sym_index_find(crt_name, NULL, &strong_count,
+						 &weak_count);
+		} else {
+			for_each_module(crt_module)
 			{
-				switch (ELF32_ST_BIND(ref_sym->st_info))
+				ref_sym = module_find_symbol(crt_name, crt_module);
+
+				// If we found a definition for our symbol...
+				if (ref_sym != NULL && ref_sym->st_shndx != SHN_UNDEF)
 				{
-					case STB_GLOBAL:
-						strong_count++;
-						break;
-					case STB_WEAK:
-						weak_count++;
-						break;
+					switch (ELF32_ST_BIND(ref_sym->st_info))
+					{
+						case STB_GLOBAL:
+							strong_count++;
+							break;
+						case STB_WEAK:
+							weak_count++;
+							break;
+					}
 				}
 			}
 		}
@@ -414,6 +830,8 @@ int _module_unload(struct elf_module *module) {
 				module->name);
 	}
 
+	module_unindex_symbols(module);
+
 	dprintf("Unloading module %s\n", module->name);
 	// Release the module structure
 	free(module);
@@ -578,7 +996,7 @@ Elf_Sym *module_find_symbol(const char *name, struct elf_module *module) {
 	return result;
 }
 
-Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
+static Elf_Sym *global_find_symbol_slow(const char *name, struct elf_module **module) {
 	struct elf_module *crt_module;
 	Elf_Sym *crt_sym = NULL;
 	Elf_Sym *result = NULL;
@@ -608,3 +1026,10 @@ Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
 
 	return result;
 }
+
+Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
+	if (sym_index_valid)
+		return sym_index_find(name, module, NULL, NULL);
+
+	return global_find_symbol_slow(name, module);
+}
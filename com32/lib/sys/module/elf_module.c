@@ -42,10 +42,8 @@ static int check_header(Elf_Ehdr *elf_hdr) {
 }
 
 /*
- *
- * The implementation assumes that the loadable segments are present
- * in the PHT sorted by their offsets, so that only forward seeks would
- * be necessary.
+ * Loads the PT_LOAD segments of the module image. The whole file is in
+ * memory, so the segments can come in any order in the PHT.
  */
 extern int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr);
 
@@ -179,7 +177,7 @@ static int extract_operations(struct elf_module *module) {
 }
 
 // Loads the module into the system
-int module_load(struct elf_module *module) {
+static int __module_load(struct elf_module *module, int use_bundle) {
 	int res;
 	Elf_Sym *main_sym;
 	Elf_Ehdr elf_hdr;
@@ -193,7 +191,7 @@ int module_load(struct elf_module *module) {
 	}
 
 	// Get a mapping/copy of the ELF file in memory
-	res = image_load(module);
+	res = image_load(module, use_bundle);
 
 	if (res < 0) {
 		dprintf("Image load failed for %s\n", module->name);
@@ -267,6 +265,7 @@ int module_load(struct elf_module *module) {
 
 	// Add the module at the beginning of the module list
 	list_add(&module->list, &modules_head);
+	module_index_symbols(module);
 
 	// Perform the relocations
 	resolve_symbols(module);
@@ -299,6 +298,7 @@ error:
 		unload_modules_since(head->name);
 
 	// Remove the module from the module list (if applicable)
+	module_unindex_symbols(module);
 	list_del_init(&module->list);
 
 	if (module->module_addr != NULL) {
@@ -314,3 +314,22 @@ error:
 	return res;
 }
 
+int module_load(struct elf_module *module) {
+	int res;
+
+	res = __module_load(module, 1);
+
+	/*
+	 * A bundled image that can't be loaded, e.g. because the bundle
+	 * was built against an older core, is retried from its own file.
+	 */
+	if (res < 0 && module_bundle_find(module->name, NULL)) {
+		dprintf("Bundled %s failed to load, reading its file\n",
+			module->name);
+		module->nr_needed = 0;
+		res = __module_load(module, 0);
+	}
+
+	return res;
+}
+
@@ -15,6 +15,7 @@
 #include <setjmp.h>
 #include <alloca.h>
 #include <dprintf.h>
+#include <syslinux/memstats.h>
 
 #define DBG_PRINT(fmt, args...) dprintf("[EXEC] " fmt, ##args)
 
@@ -157,7 +158,7 @@ int spawn_load(const char *name, int argc, char **argv)
 {
 	int res, ret_val = 0;
 	struct elf_module *previous;
-	//malloc_tag_t prev_mem_tag;
+	size_t prev_mem_tag;
 	struct elf_module *module = module_alloc(name);
 	struct elf_module *cur_module;
 	int type;
@@ -188,6 +189,9 @@ int spawn_load(const char *name, int argc, char **argv)
 		goto out;
 	}
 
+	/* Later modules come from their own files, which may be newer */
+	module_bundle_loaded();
+
 	type = get_module_type(module);
 
 	dprintf("type = %d, prev = %s, cur = %s\n",
@@ -196,11 +200,11 @@ int spawn_load(const char *name, int argc, char **argv)
 	if(type==EXEC_MODULE)
 	{
 		previous = __syslinux_current;
-		//prev_mem_tag = __mem_get_tag_global();
+		prev_mem_tag = __mem_get_tag_global();
 
 		// Setup the new process context
 		__syslinux_current = module;
-		//__mem_set_tag_global((malloc_tag_t)module);
+		__mem_set_tag_global((size_t)module);
 
 		// Execute the program
 		ret_val = setjmp(module->u.x.process_exit);
@@ -215,7 +219,7 @@ int spawn_load(const char *name, int argc, char **argv)
 		// Clean up the allocation context
 		//__free_tagged(module);
 		// Restore the allocation context
-		//__mem_set_tag_global(prev_mem_tag);
+		__mem_set_tag_global(prev_mem_tag);
 		// Restore the process context
 		__syslinux_current = previous;
 
@@ -21,16 +21,14 @@
 #include "../common.h"
 
 /*
- *
- * The implementation assumes that the loadable segments are present
- * in the PHT sorted by their offsets, so that only forward seeks would
- * be necessary.
+ * Loads the PT_LOAD segments of the module image. The whole file is in
+ * memory, so the segments can come in any order in the PHT.
  */
 int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	int i;
 	int res = 0;
-	char *pht = NULL;
-	char *sht = NULL;
+	char *pht;
+	char *sht;
 	Elf32_Phdr *cr_pht;
 	Elf32_Shdr *cr_sht;
 
@@ -41,16 +39,12 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 	Elf32_Addr dyn_addr = 0x00000000;
 
-	// Get to the PHT
-	image_seek(elf_hdr->e_phoff, module);
-
-	// Load the PHT
-	pht = malloc(elf_hdr->e_phnum * elf_hdr->e_phentsize);
+	// The PHT is used in place, from the module image
+	pht = image_ptr(elf_hdr->e_phoff,
+			elf_hdr->e_phnum * elf_hdr->e_phentsize, module);
 	if (!pht)
 		return -1;
 
-	image_read(pht, elf_hdr->e_phnum * elf_hdr->e_phentsize, module);
-
 	// Compute the memory needings of the module
 	for (i=0; i < elf_hdr->e_phnum; i++) {
 		cr_pht = (Elf32_Phdr*)(pht + i * elf_hdr->e_phentsize);
@@ -114,28 +108,11 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 		if (cr_pht->p_type == PT_LOAD) {
 			// Copy the segment at its destination
-			if (cr_pht->p_offset < module->u.l._cr_offset) {
-				// The segment contains data before the current offset
-				// It can be discarded without worry - it would contain only
-				// headers
-				Elf32_Off aux_off = module->u.l._cr_offset - cr_pht->p_offset;
-
-				if (image_read((char *)module_get_absolute(cr_pht->p_vaddr, module) + aux_off,
-					       cr_pht->p_filesz - aux_off, module) < 0) {
-					res = -1;
-					goto out;
-				}
-			} else {
-				if (image_seek(cr_pht->p_offset, module) < 0) {
-					res = -1;
-					goto out;
-				}
-
-				if (image_read(module_get_absolute(cr_pht->p_vaddr, module),
-						cr_pht->p_filesz, module) < 0) {
-					res = -1;
-					goto out;
-				}
+			if (image_seek(cr_pht->p_offset, module) < 0 ||
+			    image_read(module_get_absolute(cr_pht->p_vaddr, module),
+				       cr_pht->p_filesz, module) < 0) {
+				res = -1;
+				goto out;
 			}
 
 			/*
@@ -147,18 +124,14 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 		}
 	}
 
-	// Get to the SHT
-	image_seek(elf_hdr->e_shoff, module);
-
-	// Load the SHT
-	sht = malloc(elf_hdr->e_shnum * elf_hdr->e_shentsize);
+	// The SHT, likewise
+	sht = image_ptr(elf_hdr->e_shoff,
+			elf_hdr->e_shnum * elf_hdr->e_shentsize, module);
 	if (!sht) {
 		res = -1;
 		goto out;
 	}
 
-	image_read(sht, elf_hdr->e_shnum * elf_hdr->e_shentsize, module);
-
 	// Setup the symtable size
 	for (i = 0; i < elf_hdr->e_shnum; i++) {
 		cr_sht = (Elf32_Shdr*)(sht + i * elf_hdr->e_shentsize);
@@ -169,8 +142,6 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 		}
 	}
 
-	free(sht);
-
 	// Setup dynamic segment location
 	module->dyn_table = module_get_absolute(dyn_addr, module);
 
@@ -181,10 +152,6 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	*/
 
 out:
-	// Free up allocated memory
-	if (pht != NULL)
-		free(pht);
-
 	return res;
 }
 
@@ -65,10 +65,14 @@ int open(const char *pathname, int flags, ...)
 
     fp = &__file_info[fd];
 
+    /* Not found, unless the filesystem reports something else */
+    errno = ENOENT;
     handle = open_file(pathname, flags, &fp->i.fd);
     if (handle < 0) {
+	int err = errno;
+
 	close(fd);
-	errno = ENOENT;
+	errno = err;
 	return -1;
     }
 
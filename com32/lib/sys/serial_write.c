@@ -41,20 +41,13 @@
 
 ssize_t __serial_write(struct file_info *fp, const void *buf, size_t count)
 {
-    const char *bufp = buf;
-    size_t n = 0;
-
     (void)fp;
 
     if (!syslinux_serial_console_info()->iobase)
 	return count;		/* Nothing to do */
 
-    while (count--) {
-	write_serial(*bufp++);
-	n++;
-    }
-
-    return n;
+    write_serial_buf(buf, count);
+    return count;
 }
 
 const struct output_dev dev_serial_w = {
@@ -31,6 +31,7 @@
  * Read the contents of a data file into a malloc'd buffer
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -48,6 +49,7 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
     struct stat st;
     void *data, *dp;
     size_t alen, clen, rlen, xlen;
+    int e;
 
     clen = alen = 0;
     data = NULL;
@@ -60,8 +62,10 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
 	if (prefix_len) {
 	    clen = alen = prefix_len;
 	    data = malloc(prefix_len);
-	    if (!data)
+	    if (!data) {
+		errno = ENOMEM;
 		goto err;
+	    }
 
 	    memcpy(data, prefix, prefix_len);
 	}
@@ -69,8 +73,10 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
 	do {
 	    alen += INCREMENTAL_CHUNK;
 	    dp = realloc(data, alen);
-	    if (!dp)
+	    if (!dp) {
+		errno = ENOMEM;
 		goto err;
+	    }
 	    data = dp;
 
 	    rlen = fread((char *)data + clen, 1, alen - clen, f);
@@ -88,21 +94,32 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
 	xlen = (clen + LOADFILE_ZERO_PAD - 1) & ~(LOADFILE_ZERO_PAD - 1);
 
 	*ptr = data = malloc(xlen);
-	if (!data)
+	if (!data) {
+	    errno = ENOMEM;
 	    return -1;
+	}
 
 	memcpy(data, prefix, prefix_len);
 
 	if ((off_t) fread((char *)data + prefix_len, 1, clen - prefix_len, f)
-	    != clen - prefix_len)
+	    != clen - prefix_len) {
+	    /*
+	     * A short read sets errno only if read() failed, and we can't
+	     * tell whether it did; errno may be stale.
+	     */
+	    errno = EIO;
 	    goto err;
+	}
     }
 
     memset((char *)data + clen, 0, xlen - clen);
     return 0;
 
 err:
+    /* errno is what the caller gets, whatever free() does to it */
+    e = errno;
     if (data)
 	free(data);
+    errno = e;
     return -1;
 }
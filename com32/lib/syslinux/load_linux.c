@@ -125,6 +125,33 @@ static int map_initramfs(struct syslinux_movelist **fraglist,
     return 0;
 }
 
+/*
+ * If the initramfs was loaded into one buffer laid out exactly the way
+ * map_initramfs() would place it (see loadfiles_reserve()), return its
+ * address, so that it can be booted where it is; otherwise 0.
+ */
+static addr_t initramfs_in_place(struct initramfs *initramfs)
+{
+    struct initramfs *ip;
+    addr_t base, addr;
+
+    ip = initramfs->next;
+    base = addr = (addr_t) ip->data;
+    if (!ip->len || (base & (INITRAMFS_MAX_ALIGN - 1)))
+	return 0;
+
+    for (; ip->len; ip = ip->next) {
+	if ((addr_t) ip->data != addr || ip->data_len != ip->len)
+	    return 0;
+
+	addr += ip->len;
+	if (ip->next->len)
+	    addr = (addr + ip->next->align - 1) & ~(ip->next->align - 1);
+    }
+
+    return base;
+}
+
 static size_t calc_cmdline_offset(const struct syslinux_memmap *mmap,
 				  const struct linux_header *hdr,
 				  size_t cmdline_size, addr_t base,
@@ -231,7 +258,7 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 	hdr.setup_sects = 4;
 
     if (hdr.version < 0x0203 || !hdr.initrd_addr_max)
-	hdr.initrd_addr_max = 0x37ffffff;
+	hdr.initrd_addr_max = INITRAMFS_ADDR_MAX;
 
     if (!memlimit && memlimit - 1 > hdr.initrd_addr_max)
 	memlimit = hdr.initrd_addr_max + 1;	/* Zero for no limit */
@@ -401,12 +428,28 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 	const addr_t align_mask = INITRAMFS_MAX_ALIGN - 1;
 
 	if (irf_size) {
-	    for (ml = amap; ml->type != SMT_END; ml = ml->next) {
-		addr_t adj_start = (ml->start + align_mask) & ~align_mask;
-		addr_t adj_end = ml->next->start & ~align_mask;
-		if (ml->type == SMT_FREE && adj_end - adj_start >= irf_size)
-		    best_addr = (adj_end - irf_size) & ~align_mask;
-	    }
+	    /*
+	     * If the initramfs already sits somewhere usable, leave it
+	     * there rather than copying it all once more.  Anywhere below
+	     * the limit will do, but keep clear of where the kernel
+	     * decompresses itself.
+	     */
+	    best_addr = initramfs_in_place(initramfs);
+	    if (best_addr &&
+		(best_addr + irf_size - 1 > hdr.initrd_addr_max ||
+		 best_addr < prot_mode_base + hdr.init_size ||
+		 syslinux_memmap_type(amap, best_addr, irf_size) != SMT_FREE))
+		best_addr = 0;
+	    if (best_addr)
+		dprintf("Initramfs in place at 0x%08x\n", best_addr);
+
+	    else
+		for (ml = amap; ml->type != SMT_END; ml = ml->next) {
+		    addr_t adj_start = (ml->start + align_mask) & ~align_mask;
+		    addr_t adj_end = ml->next->start & ~align_mask;
+		    if (ml->type == SMT_FREE && adj_end - adj_start >= irf_size)
+			best_addr = (adj_end - irf_size) & ~align_mask;
+		}
 
 	    if (!best_addr) {
 		dprintf("Insufficient memory for initramfs\n");
@@ -0,0 +1,207 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * loadfiles.c
+ *
+ * Load a batch of files, e.g. a kernel and its initrds, into malloc'd
+ * buffers.  Where the firmware has threads, every file gets one, so
+ * transfers from different servers overlap instead of queueing up
+ * behind each other.  Each buffer is sized from the file size up front
+ * (see floadfile()), so nothing is reallocated while the loads run.
+ *
+ * loadfiles_reserve() goes one step further for data which is booted
+ * where it lies, like the initramfs: it places all the files back to
+ * back in one buffer at the top of memory, which is where the Linux
+ * loader would have to move them to otherwise.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/times.h>
+#include <com32.h>
+#include <syslinux/firmware.h>
+#include <syslinux/loadfile.h>
+
+/*
+ * The other jobs run while this one waits for data, and errno is
+ * shared with them: it is only meaningful right after the call which
+ * failed, so it is saved in req->err before anything else can run.
+ */
+static void loadfile_job(void *data)
+{
+    struct loadfile_req *req = data;
+    clock_t start = times(NULL);
+    int rv;
+
+    if (req->data) {
+	/* Into the buffer from loadfiles_reserve() */
+	if (fread(req->data, 1, req->len, req->f) != req->len)
+	    req->err = EIO;	/* As floadfile() reports it */
+	else
+	    req->err = 0;
+    } else {
+	rv = req->f ? floadfile(req->f, &req->data, &req->len, NULL, 0) :
+	    loadfile(req->name, &req->data, &req->len);
+	req->err = rv ? (errno ? errno : EIO) : 0;
+	if (rv) {
+	    req->data = NULL;
+	    req->len = 0;
+	}
+    }
+
+    if (req->f) {
+	fclose(req->f);
+	req->f = NULL;
+    }
+
+    req->ms = times(NULL) - start;
+}
+
+/*
+ * Load all of reqs[].  Returns 0 if every file was loaded, otherwise
+ * -1 with errno set from the first failure; the buffers of the files
+ * which did load are left for the caller to free, with loadfiles_free().
+ */
+int loadfiles(struct loadfile_req *reqs, int nreqs)
+{
+    void **args;
+    int i;
+
+    args = NULL;
+    if (nreqs > 1 && firmware->run_threads)
+	args = malloc(nreqs * sizeof *args);
+
+    if (args) {
+	for (i = 0; i < nreqs; i++)
+	    args[i] = &reqs[i];
+
+	if (firmware->run_threads(loadfile_job, args, nreqs)) {
+	    free(args);
+	    args = NULL;
+	}
+    }
+
+    if (args)
+	free(args);
+    else
+	for (i = 0; i < nreqs; i++)
+	    loadfile_job(&reqs[i]);
+
+    for (i = 0; i < nreqs; i++) {
+	if (reqs[i].err) {
+	    errno = reqs[i].err;
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Set up reqs[] so that loadfiles() reads them into a single buffer
+ * allocated with malloc_high() below limit, each file aligned to align,
+ * which must be a power of two.  The buffer itself is page aligned.
+ * This needs the size of every file up front, so they are all opened
+ * here.  Returns the buffer, or NULL if it couldn't be had; loadfiles()
+ * then allocates the files one by one as usual.  Unlike loadfile(),
+ * the files are not zero padded.
+ */
+#define RESERVE_ALIGN	4096
+
+void *loadfiles_reserve(struct loadfile_req *reqs, int nreqs, size_t align,
+			uintptr_t limit)
+{
+    struct stat st;
+    size_t size;
+    char *buf;
+    int i;
+
+    size = 0;
+    for (i = 0; i < nreqs; i++) {
+	reqs[i].f = fopen(reqs[i].name, "r");
+	if (!reqs[i].f)
+	    return NULL;	/* loadfiles() will report it */
+
+	if (fstat(fileno(reqs[i].f), &st) || !S_ISREG(st.st_mode))
+	    return NULL;
+
+	size = (size + align - 1) & ~(align - 1);
+	size += st.st_size;
+	reqs[i].len = st.st_size;
+    }
+
+    buf = malloc_high(size, align > RESERVE_ALIGN ? align : RESERVE_ALIGN,
+		      limit);
+    if (!buf)
+	return NULL;
+
+    size = 0;
+    for (i = 0; i < nreqs; i++) {
+	size = (size + align - 1) & ~(align - 1);
+	reqs[i].data = buf + size;
+	reqs[i].reserved = buf;
+	size += reqs[i].len;
+    }
+
+    return buf;
+}
+
+/*
+ * Free the buffers of a batch, e.g. when a boot is given up after some
+ * of its files were loaded.
+ */
+void loadfiles_free(struct loadfile_req *reqs, int nreqs)
+{
+    struct loadfile_req *req;
+
+    for (req = reqs; req < reqs + nreqs; req++) {
+	/* The files of loadfiles_reserve() share the first one's buffer */
+	if (!req->reserved || req->data == req->reserved)
+	    free(req->data);
+	req->data = NULL;
+	req->reserved = NULL;
+    }
+}
+
+/*
+ * Print the size and the throughput of each file of a batch
+ */
+void loadfiles_report(const struct loadfile_req *reqs, int nreqs)
+{
+    const struct loadfile_req *req;
+    uint32_t ms;
+
+    for (req = reqs; req < reqs + nreqs; req++) {
+	if (req->err)
+	    continue;
+
+	ms = req->ms ? req->ms : 1;
+	printf("  %s: %zu bytes in %u ms (%u KiB/s)\n", req->name, req->len,
+	       req->ms, (uint32_t)((uint64_t)req->len * 1000 / 1024 / ms));
+    }
+}
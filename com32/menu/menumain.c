@@ -37,6 +37,9 @@
 /* The symbol "cm" always refers to the current menu across this file... */
 static struct menu *cm;
 
+/* Screen size, which some menu parameters are relative to */
+static int rows, cols;
+
 const struct menu_parameter mparm[NPARAMS] = {
     [P_WIDTH] = {"width", 0},
     [P_MARGIN] = {"margin", 10},
@@ -123,24 +126,24 @@ display_entry(const struct menu_entry *entry, const char *attrib,
 	    if (*p == '^') {
 		p++;
 		if (*p && ((unsigned char)*p & ~0x20) == entry->hotkey) {
-		    fputs(hotattrib, stdout);
-		    putchar(*p++);
-		    fputs(attrib, stdout);
+		    screen_puts(hotattrib);
+		    screen_putchar(*p++);
+		    screen_puts(attrib);
 		    width--;
 		}
 	    } else {
-		putchar(*p++);
+		screen_putchar(*p++);
 		width--;
 	    }
 	} else {
-	    putchar(' ');
+	    screen_putchar(' ');
 	    width--;
 	}
     }
 
     if (marker) {
-	putchar(' ');
-	putchar(marker);
+	screen_putchar(' ');
+	screen_putchar(marker);
     }
 }
 
@@ -149,12 +152,12 @@ static void draw_row(int y, int sel, int top, int sbtop, int sbbot)
     int i = (y - 4 - VSHIFT) + top;
     int dis = (i < cm->nentries) && is_disabled(cm->menu_entries[i]);
 
-    printf("\033[%d;%dH\1#1\016x\017%s ",
-	   y, MARGIN + 1 + HSHIFT,
-	   (i == sel) ? "\1#5" : dis ? "\2#17" : "\1#3");
+    screen_printf("\033[%d;%dH\1#1\016x\017%s ",
+		  y, MARGIN + 1 + HSHIFT,
+		  (i == sel) ? "\1#5" : dis ? "\2#17" : "\1#3");
 
     if (i >= cm->nentries) {
-	fputs(pad_line("", 0, WIDTH - 2 * MARGIN - 4), stdout);
+	screen_puts(pad_line("", 0, WIDTH - 2 * MARGIN - 4));
     } else {
 	display_entry(cm->menu_entries[i],
 		      (i == sel) ? "\1#5" : dis ? "\2#17" : "\1#3",
@@ -163,14 +166,14 @@ static void draw_row(int y, int sel, int top, int sbtop, int sbbot)
     }
 
     if (cm->nentries <= MENU_ROWS) {
-	printf(" \1#1\016x\017");
+	screen_printf(" \1#1\016x\017");
     } else if (sbtop > 0) {
 	if (y >= sbtop && y <= sbbot)
-	    printf(" \1#7\016a\017");
+	    screen_printf(" \1#7\016a\017");
 	else
-	    printf(" \1#1\016x\017");
+	    screen_printf(" \1#1\016x\017");
     } else {
-	putchar(' ');		/* Don't modify the scrollbar */
+	screen_putchar(' ');	/* Don't modify the scrollbar */
     }
 }
 
@@ -313,26 +316,26 @@ static void draw_menu(int sel, int top, int edit_line)
 	sbbot += 4;		/* Starting row of scrollbar */
     }
 
-    printf("\033[%d;%dH\1#1\016l", VSHIFT + 1, HSHIFT + MARGIN + 1);
+    screen_printf("\033[%d;%dH\1#1\016l", VSHIFT + 1, HSHIFT + MARGIN + 1);
     for (x = 2 + HSHIFT; x <= (WIDTH - 2 * MARGIN - 1) + HSHIFT; x++)
-	putchar('q');
+	screen_putchar('q');
 
-    printf("k\033[%d;%dH\1#1x\017\1#2 %s \1#1\016x",
-	   VSHIFT + 2,
-	   HSHIFT + MARGIN + 1, pad_line(cm->title, 1, WIDTH - 2 * MARGIN - 4));
+    screen_printf("k\033[%d;%dH\1#1x\017\1#2 %s \1#1\016x",
+		  VSHIFT + 2, HSHIFT + MARGIN + 1,
+		  pad_line(cm->title, 1, WIDTH - 2 * MARGIN - 4));
 
-    printf("\033[%d;%dH\1#1t", VSHIFT + 3, HSHIFT + MARGIN + 1);
+    screen_printf("\033[%d;%dH\1#1t", VSHIFT + 3, HSHIFT + MARGIN + 1);
     for (x = 2 + HSHIFT; x <= (WIDTH - 2 * MARGIN - 1) + HSHIFT; x++)
-	putchar('q');
-    fputs("u\017", stdout);
+	screen_putchar('q');
+    screen_puts("u\017");
 
     for (y = 4 + VSHIFT; y < 4 + VSHIFT + MENU_ROWS; y++)
 	draw_row(y, sel, top, sbtop, sbbot);
 
-    printf("\033[%d;%dH\1#1\016m", y, HSHIFT + MARGIN + 1);
+    screen_printf("\033[%d;%dH\1#1\016m", y, HSHIFT + MARGIN + 1);
     for (x = 2 + HSHIFT; x <= (WIDTH - 2 * MARGIN - 1) + HSHIFT; x++)
-	putchar('q');
-    fputs("j\017", stdout);
+	screen_putchar('q');
+    screen_puts("j\017");
 
     if (edit_line && cm->allowedit && !cm->menu_master_passwd)
 	tabmsg = cm->messages[MSG_TAB];
@@ -341,14 +344,16 @@ static void draw_menu(int sel, int top, int edit_line)
 
     tabmsg_len = strlen(tabmsg);
 
-    printf("\1#8\033[%d;%dH%s",
-	   TABMSG_ROW, 1 + HSHIFT + ((WIDTH - tabmsg_len) >> 1), tabmsg);
-    printf("\1#0\033[%d;1H", END_ROW);
+    screen_printf("\1#8\033[%d;%dH%s",
+		  TABMSG_ROW, 1 + HSHIFT + ((WIDTH - tabmsg_len) >> 1), tabmsg);
+    screen_printf("\1#0\033[%d;1H", END_ROW);
+    screen_flush();
 }
 
 static void clear_screen(void)
 {
     fputs("\033e\033%@\033)0\033(B\1#0\033[?25l\033[2J", stdout);
+    screen_reset();
 }
 
 static void display_help(const char *text)
@@ -358,9 +363,9 @@ static void display_help(const char *text)
 
     if (!text) {
 	text = "";
-	printf("\1#0\033[%d;1H", HELPMSG_ROW);
+	screen_printf("\1#0\033[%d;1H", HELPMSG_ROW);
     } else {
-	printf("\2#16\033[%d;1H", HELPMSG_ROW);
+	screen_printf("\2#16\033[%d;1H", HELPMSG_ROW);
     }
 
     for (p = text, row = HELPMSG_ROW; *p && row <= HELPMSGEND_ROW; p++) {
@@ -371,18 +376,20 @@ static void display_help(const char *text)
 	case '\033':
 	    break;
 	case '\n':
-	    printf("\033[K\033[%d;1H", ++row);
+	    screen_printf("\033[K\033[%d;1H", ++row);
 	    break;
 	default:
-	    putchar(*p);
+	    screen_putchar(*p);
 	}
     }
 
-    fputs("\033[K", stdout);
+    screen_puts("\033[K");
 
     while (row <= HELPMSGEND_ROW) {
-	printf("\033[K\033[%d;1H", ++row);
+	screen_printf("\033[K\033[%d;1H", ++row);
     }
+
+    screen_flush();
 }
 
 static void show_fkey(int key)
@@ -689,13 +696,40 @@ static void print_timeout_message(int tol, int row, const char *msg)
 	padc = (last_msg_len - nc + 1) >> 1;
     }
 
-    printf("\033[%d;%dH\2#14%*s%s%*s", row,
-	   HSHIFT + 1 + ((WIDTH - nc) >> 1) - padc,
-	   padc, "", buf, padc, "");
+    screen_printf("\033[%d;%dH\2#14%*s%s%*s", row,
+		  HSHIFT + 1 + ((WIDTH - nc) >> 1) - padc,
+		  padc, "", buf, padc, "");
+    screen_flush();
 
     last_msg_len = nc;
 }
 
+static void setup_menu_params(struct menu *m)
+{
+    int i;
+
+    if (!m->mparm[P_WIDTH])
+	m->mparm[P_WIDTH] = cols;
+
+    /* If anyone has specified negative parameters, consider them
+       relative to the bottom row of the screen. */
+    for (i = 0; i < NPARAMS; i++)
+	if (m->mparm[i] < 0)
+	    m->mparm[i] = max(m->mparm[i] + rows, 0);
+}
+
+/* Parse a submenu deferred by MENU LAZY, and any menus it defines */
+static void load_submenu(struct menu *m)
+{
+    struct menu *old_list = menu_list, *nm;
+
+    load_menu(m);
+
+    setup_menu_params(m);
+    for (nm = menu_list; nm != old_list; nm = nm->next)
+	setup_menu_params(nm);
+}
+
 /* Set the background screen, etc. */
 static void prepare_screen_for_menu(void)
 {
@@ -863,8 +897,10 @@ static const char *run_menu(void)
 
 	    if (key != KEY_NONE) {
 		timeout_left = key_timeout;
-		if (to_clear)
-		    printf("\033[%d;1H\1#0\033[K", TIMEOUT_ROW);
+		if (to_clear) {
+		    screen_printf("\033[%d;1H\1#0\033[K", TIMEOUT_ROW);
+		    screen_flush();
+		}
 	    }
 	}
 
@@ -893,6 +929,9 @@ static const char *run_menu(void)
 	case KEY_ENTER:
 	case KEY_CTRL('J'):
 	    key_timeout = 0;	/* Cancels timeout */
+	    /* Before the password check, as the body may set MENU PASSWD */
+	    if (me->submenu && me->submenu->body)
+		load_submenu(me->submenu);
 	    if (me->passwd) {
 		clear = 1;
 		done = ask_passwd(me->passwd);
@@ -919,6 +958,7 @@ static const char *run_menu(void)
 		    done = 1;
 		    clear = 1;
 		    draw_row(entry - top + 4 + VSHIFT, -1, top, 0, 0);
+		    screen_flush();
 		    break;
 		case MA_HELP:
 		    key = show_message_file(me->cmdline, me->background);
@@ -1042,6 +1082,7 @@ static const char *run_menu(void)
 
 		key_timeout = 0;	/* Cancels timeout */
 		draw_row(entry - top + 4 + VSHIFT, -1, top, 0, 0);
+		screen_flush();
 
 		if (cm->menu_master_passwd) {
 		    ok = ask_passwd(NULL);
@@ -1049,7 +1090,7 @@ static const char *run_menu(void)
 		    draw_menu(-1, top, 0);
 		} else {
 		    /* Erase [Tab] message and help text */
-		    printf("\033[%d;1H\1#0\033[K", TABMSG_ROW);
+		    screen_printf("\033[%d;1H\1#0\033[K", TABMSG_ROW);
 		    display_help(NULL);
 		}
 
@@ -1059,6 +1100,7 @@ static const char *run_menu(void)
 		    clear = 1;	/* In case we hit [Esc] and done is null */
 		} else {
 		    draw_row(entry - top + 4 + VSHIFT, entry, top, 0, 0);
+		    screen_flush();
 		}
 	    }
 	    break;
@@ -1075,6 +1117,7 @@ static const char *run_menu(void)
 		key_timeout = 0;
 
 		draw_row(entry - top + 4 + VSHIFT, -1, top, 0, 0);
+		screen_flush();
 
 		if (cm->menu_master_passwd)
 		    done = ask_passwd(NULL);
@@ -1104,8 +1147,6 @@ int main(int argc, char *argv[])
 {
     const char *cmdline;
     struct menu *m;
-    int rows, cols;
-    int i;
 
     (void)argc;
 
@@ -1124,16 +1165,8 @@ int main(int argc, char *argv[])
     }
 
     /* Some postprocessing for all menus */
-    for (m = menu_list; m; m = m->next) {
-	if (!m->mparm[P_WIDTH])
-	    m->mparm[P_WIDTH] = cols;
-
-	/* If anyone has specified negative parameters, consider them
-	   relative to the bottom row of the screen. */
-	for (i = 0; i < NPARAMS; i++)
-	    if (m->mparm[i] < 0)
-		m->mparm[i] = max(m->mparm[i] + rows, 0);
-    }
+    for (m = menu_list; m; m = m->next)
+	setup_menu_params(m);
 
     cm = start_menu;
 
@@ -43,6 +43,7 @@ const char *hide_key[KEY_MAX];
 static int has_ui = 0;		/* DEFAULT only counts if UI is found */
 static const char *globaldefault = NULL;
 static bool menusave = false;	/* True if there is any "menu save" */
+static bool lazymenu = false;	/* True after "menu lazy" */
 
 /* Linked list of all entires, hidden or not; used by unlabel() */
 static struct menu_entry *all_entries;
@@ -77,6 +78,40 @@ static const char *const kernel_types[] = {
     NULL
 };
 
+/*
+ * Hash tables of menus and entries by label, mirroring the lookups
+ * through menu_list and all_entries: the most recent menu with a given
+ * label wins, and the first entry.
+ */
+#define MENU_HASH_SIZE	256
+#define LABEL_HASH_SIZE	1024
+
+static struct menu *menu_table[MENU_HASH_SIZE];
+static struct menu_entry *label_table[LABEL_HASH_SIZE];
+
+static void hash_menu(struct menu *m)
+{
+    struct menu **head;
+
+    head = &menu_table[label_hash(m->label, strlen(m->label)) % MENU_HASH_SIZE];
+    m->label_next = *head;
+    *head = m;
+}
+
+static void hash_entry(struct menu_entry *me)
+{
+    struct menu_entry **pp;
+
+    pp = &label_table[label_hash(me->label, strlen(me->label)) %
+		      LABEL_HASH_SIZE];
+    for (; *pp; pp = &(*pp)->label_next) {
+	if (!strcmp((*pp)->label, me->label))
+	    return;
+    }
+
+    *pp = me;
+}
+
 /*
  * Search the list of all menus for a specific label
  */
@@ -84,7 +119,8 @@ static struct menu *find_menu(const char *label)
 {
     struct menu *m;
 
-    for (m = menu_list; m; m = m->next) {
+    m = menu_table[label_hash(label, strlen(label)) % MENU_HASH_SIZE];
+    for (; m; m = m->label_next) {
 	if (!strcmp(label, m->label))
 	    return m;
     }
@@ -186,6 +222,8 @@ static struct menu *new_menu(struct menu *parent,
 
 	m->ontimeout = refstr_get(parent->ontimeout);
 	m->onerror = refstr_get(parent->onerror);
+	m->ontimeout_resolved = parent->ontimeout_resolved;
+	m->onerror_resolved = parent->onerror_resolved;
 	m->menu_master_passwd = refstr_get(parent->menu_master_passwd);
 	m->menu_background = refstr_get(parent->menu_background);
 
@@ -210,6 +248,9 @@ static struct menu *new_menu(struct menu *parent,
     m->next = menu_list;
     menu_list = m;
 
+    if (label)
+	hash_menu(m);
+
     return m;
 }
 
@@ -364,6 +405,9 @@ static void record(struct menu *m, struct labeldata *ld, const char *append)
 	    me->passwd = NULL;
 	}
 
+	if (me->label)
+	    hash_entry(me);
+
 	if (ld->menulabel)
 	    consider_for_hotkey(m, me);
 
@@ -436,7 +480,13 @@ static struct menu *begin_submenu(const char *tag)
 	tag = NULL;
 
     me = new_entry(current_menu);
-    me->displayname = refstrdup(tag);
+    /*
+     * MENU TITLE checks whether this still is the very same string to
+     * tell if MENU LABEL was given, so it mustn't be an interned copy
+     * that a MENU LABEL with the same text would share.
+     */
+    if (tag)
+	rsprintf(&me->displayname, "%s", tag);
     return new_menu(current_menu, me, refstr_get(me->displayname));
 }
 
@@ -458,7 +508,8 @@ static struct menu_entry *find_label(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
+    me = label_table[label_hash(str, pos) % LABEL_HASH_SIZE];
+    for (; me; me = me->label_next) {
 	if (!strncmp(str, me->label, pos) && !me->label[pos])
 	    return me;
     }
@@ -472,25 +523,19 @@ static const char *unlabel(const char *str)
     const char *p;
     const char *q;
     struct menu_entry *me;
-    int pos;
 
+    me = find_label(str);
+    if (!me)
+	return str;
+
+    /* Found matching label */
     p = str;
     while (*p && !my_isspace(*p))
 	p++;
 
-    /* p now points to the first byte beyond the kernel name */
-    pos = p - str;
-
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos]) {
-	    /* Found matching label */
-	    rsprintf(&q, "%s%s", me->cmdline, p);
-	    refstr_put(str);
-	    return q;
-	}
-    }
-
-    return str;
+    rsprintf(&q, "%s%s", me->cmdline, p);
+    refstr_put(str);
+    return q;
 }
 
 static const char *refdup_word(char **p)
@@ -648,7 +693,129 @@ static char *is_fkey(char *cmdstr, int *fkeyno)
     return q;
 }
 
-static void parse_config_file(FILE * f)
+/*
+ * Where parse_config() reads lines from: a file, or a buffer in memory
+ * (the body of a submenu deferred by MENU LAZY).
+ */
+struct config_input {
+    FILE *f;
+    const char *p, *end;
+};
+
+static char *config_gets(char *line, int size, struct config_input *in)
+{
+    const char *nl;
+    size_t len;
+
+    if (in->f)
+	return fgets(line, size, in->f);
+
+    if (in->p >= in->end)
+	return NULL;
+
+    /* Like fgets(), up to and including the newline */
+    nl = memchr(in->p, '\n', in->end - in->p);
+    len = (nl ? nl + 1 : in->end) - in->p;
+    if (len > (size_t)size - 1)
+	len = size - 1;
+
+    memcpy(line, in->p, len);
+    line[len] = '\0';
+    in->p += len;
+    return line;
+}
+
+/*
+ * The body of a submenu which hasn't been parsed yet: either the text
+ * of a MENU BEGIN block or the file named by MENU INCLUDE, along with
+ * the parser state in effect where it was defined.
+ */
+struct menu_body {
+    char *text;
+    size_t len;
+    const char *file;
+    const char *append;
+    unsigned int ipappend;
+};
+
+static void defer_menu(struct menu *m, char *text, size_t len,
+		       const char *file)
+{
+    struct menu_body *b = malloc(sizeof *b);
+
+    if (!b) {
+	free(text);
+	return;
+    }
+
+    b->text = text;
+    b->len = len;
+    b->file = refstr_get(file);
+    b->append = refstr_get(append);
+    b->ipappend = ipappend;
+    m->body = b;
+}
+
+/*
+ * Copy the lines of a MENU BEGIN block, up to the matching MENU END,
+ * so that the submenu can be parsed when it is first entered.  Nested
+ * blocks and TEXT ... ENDTEXT are skipped the same way parse_config()
+ * would read them.
+ */
+static char *read_menu_block(struct config_input *in, size_t *lenp)
+{
+    char line[MAX_LINE], *p, *q;
+    char *text = NULL;
+    size_t len = 0, size = 0, n;
+    int depth = 0;
+    bool in_text = false, nomem = false;
+
+    while (config_gets(line, sizeof line, in)) {
+	p = skipspace(line);
+
+	if (in_text) {
+	    if (looking_at(p, "endtext"))
+		in_text = false;
+	} else if (looking_at(p, "text")) {
+	    in_text = true;
+	} else if (looking_at(p, "menu")) {
+	    p = skipspace(p + 4);
+	    if (looking_at(p, "begin")) {
+		depth++;
+	    } else if (looking_at(p, "end")) {
+		if (!depth--)
+		    break;
+	    }
+	}
+
+	if (nomem)
+	    continue;
+
+	n = strlen(line);
+	if (len + n > size) {
+	    size = max(size * 2, len + n + 256);
+	    q = realloc(text, size);
+	    if (!q) {
+		nomem = true;	/* The submenu will come up empty */
+		continue;
+	    }
+	    text = q;
+	}
+	memcpy(text + len, line, n);
+	len += n;
+    }
+
+    if (nomem) {
+	free(text);
+	text = NULL;
+	len = 0;
+    }
+
+    *lenp = len;
+    return text;
+}
+
+static void parse_config(struct config_input *in)
 {
     char line[MAX_LINE], *p, *ep, ch;
     enum kernel_type type = -1;
@@ -656,7 +823,7 @@ static void parse_config_file(FILE * f)
     int fkeyno = 0;
     struct menu *m = current_menu;
 
-    while (fgets(line, sizeof line, f)) {
+    while (config_gets(line, sizeof line, in)) {
 	p = strchr(line, '\r');
 	if (p)
 	    *p = '\0';
@@ -735,6 +902,7 @@ static void parse_config_file(FILE * f)
 	    } else if (looking_at(p, "onerror")) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
+		m->onerror_resolved = false;
 	    } else if (looking_at(p, "master")) {
 		p = skipspace(p + 6);
 		if (looking_at(p, "passwd")) {
@@ -747,6 +915,8 @@ static void parse_config_file(FILE * f)
 		p = skipspace(ep);
 		refstr_put(m->menu_background);
 		m->menu_background = refdup_word(&p);
+	    } else if (looking_at(p, "lazy")) {
+		lazymenu = true;
 	    } else if ((ep = looking_at(p, "hidden"))) {
 		hiddenmenu = 1;
 	    } else if (looking_at(p, "hiddenkey")) {
@@ -874,6 +1044,13 @@ static void parse_config_file(FILE * f)
 	    } else if (looking_at(p, "begin")) {
 		record(m, &ld, append);
 		m = current_menu = begin_submenu(skipspace(p + 5));
+		if (lazymenu) {
+		    size_t len;
+		    char *text = read_menu_block(in, &len);
+
+		    defer_menu(m, text, len, NULL);
+		    m = current_menu = end_submenu();
+		}
 	    } else if (looking_at(p, "end")) {
 		record(m, &ld, append);
 		m = current_menu = end_submenu();
@@ -947,7 +1124,7 @@ static void parse_config_file(FILE * f)
 	    if (looking_at(p, "help"))
 		cmd = TEXT_HELP;
 
-	    while (fgets(line, sizeof line, f)) {
+	    while (config_gets(line, sizeof line, in)) {
 		p = skipspace(line);
 		if (looking_at(p, "endtext"))
 		    break;
@@ -991,7 +1168,10 @@ do_include:
 		if (*p) {
 		    record(m, &ld, append);
 		    m = current_menu = begin_submenu(p);
-		    parse_one_config(file);
+		    if (lazymenu)
+			defer_menu(m, NULL, 0, file);
+		    else
+			parse_one_config(file);
 		    record(m, &ld, append);
 		    m = current_menu = end_submenu();
 		} else {
@@ -1042,6 +1222,7 @@ do_include:
 	    totaltimeout = (atoll(skipspace(p + 13)) * CLK_TCK + 9) / 10;
 	} else if (looking_at(p, "ontimeout")) {
 	    m->ontimeout = refstrdup(skipspace(p + 9));
+	    m->ontimeout_resolved = false;
 	} else if (looking_at(p, "allowoptions")) {
 	    m->allowedit = !!atoi(skipspace(p + 12));
 	} else if ((ep = looking_at(p, "ipappend")) ||
@@ -1062,6 +1243,7 @@ do_include:
 
 static int parse_one_config(const char *filename)
 {
+    struct config_input in = { 0 };
     FILE *f;
 
     if (!strcmp(filename, "~"))
@@ -1075,18 +1257,18 @@ static int parse_one_config(const char *filename)
     if (!f)
 	return -1;
 
-    parse_config_file(f);
+    in.f = f;
+    parse_config(&in);
     fclose(f);
 
     return 0;
 }
 
-static void resolve_gotos(void)
+static void resolve_gotos(struct menu_entry *me)
 {
-    struct menu_entry *me;
     struct menu *m;
 
-    for (me = all_entries; me; me = me->next) {
+    for (; me; me = me->next) {
 	if (me->action == MA_GOTO_UNRES || me->action == MA_EXIT_UNRES) {
 	    m = find_menu(me->cmdline);
 	    refstr_put(me->cmdline);
@@ -1101,6 +1283,69 @@ static void resolve_gotos(void)
     }
 }
 
+/*
+ * Per-menu initialization, once the labels are known.  ONTIMEOUT and
+ * ONERROR are left alone if they were inherited already resolved and
+ * not set again since; refstrings are interned, so the pointers alone
+ * cannot tell.
+ */
+static void finish_menu(struct menu *m)
+{
+    m->curentry = m->defentry;	/* All menus start at their defaults */
+
+    if (m->ontimeout && !m->ontimeout_resolved)
+	m->ontimeout = unlabel(m->ontimeout);
+    if (m->onerror && !m->onerror_resolved)
+	m->onerror = unlabel(m->onerror);
+    m->ontimeout_resolved = m->onerror_resolved = true;
+}
+
+/*
+ * Parse the body of a submenu deferred by MENU LAZY, when it is about
+ * to be entered.  Any menus it defines are added to the front of
+ * menu_list.
+ */
+void load_menu(struct menu *m)
+{
+    struct menu_body *b = m->body;
+    struct menu_entry **first = all_entries_end;
+    struct menu *old_list = menu_list, *nm;
+    const char *saved_append = append;
+    unsigned int saved_ipappend = ipappend;
+
+    if (!b)
+	return;
+    m->body = NULL;
+
+    /* The parser state as it was where the submenu was defined */
+    append = b->append;
+    ipappend = b->ipappend;
+    current_menu = m;
+
+    if (b->text) {
+	struct config_input in = { .p = b->text, .end = b->text + b->len };
+	parse_config(&in);
+    } else if (b->file) {
+	parse_one_config(b->file);
+    }
+
+    record(current_menu, &ld, append);
+
+    refstr_put(append);
+    append = saved_append;
+    ipappend = saved_ipappend;
+
+    resolve_gotos(*first);
+
+    finish_menu(m);
+    for (nm = menu_list; nm != old_list; nm = nm->next)
+	finish_menu(nm);
+
+    free(b->text);
+    refstr_put(b->file);
+    free(b);
+}
+
 void parse_configs(char **argv)
 {
     const char *filename;
@@ -1131,7 +1376,7 @@ void parse_configs(char **argv)
     record(current_menu, &ld, append);
 
     /* Common postprocessing */
-    resolve_gotos();
+    resolve_gotos(all_entries);
 
     /* Handle global default */
     if (has_ui && globaldefault) {
@@ -1160,14 +1405,8 @@ void parse_configs(char **argv)
     }
 
     /* Final per-menu initialization, with all labels known */
-    for (m = menu_list; m; m = m->next) {
-	m->curentry = m->defentry;	/* All menus start at their defaults */
-
-	if (m->ontimeout)
-	    m->ontimeout = unlabel(m->ontimeout);
-	if (m->onerror)
-	    m->onerror = unlabel(m->onerror);
-    }
+    for (m = menu_list; m; m = m->next)
+	finish_menu(m);
 
     /* Final global initialization, with all labels known */
     for (k = 0; k < KEY_MAX; k++) {
@@ -0,0 +1,451 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * screen.c
+ *
+ * Screen model for the menu drawing code.  The menu is drawn into a
+ * character/attribute buffer using the same escape sequences it would
+ * otherwise send to the console, and screen_flush() then sends only the
+ * cells which differ from what is already on the screen.  Moving the
+ * selection bar thus costs two rows of output rather than a repaint of
+ * the whole menu, which matters most on a serial console.
+ *
+ * Only the subset of the console language the menu uses is understood:
+ * cursor positioning (ESC [ row;col H), erase to end of line (ESC [ K),
+ * the color table selectors (\1#X, \2#XX, \3#XXX), the VT graphics
+ * shifts (\016, \017) and the usual control characters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <minmax.h>
+#include "menu.h"
+
+struct cell {
+    uint8_t ch;
+    uint8_t attr;
+    uint8_t vt;			/* Only set when VT graphics changes ch */
+};
+
+static struct cell *want, *shown;
+static int rows, cols;
+
+/* The state of the model, as left by the characters written so far */
+static int cur_x, cur_y, cur_attr, cur_vt;
+
+static enum {
+    st_init,
+    st_esc,
+    st_skip,
+    st_csi,
+    st_tbl,
+    st_tblc,
+} state;
+static int parms[2], nparms, tbl_digits, tbl_value;
+
+/* Output is collected here and written in as few calls as possible */
+static char obuf[256];
+static size_t olen;
+
+static void out_flush(void)
+{
+    if (olen)
+	fwrite(obuf, 1, olen, stdout);
+    olen = 0;
+}
+
+static void out_char(char c)
+{
+    if (olen >= sizeof obuf)
+	out_flush();
+    obuf[olen++] = c;
+}
+
+static void out_str(const char *s)
+{
+    while (*s)
+	out_char(*s++);
+}
+
+static inline bool vt_sensitive(uint8_t ch)
+{
+    /* The characters VT graphics maps to line drawing */
+    return (ch & 0xe0) == 0x60;
+}
+
+/*
+ * Start a new model for a screen which has just been cleared, i.e. is
+ * all blanks in attribute 0.
+ */
+void screen_reset(void)
+{
+    int r, c, i;
+
+    if (getscreensize(1, &r, &c)) {
+	r = 24;
+	c = 80;
+    }
+
+    if (r != rows || c != cols || !want) {
+	free(want);
+	free(shown);
+	rows = r;
+	cols = c;
+	want = malloc(rows * cols * sizeof *want);
+	shown = malloc(rows * cols * sizeof *shown);
+	if (!want || !shown) {
+	    /* Out of memory: write straight through to the console */
+	    free(want);
+	    free(shown);
+	    want = shown = NULL;
+	}
+    }
+
+    if (want) {
+	for (i = 0; i < rows * cols; i++) {
+	    want[i].ch = ' ';
+	    want[i].attr = 0;
+	    want[i].vt = 0;
+	}
+	memcpy(shown, want, rows * cols * sizeof *shown);
+    }
+
+    cur_x = cur_y = 0;
+    cur_attr = 0;
+    cur_vt = 0;
+    state = st_init;
+}
+
+static void put_cell(uint8_t ch)
+{
+    struct cell *c = &want[cur_y * cols + cur_x];
+
+    c->ch = ch;
+    c->attr = cur_attr;
+    c->vt = cur_vt && vt_sensitive(ch);
+
+    if (++cur_x >= cols) {
+	cur_x = 0;
+	if (cur_y < rows - 1)
+	    cur_y++;
+    }
+}
+
+static void csi_final(int ch)
+{
+    int x;
+
+    switch (ch) {
+    case 'H':
+    case 'f':
+	cur_y = min(max(parms[0], 1), rows) - 1;
+	cur_x = min(max(parms[1], 1), cols) - 1;
+	break;
+    case 'K':
+	if (parms[0] == 0) {
+	    for (x = cur_x; x < cols; x++) {
+		want[cur_y * cols + x].ch = ' ';
+		want[cur_y * cols + x].attr = cur_attr;
+		want[cur_y * cols + x].vt = 0;
+	    }
+	}
+	break;
+    default:
+	/* Not used by the menu */
+	break;
+    }
+}
+
+void screen_putchar(int ch)
+{
+    int n;
+
+    ch = (unsigned char)ch;
+
+    if (!want) {
+	putchar(ch);
+	return;
+    }
+
+    switch (state) {
+    case st_init:
+	switch (ch) {
+	case 1 ... 5:
+	    state = st_tbl;
+	    tbl_digits = ch;
+	    break;
+	case '\b':
+	    if (cur_x > 0)
+		cur_x--;
+	    break;
+	case '\t':
+	    n = 8 - (cur_x & 7);
+	    while (n--)
+		put_cell(' ');
+	    break;
+	case '\n':
+	case '\v':
+	case '\f':
+	    cur_x = 0;
+	    if (cur_y < rows - 1)
+		cur_y++;
+	    break;
+	case '\r':
+	    cur_x = 0;
+	    break;
+	case 14:
+	    cur_vt = 1;
+	    break;
+	case 15:
+	    cur_vt = 0;
+	    break;
+	case 27:
+	    state = st_esc;
+	    break;
+	default:
+	    if (ch >= 32 && ch != 127)
+		put_cell(ch);
+	    break;
+	}
+	break;
+
+    case st_esc:
+	switch (ch) {
+	case '[':
+	    state = st_csi;
+	    parms[0] = parms[1] = 0;
+	    nparms = 0;
+	    break;
+	case '%':
+	case '(':
+	case ')':
+	case '#':
+	    state = st_skip;
+	    break;
+	default:
+	    state = st_init;
+	    break;
+	}
+	break;
+
+    case st_skip:
+	state = st_init;
+	break;
+
+    case st_csi:
+	if (ch >= '0' && ch <= '9') {
+	    if (nparms < 2)
+		parms[nparms] = parms[nparms] * 10 + (ch - '0');
+	} else if (ch == ';') {
+	    nparms++;
+	} else if (ch == '?') {
+	    /* Private modes don't touch the screen contents */
+	    nparms = 2;
+	} else if (ch >= 0x40 && ch <= 0x7e) {
+	    if (nparms <= 1)
+		csi_final(ch);
+	    state = st_init;
+	}
+	break;
+
+    case st_tbl:
+	tbl_value = 0;
+	state = (ch == '#') ? st_tblc : st_init;
+	break;
+
+    case st_tblc:
+	n = ch - '0';
+	if (n < 0 || n > 9) {
+	    state = st_init;
+	} else {
+	    tbl_value = tbl_value * 10 + n;
+	    if (!--tbl_digits) {
+		if (tbl_value < 0xff)
+		    cur_attr = tbl_value;
+		state = st_init;
+	    }
+	}
+	break;
+    }
+}
+
+void screen_puts(const char *s)
+{
+    while (*s)
+	screen_putchar(*s++);
+}
+
+void screen_printf(const char *fmt, ...)
+{
+    char buf[512], *p = buf;
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+
+    if (n >= (int)sizeof buf) {
+	p = malloc(n + 1);
+	if (!p) {
+	    p = buf;
+	} else {
+	    va_start(ap, fmt);
+	    vsnprintf(p, n + 1, fmt, ap);
+	    va_end(ap);
+	}
+    }
+
+    screen_puts(p);
+
+    if (p != buf)
+	free(p);
+}
+
+static void out_moveto(int x, int y)
+{
+    char seq[32];
+
+    sprintf(seq, "\033[%d;%dH", y + 1, x + 1);
+    out_str(seq);
+}
+
+static void out_attr(int attr)
+{
+    char seq[8];
+
+    if (attr < 10)
+	sprintf(seq, "\1#%d", attr);
+    else if (attr < 100)
+	sprintf(seq, "\2#%02d", attr);
+    else
+	sprintf(seq, "\3#%03d", attr);
+    out_str(seq);
+}
+
+static inline bool same_cell(const struct cell *a, const struct cell *b)
+{
+    return a->ch == b->ch && a->attr == b->attr && a->vt == b->vt;
+}
+
+/*
+ * Gaps of up to this many unchanged cells on a row are rewritten rather
+ * than skipped with a cursor positioning sequence, which is about as long.
+ */
+#define MAX_REWRITE	6
+
+/* Is the rest of the row from c on blank, in the attribute of c? */
+static bool blank_to_eol(const struct cell *c, int n)
+{
+    uint8_t attr = c->attr;
+
+    while (n--) {
+	if (c->ch != ' ' || c->attr != attr)
+	    return false;
+	c++;
+    }
+    return true;
+}
+
+/* Can the n unchanged cells at c be rewritten without changing state? */
+static bool can_rewrite(const struct cell *c, int n, int attr, int vt)
+{
+    while (n--) {
+	if (c->attr != attr || (vt_sensitive(c->ch) && c->vt != vt))
+	    return false;
+	c++;
+    }
+    return true;
+}
+
+/*
+ * Bring the screen up to date with the model.  Nothing is assumed about
+ * the console's cursor, attribute or VT graphics state on entry; if
+ * anything was sent, they are left as those of the model, so that output
+ * written directly to the console afterwards lands where the menu code
+ * expects.
+ */
+void screen_flush(void)
+{
+    int x, y, i;
+    int tx = -1, ty = -1;	/* Console cursor, -1 if unknown */
+    int tattr = -1, tvt = -1;	/* Console attribute and VT mode */
+    const struct cell *w;
+
+    if (!want) {
+	fflush(stdout);
+	return;
+    }
+
+    for (y = 0; y < rows; y++) {
+	for (x = 0; x < cols; x++) {
+	    i = y * cols + x;
+	    w = &want[i];
+
+	    if (same_cell(w, &shown[i]))
+		continue;
+
+	    if (ty != y || tx != x) {
+		if (ty == y && tx < x && x - tx <= MAX_REWRITE &&
+		    can_rewrite(&want[i - (x - tx)], x - tx, tattr, tvt)) {
+		    while (tx < x)
+			out_char(want[y * cols + tx++].ch);
+		} else {
+		    out_moveto(x, y);
+		}
+	    }
+
+	    if (vt_sensitive(w->ch) && w->vt != tvt) {
+		out_char(w->vt ? '\016' : '\017');
+		tvt = w->vt;
+	    }
+	    if (w->attr != tattr) {
+		out_attr(w->attr);
+		tattr = w->attr;
+	    }
+
+	    /*
+	     * Erase rather than write trailing blanks; this also keeps us
+	     * from writing the bottom right corner, which would scroll.
+	     */
+	    if (blank_to_eol(w, cols - x)) {
+		out_str("\033[K");
+		memcpy(&shown[i], w, (cols - x) * sizeof *w);
+		tx = x;
+		ty = y;
+		break;
+	    }
+
+	    out_char(w->ch);
+	    shown[i] = *w;
+
+	    tx = x + 1;
+	    ty = y;
+	    if (tx >= cols)
+		tx = ty = -1;	/* Wrapped; reposition explicitly */
+	}
+    }
+
+    if (!olen)
+	return;			/* Nothing changed */
+
+    if (tx != cur_x || ty != cur_y)
+	out_moveto(cur_x, cur_y);
+    if (tvt != cur_vt)
+	out_char(cur_vt ? '\016' : '\017');
+    if (tattr != cur_attr)
+	out_attr(cur_attr);
+
+    out_flush();
+}
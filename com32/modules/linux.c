@@ -231,6 +231,34 @@ static int process_initramfs_args(char *arg, struct initramfs *initramfs,
     return 0;
 }
 
+/* Count the files in a comma-separated list */
+static int count_files(const char *arg)
+{
+    int n = 1;
+
+    while ((arg = strchr(arg, ','))) {
+	arg++;
+	n++;
+    }
+
+    return n;
+}
+
+/* Split a comma-separated list into reqs[], returning the new count */
+static int add_files(struct loadfile_req *reqs, int n, char *arg)
+{
+    char *p;
+
+    do {
+	p = strchr(arg, ',');
+	if (p)
+	    *p++ = '\0';
+	reqs[n++].name = arg;
+    } while ((arg = p));
+
+    return n;
+}
+
 static int setup_data_file(struct setup_data *setup_data,
 			   uint32_t type, const char *filename,
 			   bool opt_quiet)
@@ -264,7 +292,9 @@ int main(int argc, char *argv[])
     bool opt_quiet = false;
     void *dhcpdata;
     size_t dhcplen;
-    char **argp, **argl, *arg;
+    char **argp, **argl, *arg, *initrd;
+    struct loadfile_req *reqs;
+    int i, nreqs, e;
 
     (void)argc;
     argp = argv + 1;
@@ -302,18 +332,6 @@ int main(int argc, char *argv[])
     if (find_boolean(argp, "quiet"))
 	opt_quiet = true;
 
-    if (!opt_quiet)
-	printf("Loading %s... ", kernel_name);
-    errno = 0;
-    if (loadfile(kernel_name, &kernel_data, &kernel_len)) {
-	if (opt_quiet)
-	    printf("Loading %s ", kernel_name);
-	printf("failed: ");
-	goto bail;
-    }
-    if (!opt_quiet)
-	printf("ok\n");
-
     errno = 0;
     cmdline = make_cmdline(argp);
     if (!cmdline) {
@@ -329,20 +347,83 @@ int main(int argc, char *argv[])
 	goto bail;
     }
 
-    /* Process initramfs arguments */
-    if ((arg = find_argument(argp, "initrd="))) {
-	if (process_initramfs_args(arg, initramfs, kernel_name, ldmode_raw,
-				   opt_quiet))
-	    goto bail;
+    /*
+     * The kernel and the raw initramfs archives are loaded all at once,
+     * so that transfers from different servers overlap.
+     */
+    nreqs = 1;
+    if ((initrd = find_argument(argp, "initrd=")))
+	nreqs += count_files(initrd);
+
+    argl = argv;
+    while ((argl = find_arguments(argl, &arg, "initrd+="))) {
+	argl++;
+	nreqs += count_files(arg);
     }
 
+    errno = 0;
+    reqs = calloc(nreqs, sizeof *reqs);
+    if (!reqs) {
+	fprintf(stderr, "Error allocating file list: ");
+	goto bail;
+    }
+
+    reqs[0].name = kernel_name;
+    nreqs = 1;
+    if (initrd)
+	nreqs = add_files(reqs, nreqs, initrd);
+
     argl = argv;
     while ((argl = find_arguments(argl, &arg, "initrd+="))) {
 	argl++;
-	if (process_initramfs_args(arg, initramfs, kernel_name, ldmode_raw,
-				   opt_quiet))
+	nreqs = add_files(reqs, nreqs, arg);
+    }
+
+    if (!opt_quiet) {
+	printf("Loading %s", kernel_name);
+	for (i = 1; i < nreqs; i++)
+	    printf(" %s", reqs[i].name);
+	printf("... ");
+    }
+
+    /* Load the initrds straight to where they will be booted */
+    if (nreqs > 1)
+	loadfiles_reserve(reqs + 1, nreqs - 1, 4, INITRAMFS_ADDR_MAX + 1);
+
+    if (loadfiles(reqs, nreqs)) {
+	for (i = 0; !reqs[i].err; i++)
+	    ;
+	if (!opt_quiet)
+	    printf("\n");
+	printf("Loading %s failed: ", reqs[i].name);
+	e = errno;
+	loadfiles_free(reqs, nreqs);
+	free(reqs);
+	errno = e;
+	goto bail;
+    }
+
+    if (!opt_quiet) {
+	printf("ok\n");
+	loadfiles_report(reqs, nreqs);
+    }
+
+    kernel_data = reqs[0].data;
+    kernel_len = reqs[0].len;
+
+    for (i = 1; i < nreqs; i++) {
+	errno = 0;
+	if (initramfs_add_data(initramfs, reqs[i].data, reqs[i].len,
+			       reqs[i].len, 4)) {
+	    fprintf(stderr, "initramfs_add_data() failed: ");
+	    e = errno;
+	    loadfiles_free(reqs, nreqs);
+	    free(reqs);
+	    errno = e;
 	    goto bail;
+	}
     }
+    free(reqs);
 
     argl = argv;
     while ((argl = find_arguments(argl, &arg, "initrdfile="))) {
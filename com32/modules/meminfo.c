@@ -14,13 +14,16 @@
 /*
  * meminfo.c
  *
- * Dump the memory map of the system
+ * Dump the memory map of the system, and the state of our own heaps
  */
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <console.h>
 #include <com32.h>
+#include <syslinux/memstats.h>
+
+#define MAX_OWNERS	16
 
 struct e820_data {
     uint64_t base;
@@ -124,9 +127,41 @@ static void dump_legacy(void)
 	   oreg.ecx.w[0], oreg.ecx.w[0], oreg.edx.w[0], oreg.edx.w[0] << 6);
 }
 
+static void dump_heaps(void)
+{
+    static const char *const heap_names[] = { "main", "lowmem" };
+    struct syslinux_heap_stats hs;
+    struct syslinux_mem_owner owners[MAX_OWNERS];
+    int heap, i, n;
+
+    printf("Heap        used       peak       free    largest  frag  "
+	   "failed\n");
+    for (heap = SYSLINUX_HEAP_MAIN; heap <= SYSLINUX_HEAP_LOWMEM; heap++) {
+	if (syslinux_heap_stats(heap, &hs))
+	    continue;
+
+	/* How much of the free memory is unusable for one big allocation */
+	printf("%-6s %9zu  %9zu  %9zu  %9zu  %3zu%%  %6lu\n",
+	       heap_names[heap], hs.used_bytes, hs.peak_bytes, hs.free_bytes,
+	       hs.largest_free,
+	       hs.free_bytes ? 100 - (hs.largest_free * 100) / hs.free_bytes : 0,
+	       hs.failures);
+    }
+
+    n = syslinux_mem_owners(owners, MAX_OWNERS);
+    if (!n)
+	return;
+
+    printf("Owner                      used   blocks       peak\n");
+    for (i = 0; i < n; i++)
+	printf("%-22.22s %9zu %8zu  %9zu\n", owners[i].name,
+	       owners[i].bytes, owners[i].blocks, owners[i].peak);
+}
+
 int main(int argc __unused, char **argv __unused)
 {
     dump_legacy();
     dump_e820();
+    dump_heaps();
     return 0;
 }
@@ -13,6 +13,7 @@
 #include <sys/vesa/debug.h>
 #include <minmax.h>
 #include "core.h"
+#include "thread.h"
 
 __export struct firmware *firmware = NULL;
 
@@ -684,6 +685,13 @@ static void bios_cleanup_hardware(void)
 	 */
 	__intcall(0x13, &zero_regs, NULL);
 
+	/*
+	 * Get any queued console output out of the way.  This has to
+	 * happen while the timer hook is still in place, since
+	 * serial_flush() times out on ms_timer().
+	 */
+	serial_flush();
+
 	call16(bios_timer_cleanup, &zero_regs, NULL);
 
 	/* If we enabled serial port interrupts, clean them up now */
@@ -691,6 +699,7 @@ static void bios_cleanup_hardware(void)
 }
 
 extern void *bios_malloc(size_t, enum heap, size_t);
+extern void *bios_malloc_high(size_t, size_t, uintptr_t, size_t);
 extern void *bios_realloc(void *, size_t);
 extern void bios_free(void *);
 
@@ -698,6 +707,7 @@ struct mem_ops bios_mem_ops = {
 	.malloc = bios_malloc,
 	.realloc = bios_realloc,
 	.free = bios_free,
+	.malloc_high = bios_malloc_high,
 };
 
 struct firmware bios_fw = {
@@ -711,6 +721,7 @@ struct firmware bios_fw = {
 	.adv_ops = &bios_adv_ops,
 	.vesa = &bios_vesa_ops,
 	.mem = &bios_mem_ops,
+	.run_threads = run_threads,
 };
 
 void syslinux_register_bios(void)
@@ -46,6 +46,7 @@ __export uint16_t DisplayCon = 0x01;	/* Display console enabled */
 __export uint8_t FlowOutput = 0;	/* Output to assert for serial flow */
 
 __export uint8_t DisplayMask = 0x07;	/* Display modes mask */
+__export uint8_t SerialTxFifo = 1;	/* Bytes the UART takes when THRE is set */
 
 uint8_t ScrollAttribute = 0x07; /* Grey on white (normal text color) */
 
@@ -69,37 +70,155 @@ __export int loadkeys(const char *filename)
 }
 
 /*
- * write_serial: If serial output is enabled, write character on
- * serial port.
+ * Serial output goes through a transmit ring, which is moved into the
+ * UART a FIFO load at a time whenever the transmitter is empty: from
+ * write_serial() itself, from the idle loop and, if serial interrupts
+ * are enabled, from the serial IRQ handler.  Writers only wait when
+ * the ring is full.
  */
-__export void write_serial(char data)
+#define SERIAL_TX_SIZE		1024	/* Must be a power of 2 */
+#define SERIAL_TX_MASK		(SERIAL_TX_SIZE - 1)
+#define SERIAL_FLUSH_TIMEOUT	250	/* ms without progress before we give up */
+
+static char serial_tx_buf[SERIAL_TX_SIZE];
+static volatile uint16_t serial_tx_head, serial_tx_tail;
+
+static inline unsigned int serial_tx_queued(void)
+{
+	return (serial_tx_head - serial_tx_tail) & SERIAL_TX_MASK;
+}
+
+/*
+ * Feed the UART from the ring, if it has room.  Call with interrupts
+ * disabled.  Returns the number of bytes handed to the UART.
+ */
+static unsigned int serial_tx_drain(void)
+{
+	uint16_t tail = serial_tx_tail;
+	unsigned int n = 0;
+
+	if (tail == serial_tx_head)
+		return 0;
+
+	/* Wait for space in transmit register */
+	if (!(inb(SerialPort + 5) & 0x20))	/* LSR */
+		return 0;
+
+	/* Wait for input flow control */
+	if ((inb(SerialPort + 6) & FlowInput) != FlowInput)	/* MSR */
+		return 0;
+
+	while (n < SerialTxFifo && tail != serial_tx_head) {
+		outb(serial_tx_buf[tail], SerialPort);
+		tail = (tail + 1) & SERIAL_TX_MASK;
+		n++;
+	}
+
+	serial_tx_tail = tail;
+	return n;
+}
+
+/*
+ * serial_tx_poll: push queued serial output along.
+ *
+ * Returns the number of bytes moved out of the ring; zero if there was
+ * nothing queued or the UART could not take any (busy or flow control).
+ */
+__export unsigned int serial_tx_poll(void)
 {
+	irq_state_t irq;
+	unsigned int moved;
+
 	if (!SerialPort)
-		return;
+		return 0;
 
-	if (!(DisplayMask & 0x04))
+	irq = irq_save();
+	moved = serial_tx_drain();
+	sirq_tx_enable(serial_tx_queued() != 0);
+	irq_restore(irq);
+
+	return moved;
+}
+
+/*
+ * serial_flush: wait for all queued serial output to be sent, e.g.
+ * before the port is reprogrammed or we boot something.  Output which
+ * isn't moving (flow control) is dropped after a while.
+ */
+__export void serial_flush(void)
+{
+	mstime_t start = ms_timer();
+
+	if (!SerialPort)
 		return;
 
-	while (1) {
-		char ch;
+	while (serial_tx_queued()) {
+		if (serial_tx_poll()) {
+			start = ms_timer();
+		} else if (ms_timer() - start > SERIAL_FLUSH_TIMEOUT) {
+			serial_tx_tail = serial_tx_head;
+			return;
+		}
+		cpu_relax();
+	}
 
-		ch = inb(SerialPort + 5); /* LSR */
+	/* Let the last bytes leave the shift register */
+	start = ms_timer();
+	while (!(inb(SerialPort + 5) & 0x40)) {	/* LSR TEMT */
+		if (ms_timer() - start > SERIAL_FLUSH_TIMEOUT)
+			break;
+		cpu_relax();
+	}
+}
 
-		/* Wait for space in transmit register */
-		if (!(ch & 0x20))
-			continue;
+/*
+ * write_serial_buf: If serial output is enabled, queue a buffer for
+ * the serial port.
+ */
+__export void write_serial_buf(const void *buf, size_t count)
+{
+	const char *p = buf;
+	irq_state_t irq;
+	uint16_t head;
 
-		/* Wait for input flow control */
-		ch = inb(SerialPort + 6);
-		ch &= FlowInput;
-		if (ch != FlowInput)
-			continue;
+	if (!SerialPort)
+		return;
 
-		break;
+	if (!(DisplayMask & 0x04))
+		return;
+
+	irq = irq_save();
+	while (count) {
+		head = serial_tx_head;
+
+		/* Ring full?  Drain it, letting interrupts in meanwhile */
+		while (((head + 1) & SERIAL_TX_MASK) == serial_tx_tail) {
+			serial_tx_drain();
+			irq_restore(irq);
+			cpu_relax();
+			irq = irq_save();
+		}
+
+		while (count && ((head + 1) & SERIAL_TX_MASK) != serial_tx_tail) {
+			serial_tx_buf[head] = *p++;
+			head = (head + 1) & SERIAL_TX_MASK;
+			count--;
+		}
+		serial_tx_head = head;
 	}
 
-	outb(data, SerialPort);	/* Send data */
-	io_delay();
+	serial_tx_drain();
+	sirq_tx_enable(serial_tx_queued() != 0);
+	irq_restore(irq);
+}
+
+/*
+ * write_serial: If serial output is enabled, write character on
+ * serial port.
+ */
+__export void write_serial(char data)
+{
+	write_serial_buf(&data, 1);
 }
 
 void pm_write_serial(com32sys_t *regs)
@@ -137,10 +256,7 @@ void pm_serialcfg(com32sys_t *regs)
  */
 __export void write_serial_str(char *data)
 {
-	char ch;
-
-	while ((ch = *data++))
-		write_serial(ch);
+	write_serial_buf(data, strlen(data));
 }
 
 /*
@@ -44,11 +44,15 @@ extern void print_elf_symbols(struct elf_module *module);
  * Image files manipulation routines
  */
 
-extern int image_load(struct elf_module *module);
+extern void *module_bundle_find(const char *name, size_t *size);
+
+extern int image_read_file(FILE *f, char **data, size_t *len);
+extern int image_load(struct elf_module *module, int use_bundle);
 extern int image_unload(struct elf_module *module);
 extern int image_read(void *buff, size_t size, struct elf_module *module);
 extern int image_skip(size_t size, struct elf_module *module);
 extern int image_seek(Elf32_Off offset, struct elf_module *module);
+extern void *image_ptr(Elf32_Off offset, size_t size, struct elf_module *module);
 
 extern struct module_dep *module_dep_alloc(struct elf_module *module);
 
@@ -59,4 +63,7 @@ extern int clear_dependency(struct elf_module *req, struct elf_module *dep);
 
 extern int check_symbols(struct elf_module *module);
 
+extern int module_index_symbols(struct elf_module *module);
+extern void module_unindex_symbols(struct elf_module *module);
+
 #endif /* COMMON_H_ */
@@ -20,6 +20,7 @@
 
 #include <sys/exec.h>
 #include <sys/module.h>
+#include <sys/modbundle.h>
 #include "common.h"
 
 extern char __dynstr_start[];
@@ -53,6 +54,7 @@ struct elf_module core_module = {
 void init_module_subsystem(struct elf_module *module)
 {
     list_add(&module->list, &modules_head);
+    module_index_symbols(module);
 }
 
 static int _start_ldlinux(int argc, char **argv)
@@ -190,6 +192,9 @@ void load_env32(com32sys_t * regs __unused)
 
 	init_module_subsystem(&core_module);
 
+	/* Fetch LDLINUX and the modules it needs in one go, if we can */
+	module_bundle_open(MODBUNDLE_FILE, CORE_BUILD_ID);
+
 	start_ldlinux(1, argv);
 
 	/*
@@ -220,6 +225,7 @@ void load_env32(com32sys_t * regs __unused)
 			goto out;
 		}
 
+		module_bundle_open(MODBUNDLE_FILE, CORE_BUILD_ID);
 		start_ldlinux(1, argv);
 	}
 
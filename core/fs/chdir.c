@@ -94,6 +94,9 @@ __export int chdir(const char *src)
     dprintf("chdir: from %s (inode %p) add %s\n",
 	    this_fs->cwd_name, this_fs->cwd, src);
 
+    /* Relative PATH entries may now point elsewhere */
+    path_generation++;
+
     if (this_fs->fs_ops->chdir)
 	return this_fs->fs_ops->chdir(this_fs, src);
 
@@ -47,6 +47,8 @@ void put_inode(struct inode *inode)
 	if (refcnt)
 	    break;		/* We still have references */
 	inode = dead->parent;
+	if (dead->fs && dead->fs->fs_ops->free_inode)
+	    dead->fs->fs_ops->free_inode(dead);
 	if (dead->name)
 	    free((char *)dead->name);
 	free(dead);
@@ -180,6 +180,151 @@ out:
     return -1;
 }
 
+/* Decode the data runs of a non-resident attribute into @rlist */
+static int ntfs_decode_runlist(struct ntfs_attr_record *attr,
+                               struct runlist *rlist)
+{
+    uint8_t *attr_len;
+    uint8_t *stream;
+    uint32_t offset;
+    struct mapping_chunk chunk;
+    struct runlist_element run;
+    int err;
+
+    dprintf("in %s()\n", __func__);
+
+    runlist_init(rlist);
+
+    attr_len = (uint8_t *)attr + attr->len;
+    stream = mapping_chunk_init(attr, &chunk, &offset);
+    for (;;) {
+        err = parse_data_run(stream, &offset, attr_len, &chunk);
+        if (err) {
+            runlist_free(rlist);
+            return -1;
+        }
+
+        if (chunk.flags & MAP_END)
+            break;
+
+        run.vcn = chunk.vcn;
+        run.len = chunk.len;
+        run.lcn = chunk.flags & MAP_UNALLOCATED ? RUNLIST_LCN_HOLE : chunk.lcn;
+        runlist_append(rlist, &run);
+
+        /* update for next VCN */
+        chunk.vcn += chunk.len;
+    }
+
+    return 0;
+}
+
+/* Get the decoded runlist of $MFT/$DATA, parsing it on first use */
+static const struct runlist *ntfs_mft_runlist(struct fs_info *fs)
+{
+    struct ntfs_sb_info *sbi = NTFS_SB(fs);
+    struct ntfs_mft_record *mrec, *lmrec;
+    struct ntfs_attr_record *attr;
+    uint64_t start_blk = 0;
+
+    if (!runlist_is_empty(&sbi->mft_runs))
+        return &sbi->mft_runs;
+
+    mrec = sbi->mft_record_lookup(fs, FILE_MFT, &start_blk);
+    if (!mrec) {
+        dprintf("%s: read MFT(0) failed\n", __func__);
+        return NULL;
+    }
+
+    lmrec = mrec;
+    if (get_inode_mode(mrec) != DT_REG) {
+        dprintf("%s: $MFT is not a file\n", __func__);
+        goto out;
+    }
+
+    attr = ntfs_attr_lookup(fs, NTFS_AT_DATA, &mrec, lmrec);
+    if (!attr) {
+        dprintf("%s: $MFT have no data attr\n", __func__);
+        goto out;
+    }
+
+    if (!attr->non_resident) {
+        dprintf("%s: $MFT data attr is resident\n", __func__);
+        goto out;
+    }
+
+    if (ntfs_decode_runlist(attr, &sbi->mft_runs))
+        dprintf("%s: $MFT data run parse failed\n", __func__);
+
+out:
+    free(mrec);
+
+    return runlist_is_empty(&sbi->mft_runs) ? NULL : &sbi->mft_runs;
+}
+
+/* Return a private copy of a cached MFT record, or NULL on a miss */
+static struct ntfs_mft_record *ntfs_mft_cache_get(struct fs_info *fs,
+                                                  uint32_t file,
+                                                  block_t *out_blk)
+{
+    struct ntfs_sb_info *sbi = NTFS_SB(fs);
+    struct ntfs_mft_cache_entry *ce;
+    uint8_t *buf;
+    int i;
+
+    for (i = 0; i < NTFS_MFT_CACHE_ENTRIES; i++) {
+        ce = &sbi->mft_cache[i];
+        if (!ce->data || ce->mft_no != file)
+            continue;
+
+        buf = malloc(sbi->mft_record_size);
+        if (!buf) {
+            malloc_error("uint8_t *");
+            return NULL;
+        }
+
+        memcpy(buf, ce->data, sbi->mft_record_size);
+        ce->stamp = ++sbi->mft_cache_stamp;
+        if (out_blk)
+            *out_blk = ce->blk;
+
+        return (struct ntfs_mft_record *)buf;
+    }
+
+    return NULL;
+}
+
+/* Remember an MFT record which has been validated and fixed up */
+static void ntfs_mft_cache_put(struct fs_info *fs, uint32_t file,
+                               block_t blk, const struct ntfs_mft_record *mrec)
+{
+    struct ntfs_sb_info *sbi = NTFS_SB(fs);
+    struct ntfs_mft_cache_entry *ce, *victim = NULL;
+    int i;
+
+    for (i = 0; i < NTFS_MFT_CACHE_ENTRIES; i++) {
+        ce = &sbi->mft_cache[i];
+        if (!ce->data) {
+            victim = ce;
+            break;
+        }
+
+        if (!victim || (int32_t)(ce->stamp - victim->stamp) < 0)
+            victim = ce;
+    }
+
+    if (!victim->data) {
+        victim->data = malloc(sbi->mft_record_size);
+        if (!victim->data)
+            return;     /* the cache is only an optimization */
+    }
+
+    memcpy(victim->data, mrec, sbi->mft_record_size);
+    victim->mft_no = file;
+    victim->blk = blk;
+    victim->stamp = ++sbi->mft_cache_stamp;
+}
+
 /* AndyAlex: read and validate single MFT record. Keep in mind that MFT itself can be fragmented */
 static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
                                                 uint32_t file, block_t *out_blk, bool is_v31)
@@ -193,50 +338,36 @@ static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
     block_t blk = 0;
     uint64_t offset = 0;
 
-    struct ntfs_mft_record *mrec = NULL, *lmrec = NULL;
-    uint64_t start_blk = 0;
-    struct ntfs_attr_record *attr = NULL;
-    uint8_t *stream = NULL;
-    uint32_t attr_offset = 0;
-    uint8_t *attr_len = NULL;
-    struct mapping_chunk chunk;
+    struct ntfs_mft_record *mrec = NULL;
+    const struct runlist *mft_runs;
+    const struct runlist_element *run;
 
     int err = 0;
 
     /* determine MFT record's LCN */
     uint64_t vcn = (file << mft_record_shift >> clust_byte_shift);
     dprintf("in %s(%s)\n", __func__,(is_v31?"v3.1":"v3.0"));
+
+    /* records in the cache already had their fixups applied */
+    mrec = ntfs_mft_cache_get(fs, file, out_blk);
+    if (mrec) {
+      if (!is_v31 || mrec->mft_record_no == file)
+        return mrec;
+      free(mrec);
+      mrec = NULL;
+    }
+
     if (0==vcn) {
       lcn = NTFS_SB(fs)->mft_lcn;
-    } else do {
+    } else {
       dprintf("%s: looking for VCN %u for MFT record %u\n", __func__,(unsigned)vcn,(unsigned)file);
-      mrec = NTFS_SB(fs)->mft_record_lookup(fs, 0, &start_blk);
-      if (!mrec) {dprintf("%s: read MFT(0) failed\n", __func__); break;}
-      lmrec = mrec;
-      if (get_inode_mode(mrec) != DT_REG) {dprintf("%s: $MFT is not a file\n", __func__); break;}
-      attr = ntfs_attr_lookup(fs, NTFS_AT_DATA, &mrec, lmrec);
-      if (!attr) {dprintf("%s: $MFT have no data attr\n", __func__); break;}
-      if (!attr->non_resident) {dprintf("%s: $MFT data attr is resident\n", __func__); break;}
-      attr_len = (uint8_t *)attr + attr->len;
-      stream = mapping_chunk_init(attr, &chunk, &attr_offset);
-      while (true) {
-        err = parse_data_run(stream, &attr_offset, attr_len, &chunk);
-        if (err) {dprintf("%s: $MFT data run parse failed with error %d\n", __func__,err); break;}
-        if (chunk.flags & MAP_UNALLOCATED) continue;
-        if (chunk.flags & MAP_END) break;
-        if (chunk.flags & MAP_ALLOCATED) {
-          dprintf("%s: Chunk: VCN=%u, LCN=%u, len=%u\n", __func__,(unsigned)chunk.vcn,(unsigned)chunk.lcn,(unsigned)chunk.len);
-          if ((vcn>=chunk.vcn)&&(vcn<chunk.vcn+chunk.len)) {
-            lcn=vcn-chunk.vcn+chunk.lcn;
-            dprintf("%s: VCN %u for MFT record %u maps to lcn %u\n", __func__,(unsigned)vcn,(unsigned)file,(unsigned)lcn);
-            break;
-          }
-          chunk.vcn += chunk.len;
-        }
+      mft_runs = ntfs_mft_runlist(fs);
+      run = mft_runs ? runlist_lookup(mft_runs, vcn) : NULL;
+      if (run && run->lcn != RUNLIST_LCN_HOLE) {
+        lcn=vcn-run->vcn+run->lcn;
+        dprintf("%s: VCN %u for MFT record %u maps to lcn %u\n", __func__,(unsigned)vcn,(unsigned)file,(unsigned)lcn);
       }
-    } while(false);
-    if (mrec!=NULL) free(mrec);
-    mrec = NULL;
+    }
     if (0==lcn) {
       dprintf("%s: unable to map VCN %u for MFT record %u\n", __func__,(unsigned)vcn,(unsigned)file);
       return NULL;
@@ -268,9 +399,11 @@ static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
     if (mrec->magic != NTFS_MAGIC_FILE) mrec = NULL;
     if (mrec && is_v31) if (mrec->mft_record_no != file) mrec = NULL;
     if (mrec!=NULL) {
+      blk = (file << mft_record_shift >> BLOCK_SHIFT(fs));
       if (out_blk) {
-        *out_blk = (file << mft_record_shift >> BLOCK_SHIFT(fs));   /* update record starting block */
+        *out_blk = blk;   /* update record starting block */
       }
+      ntfs_mft_cache_put(fs, file, blk, mrec);
       return mrec;          /* found MFT record */
     }
 
@@ -378,6 +511,14 @@ static int parse_data_run(const void *stream, uint32_t *offset,
 
     chunk->len = res;   /* get length data */
 
+    /* a run without an LCN offset is sparse: it has no clusters and
+     * leaves the LCN base of the following runs untouched
+     */
+    if (!l) {
+        chunk->flags |= MAP_UNALLOCATED;
+        goto done;
+    }
+
     byte = (uint8_t *)buf + v + l;
     count = l;
 
@@ -396,6 +537,8 @@ static int parse_data_run(const void *stream, uint32_t *offset,
     else
         chunk->flags |= MAP_ALLOCATED;
 
+done:
+
     *offset += v + l + 1;
 
     return 0;
@@ -614,11 +757,6 @@ static int index_inode_setup(struct fs_info *fs, unsigned long mft_no,
     struct ntfs_mft_record *mrec, *lmrec;
     struct ntfs_attr_record *attr;
     enum dirent_type d_type;
-    uint8_t *attr_len;
-    struct mapping_chunk chunk;
-    int err;
-    uint8_t *stream;
-    uint32_t offset;
 
     dprintf("in %s()\n", __func__);
 
@@ -675,31 +813,13 @@ static int index_inode_setup(struct fs_info *fs, unsigned long mft_no,
                 (uint32_t)((uint8_t *)attr + attr->data.resident.value_offset);
             inode->size = attr->data.resident.value_len;
         } else {
-            attr_len = (uint8_t *)attr + attr->len;
-
-            stream = mapping_chunk_init(attr, &chunk, &offset);
-            NTFS_PVT(inode)->data.non_resident.rlist = NULL;
-            for (;;) {
-                err = parse_data_run(stream, &offset, attr_len, &chunk);
-                if (err) {
-                    printf("parse_data_run()\n");
-                    goto out;
-                }
-
-                if (chunk.flags & MAP_UNALLOCATED)
-                    continue;
-                if (chunk.flags & MAP_END)
-                    break;
-                if (chunk.flags &  MAP_ALLOCATED) {
-                    /* append new run to the runlist */
-                    runlist_append(&NTFS_PVT(inode)->data.non_resident.rlist,
-                                    (struct runlist_element *)&chunk);
-                    /* update for next VCN */
-                    chunk.vcn += chunk.len;
-                }
+            if (ntfs_decode_runlist(attr,
+                                    &NTFS_PVT(inode)->data.non_resident.rlist)) {
+                printf("parse_data_run()\n");
+                goto out;
             }
 
-            if (runlist_is_empty(NTFS_PVT(inode)->data.non_resident.rlist)) {
+            if (runlist_is_empty(&NTFS_PVT(inode)->data.non_resident.rlist)) {
                 printf("No mapping found\n");
                 goto out;
             }
@@ -915,8 +1035,8 @@ static int ntfs_next_extent(struct inode *inode, uint32_t lstart)
     struct fs_info *fs = inode->fs;
     struct ntfs_sb_info *sbi = NTFS_SB(fs);
     sector_t pstart = 0;
-    struct runlist *rlist;
-    struct runlist *ret;
+    const struct runlist_element *run;
+    uint32_t delta;
     const uint32_t sec_size = SECTOR_SIZE(fs);
     const uint32_t sec_shift = SECTOR_SHIFT(fs);
 
@@ -927,27 +1047,19 @@ static int ntfs_next_extent(struct inode *inode, uint32_t lstart)
                 sec_shift;
         inode->next_extent.len = (inode->size + sec_size - 1) >> sec_shift;
     } else {
-        rlist = NTFS_PVT(inode)->data.non_resident.rlist;
-
-        if (!lstart || lstart >= NTFS_PVT(inode)->here) {
-            if (runlist_is_empty(rlist))
-                goto out;   /* nothing to do ;-) */
-
-            ret = runlist_remove(&rlist);
-
-            NTFS_PVT(inode)->here =
-                ((ret->run.len << sbi->clust_byte_shift) >> sec_shift);
-
-            pstart = ret->run.lcn << sbi->clust_shift;
-            inode->next_extent.len =
-                ((ret->run.len << sbi->clust_byte_shift) + sec_size - 1) >>
-                sec_shift;
-
-            NTFS_PVT(inode)->data.non_resident.rlist = rlist;
-
-            free(ret);
-            ret = NULL;
-        }
+        /* map the logical sector through the decoded runlist */
+        run = runlist_lookup(&NTFS_PVT(inode)->data.non_resident.rlist,
+                             lstart >> sbi->clust_shift);
+        if (!run)
+            goto out;   /* nothing to do ;-) */
+
+        delta = lstart - (run->vcn << sbi->clust_shift);
+        if (run->lcn == RUNLIST_LCN_HOLE)
+            pstart = EXTENT_ZERO;
+        else
+            pstart = (run->lcn << sbi->clust_shift) + delta;
+
+        inode->next_extent.len = (run->len << sbi->clust_shift) - delta;
     }
 
     inode->next_extent.pstart = pstart;
@@ -1010,6 +1122,13 @@ out:
     return 0;
 }
 
+/* Drop the decoded runlist when put_inode() releases the inode */
+static void ntfs_free_inode(struct inode *inode)
+{
+    if (NTFS_PVT(inode)->non_resident)
+        runlist_free(&NTFS_PVT(inode)->data.non_resident.rlist);
+}
+
 static inline bool is_filename_printable(const char *s)
 {
     return s && (*s != '.' && *s != '$');
@@ -1322,6 +1441,8 @@ static int ntfs_fs_init(struct fs_info *fs)
     if (!sbi)
         malloc_error("ntfs_sb_info structure");
 
+    memset(sbi, 0, sizeof *sbi);
+
     fs->fs_info = sbi;
 
     sbi->clust_shift            = ilog2(ntfs.sec_per_clust);
@@ -1366,6 +1487,7 @@ const struct fs_ops ntfs_fs_ops = {
     .searchdir      = NULL,
     .getfssec       = ntfs_getfssec,
     .close_file     = generic_close_file,
+    .free_inode     = ntfs_free_inode,
     .mangle_name    = generic_mangle_name,
     .open_config    = generic_open_config,
     .readdir        = ntfs_readdir,
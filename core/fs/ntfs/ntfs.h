@@ -50,6 +50,16 @@ struct ntfs_bpb {
     uint8_t pad[428];       /* padding to a sector boundary (512 bytes) */
 } __attribute__((__packed__));
 
+/* Number of MFT records kept, with fixups applied, by the record cache */
+#define NTFS_MFT_CACHE_ENTRIES  16
+
+struct ntfs_mft_cache_entry {
+    uint32_t mft_no;            /* MFT record number */
+    uint32_t stamp;             /* Last use, for LRU replacement */
+    block_t blk;                /* Block holding the record */
+    uint8_t *data;              /* The record, NULL if the slot is unused */
+};
+
 /* Function type for an NTFS-version-dependent MFT record lookup */
 struct ntfs_mft_record;
 typedef struct ntfs_mft_record *f_mft_record_lookup(struct fs_info *,
@@ -75,7 +85,13 @@ struct ntfs_sb_info {
 
     /* NTFS-version-dependent MFT record lookup function to use */
     f_mft_record_lookup *mft_record_lookup;
-} __attribute__((__packed__));
+
+    struct runlist mft_runs;        /* Decoded runlist of $MFT/$DATA */
+
+    /* Recently used MFT records */
+    struct ntfs_mft_cache_entry mft_cache[NTFS_MFT_CACHE_ENTRIES];
+    uint32_t mft_cache_stamp;
+};
 
 /* The NTFS in-memory inode structure */
 struct ntfs_inode {
@@ -90,7 +106,7 @@ struct ntfs_inode {
             uint32_t offset;    /* Data offset */
         } resident;
         struct {            /* Used only if non_resident is set */
-            struct runlist *rlist;
+            struct runlist rlist;   /* Decoded data runs */
         } non_resident;
     } data;
     uint32_t start_cluster; /* Starting cluster address */
@@ -20,6 +20,16 @@
 #ifndef _RUNLIST_H_
 #define _RUNLIST_H_
 
+/*
+ * A decoded runlist: the mapping pairs of a non-resident attribute are
+ * parsed once and kept as an array sorted by VCN, so that any VCN can be
+ * mapped with a binary search instead of reparsing the data runs.
+ *
+ * Sparse runs are kept with an lcn of RUNLIST_LCN_HOLE.
+ */
+
+#define RUNLIST_LCN_HOLE    ((int64_t)-1)
+
 struct runlist_element {
     uint64_t vcn;
     int64_t lcn;
@@ -27,57 +37,65 @@ struct runlist_element {
 };
 
 struct runlist {
-    struct runlist_element run;
-    struct runlist *next;
+    struct runlist_element *runs;
+    unsigned int count;
+    unsigned int max;
 };
 
-static struct runlist *tail;
-
-static inline bool runlist_is_empty(struct runlist *rlist)
+static inline bool runlist_is_empty(const struct runlist *rlist)
 {
-    return !rlist;
+    return !rlist->count;
 }
 
-static inline struct runlist *runlist_alloc(void)
+static inline void runlist_init(struct runlist *rlist)
 {
-    struct runlist *rlist;
-
-    rlist = malloc(sizeof *rlist);
-    if (!rlist)
-        malloc_error("runlist structure");
-
-    rlist->next = NULL;
+    rlist->runs = NULL;
+    rlist->count = rlist->max = 0;
+}
 
-    return rlist;
+static inline void runlist_free(struct runlist *rlist)
+{
+    free(rlist->runs);
+    runlist_init(rlist);
 }
 
-static inline void runlist_append(struct runlist **rlist,
-                                struct runlist_element *elem)
+static inline void runlist_append(struct runlist *rlist,
+                                  const struct runlist_element *elem)
 {
-    struct runlist *n = runlist_alloc();
+    struct runlist_element *runs;
 
-    n->run = *elem;
+    if (rlist->count == rlist->max) {
+        rlist->max = rlist->max ? rlist->max << 1 : 8;
+        runs = realloc(rlist->runs, rlist->max * sizeof *runs);
+        if (!runs)
+            malloc_error("runlist structure");
 
-    if (runlist_is_empty(*rlist)) {
-        *rlist = n;
-        tail = n;
-    } else {
-        tail->next = n;
-        tail = n;
+        rlist->runs = runs;
     }
+
+    rlist->runs[rlist->count++] = *elem;
 }
 
-static inline struct runlist *runlist_remove(struct runlist **rlist)
+/* Return the run containing @vcn, or NULL if @vcn is past the end */
+static inline const struct runlist_element *
+runlist_lookup(const struct runlist *rlist, uint64_t vcn)
 {
-    struct runlist *ret;
-
-    if (runlist_is_empty(*rlist))
-        return NULL;
-
-    ret = *rlist;
-    *rlist = ret->next;
+    unsigned int lo = 0, hi = rlist->count;
+    const struct runlist_element *run;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) >> 1;
+
+        run = &rlist->runs[mid];
+        if (vcn < run->vcn)
+            hi = mid;
+        else if (vcn >= run->vcn + run->len)
+            lo = mid + 1;
+        else
+            return run;
+    }
 
-    return ret;
+    return NULL;
 }
 
 #endif /* _RUNLIST_H_ */
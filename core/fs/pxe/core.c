@@ -15,6 +15,9 @@ const struct url_scheme url_schemes[] = {
     { NULL, NULL, 0 },
 };
 
+/* Each lwIP connection has its own receive queue */
+const int core_udp_concurrency = 8;
+
 /**
  * Open a socket
  *
@@ -1,10 +1,31 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <core.h>
+#include <net.h>
+#include <thread.h>
 #include "pxe.h"
 #include "lwip/api.h"
 #include "lwip/dns.h"
 
+#define DNS_PORT	53
+
+/* Resolver cache */
+#define DNS_CACHE_SIZE	16
+#define DNS_MAX_TTL	3600	/* Cap on how long we trust an answer (s) */
+#define DNS_NEG_TTL	60	/* How long we remember a name is missing (s) */
+
+/* Retransmissions: every server is asked again after 1, 2 then 4 s */
+#define DNS_TIMEOUT	1000	/* ms */
+#define DNS_RETRIES	3
+
+/* DNS header flags */
+#define FLAG_QR		0x8000	/* This is a response */
+#define FLAG_RD		0x0100	/* Recursion desired */
+#define FLAG_RA		0x0080	/* Recursion available */
+#define RCODE_MASK	0x000f
+#define RCODE_NXDOMAIN	3
+
 /* DNS CLASS values we care about */
 #define CLASS_IN	1
 
@@ -81,6 +102,294 @@ static bool parse_dotquad(const char *ip_str, uint32_t *res)
     return *p == '\0';
 }
 
+struct dns_cache_entry {
+    char name[256];
+    uint32_t ip;		/* 0 if the name doesn't resolve */
+    mstime_t expires;
+    bool valid;
+};
+
+static struct dns_cache_entry dns_cache[DNS_CACHE_SIZE];
+
+/*
+ * Several threads may resolve names at once (see loadfiles()); this
+ * protects the cache and the query ID counter.
+ */
+static DECLARE_INIT_SEMAPHORE(dns_sem, 1);
+static uint16_t dns_id;
+
+static bool dns_cache_lookup(const char *name, uint32_t *ip)
+{
+    struct dns_cache_entry *ce;
+    bool found = false;
+
+    sem_down(&dns_sem, 0);
+
+    for (ce = dns_cache; ce < &dns_cache[DNS_CACHE_SIZE]; ce++) {
+	if (!ce->valid || strcasecmp(ce->name, name))
+	    continue;
+
+	if ((mstimediff_t)(ce->expires - ms_timer()) <= 0) {
+	    ce->valid = false;	/* Expired */
+	    break;
+	}
+
+	*ip = ce->ip;
+	found = true;
+	break;
+    }
+
+    sem_up(&dns_sem);
+    return found;
+}
+
+static void dns_cache_add(const char *name, uint32_t ip, uint32_t ttl)
+{
+    struct dns_cache_entry *ce, *victim = NULL;
+
+    if (strlen(name) >= sizeof victim->name)
+	return;
+
+    if (ttl > DNS_MAX_TTL)
+	ttl = DNS_MAX_TTL;
+
+    sem_down(&dns_sem, 0);
+
+    /* Reuse a free slot, or else the one closest to expiry */
+    for (ce = dns_cache; ce < &dns_cache[DNS_CACHE_SIZE]; ce++) {
+	if (!ce->valid) {
+	    victim = ce;
+	    break;
+	}
+	if (!victim || (mstimediff_t)(ce->expires - victim->expires) < 0)
+	    victim = ce;
+    }
+
+    strcpy(victim->name, name);
+    victim->ip = ip;
+    victim->expires = ms_timer() + ttl * 1000;
+    victim->valid = true;
+
+    sem_up(&dns_sem);
+}
+
+/*
+ * Turn a dotted name into a sequence of DNS labels. Returns the
+ * length of the encoded name, or 0 if it can't be encoded.
+ */
+static int dns_mangle(char *buf, const char *name, int bufsize)
+{
+    char *p = buf, *lenp;
+    const char *end = buf + bufsize;
+
+    while (*name) {
+	lenp = p++;
+	while (*name && *name != '.') {
+	    if (p >= end - 1)
+		return 0;
+	    *p++ = *name++;
+	}
+	if (p - lenp - 1 == 0 || p - lenp - 1 > 63)
+	    return 0;		/* Empty or oversized label */
+	*lenp = p - lenp - 1;
+	if (*name)
+	    name++;
+    }
+
+    *p++ = 0;
+    return p - buf;
+}
+
+/*
+ * Skip a (possibly compressed) name in a DNS packet
+ */
+static const char *dns_skipname(const char *p, const char *end)
+{
+    uint8_t c;
+
+    while (p < end) {
+	c = *p++;
+	if (c >= 0xc0)
+	    return p + 1 <= end ? p + 1 : NULL;	/* Pointer */
+	if (!c)
+	    return p;
+	p += c;
+    }
+
+    return NULL;
+}
+
+/*
+ * Look for the answer to our query in a reply.  Returns false if the
+ * packet should be ignored, true if it settles the question; *ip is 0
+ * if the name doesn't resolve.
+ */
+static bool dns_parse_reply(const char *buf, int len, uint16_t id,
+			    uint32_t *ip, uint32_t *ttl)
+{
+    const struct dnshdr *hd = (const struct dnshdr *)buf;
+    const char *end = buf + len;
+    const char *p;
+    const struct dnsrr *rr;
+    uint16_t flags;
+    int ques, reps;
+    uint32_t rttl;
+
+    if (len < (int)sizeof *hd || hd->id != id)
+	return false;
+
+    flags = ntohs(hd->flags);
+    if (!(flags & FLAG_QR))
+	return false;
+
+    if ((flags & RCODE_MASK) == RCODE_NXDOMAIN) {
+	*ip = 0;
+	*ttl = DNS_NEG_TTL;
+	return true;
+    }
+
+    if (flags & RCODE_MASK)
+	return false;		/* Server failure; let another one answer */
+
+    p = buf + sizeof *hd;
+    ques = ntohs(hd->qdcount);
+    reps = ntohs(hd->ancount);
+
+    while (ques--) {
+	p = dns_skipname(p, end);
+	if (!p)
+	    return false;
+	p += sizeof(struct dnsquery);
+    }
+
+    /* Follow the CNAME chain, if any; the TTL is that of its weakest link */
+    *ttl = DNS_MAX_TTL;
+    while (reps--) {
+	p = dns_skipname(p, end);
+	if (!p || p + sizeof *rr > end)
+	    return false;
+
+	rr = (const struct dnsrr *)p;
+	p += sizeof *rr + ntohs(rr->rdlength);
+	if (p > end)
+	    return false;
+
+	if (ntohs(rr->class) != CLASS_IN)
+	    continue;
+
+	rttl = ntohl(rr->ttl);
+	if (rttl < *ttl)
+	    *ttl = rttl;
+
+	if (ntohs(rr->type) == TYPE_A && ntohs(rr->rdlength) == 4) {
+	    memcpy(ip, rr->rdata, 4);
+	    return true;
+	}
+    }
+
+    /*
+     * No address.  Only a recursive server can tell us the name really
+     * has none; otherwise give the other servers a chance.
+     */
+    if (!(flags & FLAG_RA))
+	return false;
+
+    *ip = 0;
+    *ttl = DNS_NEG_TTL;
+    return true;
+}
+
+static bool dns_is_server(uint32_t ip)
+{
+    int i;
+
+    for (i = 0; i < DNS_MAX_SERVERS; i++) {
+	if (dns_server[i] && dns_server[i] == ip)
+	    return true;
+    }
+
+    return false;
+}
+
+/*
+ * Ask all the configured servers at once, and take the first answer.
+ * Returns false if none of them answered.
+ *
+ * core_udp_recv() yields, so everything here must be private to the
+ * call: another thread may be resolving a name at the same time.
+ */
+static bool dns_query(const char *name, uint32_t *ip, uint32_t *ttl)
+{
+    char *query_buf, *buf;
+    struct pxe_pvt_inode socket;
+    struct dnshdr *hd;
+    struct dnsquery *query;
+    mstime_t timeout, start;
+    uint16_t buf_len, src_port;
+    uint32_t src_ip;
+    bool answered = false;
+    int len, qlen, i, tries;
+    uint16_t id;
+
+    query_buf = malloc(2*PKTBUF_SIZE);
+    if (!query_buf)
+	return false;
+    buf = query_buf + PKTBUF_SIZE;
+    hd = (struct dnshdr *)query_buf;
+
+    len = dns_mangle(query_buf + sizeof *hd, name,
+		     PKTBUF_SIZE - sizeof *hd - sizeof *query);
+    if (!len)
+	goto out;
+
+    memset(&socket, 0, sizeof socket);
+    if (core_udp_open(&socket))
+	goto out;
+
+    sem_down(&dns_sem, 0);
+    id = htons(++dns_id ^ (uint16_t)ms_timer());
+    sem_up(&dns_sem);
+
+    hd->id      = id;
+    hd->flags   = htons(FLAG_RD);
+    hd->qdcount = htons(1);
+    hd->ancount = 0;
+    hd->nscount = 0;
+    hd->arcount = 0;
+
+    query = (struct dnsquery *)(query_buf + sizeof *hd + len);
+    query->qtype  = htons(TYPE_A);
+    query->qclass = htons(CLASS_IN);
+    qlen = sizeof *hd + len + sizeof *query;
+
+    timeout = DNS_TIMEOUT;
+    for (tries = DNS_RETRIES; tries && !answered; tries--, timeout <<= 1) {
+	for (i = 0; i < DNS_MAX_SERVERS; i++) {
+	    if (dns_server[i])
+		core_udp_sendto(&socket, query_buf, qlen,
+				dns_server[i], DNS_PORT);
+	}
+
+	start = ms_timer();
+	while (ms_timer() - start < timeout) {
+	    buf_len = PKTBUF_SIZE;
+	    if (core_udp_recv(&socket, buf, &buf_len, &src_ip, &src_port))
+		continue;
+	    if (src_port != DNS_PORT || !dns_is_server(src_ip))
+		continue;
+	    if (dns_parse_reply(buf, buf_len, id, ip, ttl)) {
+		answered = true;
+		break;
+	    }
+	}
+    }
+
+    core_udp_close(&socket);
+out:
+    free(query_buf);
+    return answered;
+}
+
 /*
  * Actual resolver function.
  *
@@ -90,8 +399,8 @@ static bool parse_dotquad(const char *ip_str, uint32_t *res)
  */
 __export uint32_t pxe_dns(const char *name)
 {
-    err_t err;
     struct ip_addr ip;
+    uint32_t ttl;
     char fullname[512];
 
     /*
@@ -107,7 +416,7 @@ __export uint32_t pxe_dns(const char *name)
 	return ip.addr;
 
     /* Make sure we have at least one valid DNS server */
-    if (!dns_getserver(0).addr)
+    if (!dns_server[0])
 	return 0;
 
     /* Is it a local (unqualified) domain name? */
@@ -116,9 +425,12 @@ __export uint32_t pxe_dns(const char *name)
 	name = fullname;
     }
 
-    err = netconn_gethostbyname(name, &ip);
-    if (err)
-	return 0;
+    if (dns_cache_lookup(name, &ip.addr))
+	return ip.addr;
+
+    if (!dns_query(name, &ip.addr, &ttl))
+	return 0;		/* No answer; don't remember that */
 
+    dns_cache_add(name, ip.addr, ttl);
     return ip.addr;
 }
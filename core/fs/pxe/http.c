@@ -1,5 +1,6 @@
 #include <syslinux/sysappend.h>
 #include <ctype.h>
+#include <errno.h>
 #include <lwip/api.h>
 #include "pxe.h"
 #include "version.h"
@@ -48,7 +49,7 @@ static bool append_ch(char *str, size_t size, size_t *pos, int ch)
 }
 
 static size_t cookie_len, header_len;
-static char *cookie_buf, *header_buf;
+static char *cookie_buf;
 
 __export uint32_t SendCookies = UINT_MAX; /* Send all cookies */
 
@@ -133,15 +134,8 @@ __export void http_bake_cookies(void)
 	return;
     }
 
-    if (header_buf)
-	free(header_buf);
-
+    /* Each request builds its header in a buffer of its own */
     header_len = cookie_len + 6*FILENAME_MAX + 256;
-    header_buf = malloc(header_len);
-    if (!header_buf) {
-	header_len = 0;
-	return;			/* Uh-oh... */
-    }
 
     http_do_bake_cookies(cookie_buf);
 }
@@ -152,10 +146,16 @@ static const struct pxe_conn_ops http_conn_ops = {
     .readdir		= http_readdir,
 };
 
+/*
+ * On a redirect, *redir is set to the new location, in a malloc'd
+ * buffer the caller frees.  Nothing here may be static: several files
+ * can be opened at once (see loadfiles()).
+ */
 void http_open(struct url_info *url, int flags, struct inode *inode,
 	       const char **redir)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
+    char *header_buf;
     int header_bytes;
     const char *next;
     char field_name[20];
@@ -172,7 +172,7 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	st_skip_fieldvalue,
 	st_eoh,
     } state;
-    static char location[FILENAME_MAX];
+    char location[FILENAME_MAX];
     uint32_t content_length; /* same as inode->size */
     size_t response_size;
     int status;
@@ -181,9 +181,14 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 
     (void)flags;
 
-    if (!header_buf)
+    if (!header_len)
 	return;			/* http is broken... */
 
+    header_buf = malloc(header_len);
+    if (!header_buf)
+	return;
+    location[0] = '\0';
+
     /* This is a straightforward TCP connection after headers */
     socket->ops = &http_conn_ops;
 
@@ -192,8 +197,10 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 
     /* Start the http connection */
     err = core_tcp_open(socket);
-    if (err)
+    if (err) {
+	free(header_buf);
         return;
+    }
 
     if (!url->port)
 	url->port = HTTP_PORT;
@@ -233,7 +240,10 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
     if (header_bytes >= header_len)
 	goto fail;		/* Buffer overflow */
 
-    err = core_tcp_write(socket, header_buf, header_bytes, false);
+    /* Copied, as the buffer goes away once it is sent */
+    err = core_tcp_write(socket, header_buf, header_bytes, true);
+    free(header_buf);
+    header_buf = NULL;
     if (err)
 	goto fail;
 
@@ -391,7 +401,11 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	/* A redirect */
 	if (!location[0])
 	    goto fail;
-	*redir = location;
+	*redir = strdup(location);
+	goto fail;
+    case 404:
+    case 410:
+	errno = ENOENT;		/* Not Found, Gone */
 	goto fail;
     default:
 	goto fail;
@@ -399,6 +413,7 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
     }
     return;
 fail:
+    free(header_buf);
     inode->size = 0;
     core_tcp_close_file(inode);
     return;
@@ -1,4 +1,5 @@
 #include <dprintf.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <core.h>
@@ -290,11 +291,15 @@ static void __pxe_searchdir(const char *filename, int flags, struct file *file)
 #endif
     struct url_info url;
     const struct url_scheme *us = NULL;
+    const char *redirect = NULL;
     int redirect_count = 0;
     bool found_scheme = false;
 
     inode = file->inode = NULL;
 
+    /* Only a scheme which positively knows the file isn't there says ENOENT */
+    errno = EIO;
+
     while (filename) {
 	if (redirect_count++ > 5)
 	    break;
@@ -312,6 +317,10 @@ static void __pxe_searchdir(const char *filename, int flags, struct file *file)
 	    parse_url(&url, fullpath);
 	}
 
+	/* filename may be the previous redirect; done with it now */
+	free((char *)redirect);
+	redirect = NULL;
+
 	inode = allocate_socket(fs);
 	if (!inode)
 	    return;			/* Allocation failure */
@@ -323,14 +332,16 @@ static void __pxe_searchdir(const char *filename, int flags, struct file *file)
 	for (us = url_schemes; us->name; us++) {
 	    if (!strcmp(us->name, url.scheme)) {
 		if ((flags & ~us->ok_flags & OK_FLAGS_MASK) == 0)
-		    us->open(&url, flags, inode, &filename);
+		    us->open(&url, flags, inode, &redirect);
 		found_scheme = true;
 		break;
 	    }
 	}
 
-	/* filename here is set on a redirect */
+	/* redirect, a malloc'd string, is set on a redirect */
+	filename = redirect;
     }
+    free((char *)redirect);
 
     if (!found_scheme) {
 #if GPXE
@@ -439,14 +450,57 @@ static int pxe_chdir_start(void)
 	return 0;
 }
 
+/* UUID, MAC, 8 hexadecimal IP prefixes, "default" */
+#define PXE_CONFIG_NAMES	11
+#define PXE_CONFIG_NAME_LEN	(3*(MAC_MAX+1)+1)
+
+/*
+ * Ask for all the candidate config files at once, if they all live on
+ * a TFTP server and the network stack can juggle several sockets.
+ * Returns the index of the first one which exists, -1 if none does,
+ * or -2 if they have to be tried one by one.
+ */
+static int pxe_probe_config(char *config_file,
+			    char names[][PXE_CONFIG_NAME_LEN], int count)
+{
+    struct url_info url[PXE_CONFIG_NAMES];
+    char (*paths)[2*FILENAME_MAX];
+    int i, rv = -2;
+
+    if (core_udp_concurrency < 2)
+	return -2;
+
+    paths = malloc(count * sizeof *paths);
+    if (!paths)
+	return -2;
+
+    for (i = 0; i < count; i++) {
+	strcpy(config_file, names[i]);
+	pxe_realpath(this_fs, paths[i], ConfigName, sizeof *paths);
+	parse_url(&url[i], paths[i]);
+	if (!url[i].scheme || strcmp(url[i].scheme, "tftp"))
+	    goto out;
+	if (url_set_ip(&url[i]))
+	    goto out;
+    }
+
+    rv = tftp_probe(url, count, core_udp_concurrency);
+
+out:
+    free(paths);
+    return rv;
+}
+
 /* Load the config file, return -1 if failed, or 0 */
 static int pxe_open_config(struct com32_filedata *filedata)
 {
     const char *cfgprefix = "pxelinux.cfg/";
     const char *default_str = "default";
+    char names[PXE_CONFIG_NAMES][PXE_CONFIG_NAME_LEN];
     char *config_file;
-    char *last;
-    int tries = 8;
+    int count = 0;
+    int tries;
+    int i;
 
     chdir(path_prefix);
     if (DHCPMagic & 0x02) {
@@ -456,37 +510,40 @@ static int pxe_open_config(struct com32_filedata *filedata)
     }
 
     /*
-     * Have to guess config file name ...
+     * Have to guess config file name, in order of preference ...
      */
-    config_file = stpcpy(ConfigName, cfgprefix);
 
-    /* Try loading by UUID */
-    if (sysappend_strings[SYSAPPEND_SYSUUID]) {
-	strcpy(config_file, sysappend_strings[SYSAPPEND_SYSUUID]+8);
-	if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-            return 0;
-    }
+    /* By UUID */
+    if (sysappend_strings[SYSAPPEND_SYSUUID])
+	strlcpy(names[count++], sysappend_strings[SYSAPPEND_SYSUUID]+8,
+		PXE_CONFIG_NAME_LEN);
 
-    /* Try loading by MAC address */
-    strcpy(config_file, sysappend_strings[SYSAPPEND_BOOTIF]+7);
-    if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-        return 0;
+    /* By MAC address */
+    strlcpy(names[count++], sysappend_strings[SYSAPPEND_BOOTIF]+7,
+	    PXE_CONFIG_NAME_LEN);
 
-    /* Nope, try hexadecimal IP prefixes... */
-    sprintf(config_file, "%08X", ntohl(IPInfo.myip));
-    last = &config_file[8];
-    while (tries) {
-        *last = '\0';        /* Zero-terminate string */
-	if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-            return 0;
-        last--;           /* Drop one character */
-        tries--;
-    };
+    /* By hexadecimal IP prefixes, dropping one character at a time */
+    for (tries = 8; tries; tries--) {
+	sprintf(names[count], "%08X", ntohl(IPInfo.myip));
+	names[count++][tries] = '\0';
+    }
 
     /* Final attempt: "default" string */
-    strcpy(config_file, default_str);
-    if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-        return 0;
+    strcpy(names[count++], default_str);
+
+    config_file = stpcpy(ConfigName, cfgprefix);
+
+    i = pxe_probe_config(config_file, names, count);
+    if (i == -2)
+	i = 0;			/* Couldn't probe, try them all in turn */
+    else if (i < 0)
+	i = count;		/* None of them is there */
+
+    for (; i < count; i++) {
+	strcpy(config_file, names[i]);
+	if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
+	    return 0;
+    }
 
     ddprintf("%-68s\n", "Unable to locate configuration file");
     kaboom();
@@ -142,7 +142,12 @@ struct pxe_pvt_inode {
     uint16_t tftp_lastpkt;        /* Sequence number of last packet (HBO) */
     char    *tftp_dataptr;        /* Pointer to available data */
     uint8_t  tftp_goteof;         /* 1 if the EOF packet received */
-    uint8_t  tftp_unused[3];      /* Currently unused */
+    uint8_t  tftp_rtt_valid;      /* 1 once a round trip was measured */
+    uint8_t  tftp_unused[2];      /* Currently unused */
+    uint32_t tftp_srtt;           /* Smoothed round trip time, ms << 3 */
+    uint32_t tftp_rttvar;         /* Round trip time variation, ms << 2 */
+    uint32_t tftp_rto;            /* Retransmission timeout, ms */
+    uint32_t tftp_retransmits;    /* Retransmissions on this transfer */
     char    *tftp_pktbuf;         /* Packet buffer */
     struct inode *ctl;	          /* Control connection (for FTP) */
     const struct pxe_conn_ops *ops;
@@ -241,6 +246,7 @@ void pxe_idle_cleanup(void);
 /* tftp.c */
 void tftp_open(struct url_info *url, int flags, struct inode *inode,
 	       const char **redir);
+int tftp_probe(struct url_info *url, int count, int window);
 
 /* gpxeurl.c */
 void gpxe_open(struct inode *inode, const char *url);
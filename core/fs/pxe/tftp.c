@@ -1,4 +1,5 @@
 #include <minmax.h>
+#include <errno.h>
 #include <net.h>
 #include "pxe.h"
 #include "url.h"
@@ -14,12 +15,127 @@ struct tftp_packet {
     char data[];
 };
 
+struct tftp_stats tftp_stats;
+
+/*
+ * Round trip estimate left by the last exchange, so that a new transfer
+ * (usually to the same server) doesn't have to start from scratch.
+ */
+static struct {
+    bool valid;
+    uint32_t srtt, rttvar, rto;
+} tftp_rtt_seed;
+
+/*
+ * Timing of one request/reply exchange
+ */
+struct tftp_timer {
+    mstime_t start;		/* First transmission */
+    mstime_t sent;		/* Latest transmission */
+    bool resent;		/* The round trip is ambiguous */
+};
+
+static void tftp_rtt_init(struct pxe_pvt_inode *socket)
+{
+    socket->tftp_rtt_valid   = tftp_rtt_seed.valid;
+    socket->tftp_srtt        = tftp_rtt_seed.srtt;
+    socket->tftp_rttvar      = tftp_rtt_seed.rttvar;
+    socket->tftp_rto         = tftp_rtt_seed.valid ? tftp_rtt_seed.rto
+						     : TFTP_RTO_INITIAL;
+    socket->tftp_retransmits = 0;
+}
+
+/*
+ * Fold a round trip measurement into the estimate, the way TCP does
+ * (RFC 6298): SRTT += (R - SRTT)/8, RTTVAR += (|R - SRTT| - RTTVAR)/4,
+ * RTO = SRTT + max(G, 4*RTTVAR), G being the clock granularity.
+ */
+static void tftp_rtt_sample(struct pxe_pvt_inode *socket, mstime_t rtt)
+{
+    int32_t delta;
+    uint32_t rto;
+
+    if (!socket->tftp_rtt_valid) {
+	socket->tftp_srtt = rtt << 3;
+	socket->tftp_rttvar = rtt << 1;
+	socket->tftp_rtt_valid = 1;
+    } else {
+	delta = rtt - (socket->tftp_srtt >> 3);
+	socket->tftp_srtt += delta;
+	if (delta < 0)
+	    delta = -delta;
+	socket->tftp_rttvar += delta - (socket->tftp_rttvar >> 2);
+    }
+
+    rto = (socket->tftp_srtt >> 3) + max(TFTP_CLOCK_G, socket->tftp_rttvar);
+    if (rto < TFTP_RTO_MIN)
+	rto = TFTP_RTO_MIN;
+    else if (rto > TFTP_RTO_MAX)
+	rto = TFTP_RTO_MAX;
+    socket->tftp_rto = rto;
+
+    tftp_rtt_seed.valid  = true;
+    tftp_rtt_seed.srtt   = socket->tftp_srtt;
+    tftp_rtt_seed.rttvar = socket->tftp_rttvar;
+    tftp_rtt_seed.rto    = rto;
+}
+
+static void tftp_timer_start(struct tftp_timer *timer)
+{
+    timer->start = timer->sent = ms_timer();
+    timer->resent = false;
+}
+
+/*
+ * Called while waiting for a reply. Returns 1 if the request should be
+ * sent again, with the timeout backed off, 0 to keep waiting, or -1 if
+ * it is time to give up.
+ */
+static int tftp_timer_check(struct pxe_pvt_inode *socket,
+			    struct tftp_timer *timer)
+{
+    mstime_t now = ms_timer();
+
+    if (now - timer->sent < socket->tftp_rto)
+	return 0;
+
+    if (now - timer->start >= TFTP_GIVEUP) {
+	tftp_stats.giveups++;
+	return -1;
+    }
+
+    socket->tftp_rto <<= 1;
+    if (socket->tftp_rto > TFTP_RTO_MAX)
+	socket->tftp_rto = TFTP_RTO_MAX;
+
+    timer->sent = now;
+    timer->resent = true;
+    socket->tftp_retransmits++;
+    tftp_stats.retransmits++;
+    return 1;
+}
+
+/*
+ * A reply came in. Only take a sample if there is no doubt about which
+ * transmission it answers (Karn's algorithm).
+ */
+static void tftp_timer_done(struct pxe_pvt_inode *socket,
+			    struct tftp_timer *timer)
+{
+    tftp_stats.exchanges++;
+    if (!timer->resent)
+	tftp_rtt_sample(socket, ms_timer() - timer->sent);
+}
+
 static void tftp_error(struct inode *file, uint16_t errnum,
 		       const char *errstr);
 
 static void tftp_close_file(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
+
+    dprintf("tftp: %u retransmits, rto %u ms\n",
+	    socket->tftp_retransmits, socket->tftp_rto);
     if (!socket->tftp_goteof) {
 	tftp_error(inode, 0, "No error, file close");
     }
@@ -29,12 +145,12 @@ static void tftp_close_file(struct inode *inode)
 /**
  * Send an ERROR packet.  This is used to terminate a connection.
  *
- * @inode:	Inode structure
+ * @socket:	Socket structure
  * @errnum:	Error number (network byte order)
  * @errstr:	Error string (included in packet)
  */
-static void tftp_error(struct inode *inode, uint16_t errnum,
-		       const char *errstr)
+static void tftp_send_error(struct pxe_pvt_inode *socket, uint16_t errnum,
+			    const char *errstr)
 {
     static struct {
 	uint16_t err_op;
@@ -42,7 +158,6 @@ static void tftp_error(struct inode *inode, uint16_t errnum,
 	char err_msg[64];
     } __packed err_buf;
     int len = min(strlen(errstr), sizeof(err_buf.err_msg)-1);
-    struct pxe_pvt_inode *socket = PVT(inode);
 
     err_buf.err_op  = TFTP_ERROR;
     err_buf.err_num = errnum;
@@ -52,6 +167,12 @@ static void tftp_error(struct inode *inode, uint16_t errnum,
     core_udp_send(socket, &err_buf, 4 + len + 1);
 }
 
+static void tftp_error(struct inode *inode, uint16_t errnum,
+		       const char *errstr)
+{
+    tftp_send_error(PVT(inode), errnum, errstr);
+}
+
 /**
  * Send ACK packet. This is a common operation and so is worth canning.
  *
@@ -78,11 +199,9 @@ static void ack_packet(struct inode *inode, uint16_t ack_num)
 static void tftp_get_packet(struct inode *inode)
 {
     uint16_t last_pkt;
-    const uint8_t *timeout_ptr;
-    uint8_t timeout;
+    struct tftp_timer timer;
     uint16_t buffersize;
     uint16_t serial;
-    jiffies_t oldtime;
     struct tftp_packet *pkt = NULL;
     uint16_t buf_len;
     struct pxe_pvt_inode *socket = PVT(inode);
@@ -94,26 +213,21 @@ static void tftp_get_packet(struct inode *inode)
      * Start by ACKing the previous packet; this should cause
      * the next packet to be sent.
      */
-    timeout_ptr = TimeoutTable;
-    timeout = *timeout_ptr++;
-    oldtime = jiffies();
+    tftp_timer_start(&timer);
 
  ack_again:
     ack_packet(inode, socket->tftp_lastpkt);
 
-    while (timeout) {
+    for (;;) {
 	buf_len = socket->tftp_blksize + 4;
 	err = core_udp_recv(socket, socket->tftp_pktbuf, &buf_len,
 			    &src_ip, &src_port);
 	if (err) {
-	    jiffies_t now = jiffies();
-
-	    if (now-oldtime >= timeout) {
-		oldtime = now;
-		timeout = *timeout_ptr++;
-		if (!timeout)
-		    break;
+	    switch (tftp_timer_check(socket, &timer)) {
+	    case 1:
 		goto ack_again;
+	    case -1:
+		kaboom();	/* time runs out */
 	    }
             continue;
 	}
@@ -129,10 +243,6 @@ static void tftp_get_packet(struct inode *inode)
         break;
     }
 
-    /* time runs out */
-    if (timeout == 0)
-	kaboom();
-
     last_pkt = socket->tftp_lastpkt;
     last_pkt++;
     serial = ntohs(pkt->serial);
@@ -146,9 +256,12 @@ static void tftp_get_packet(struct inode *inode)
 	printf("Wrong packet, wanted %04x, got %04x\n", \
                htons(last_pkt), htons(*(uint16_t *)(data+2)));
 #endif
+	timer.resent = true;
         goto ack_again;
     }
 
+    tftp_timer_done(socket, &timer);
+
     /* It's the packet we want.  We're also EOF if the size < blocksize */
     socket->tftp_lastpkt = last_pkt;    /* Update last packet number */
     buffersize = buf_len - 4;		/* Skip TFTP header */
@@ -197,9 +310,7 @@ void tftp_open(struct url_info *url, int flags, struct inode *inode,
     int err;
     int buffersize;
     int rrq_len;
-    const uint8_t  *timeout_ptr;
-    jiffies_t timeout;
-    jiffies_t oldtime;
+    struct tftp_timer timer;
     uint16_t opcode;
     uint16_t blk_num;
     uint64_t opdata;
@@ -236,13 +347,9 @@ void tftp_open(struct url_info *url, int flags, struct inode *inode,
 
     rrq_len = buf - rrq_packet_buf;
 
-    timeout_ptr = TimeoutTable;   /* Reset timeout */
+    tftp_rtt_init(socket);
+    tftp_timer_start(&timer);
 sendreq:
-    timeout = *timeout_ptr++;
-    if (!timeout)
-	return;			/* No file available... */
-    oldtime = jiffies();
-
     core_udp_sendto(socket, rrq_packet_buf, rrq_len, url->ip, url->port);
 
     /* If the WRITE call fails, we let the timeout take care of it... */
@@ -253,9 +360,13 @@ wait_pkt:
 	err = core_udp_recv(socket, reply_packet_buf, &buf_len,
 			    &src_ip, &src_port);
 	if (err) {
-	    jiffies_t now = jiffies();
-	    if (now - oldtime >= timeout)
-		 goto sendreq;
+	    switch (tftp_timer_check(socket, &timer)) {
+	    case 1:
+		goto sendreq;
+	    case -1:
+		core_udp_close(socket);
+		return;		/* No file available... */
+	    }
 	} else {
 	    /* Make sure the packet actually came from the server and
 	       is long enough for a TFTP opcode */
@@ -274,6 +385,7 @@ wait_pkt:
 	}
     }
 
+    tftp_timer_done(socket, &timer);
     core_udp_disconnect(socket);
     core_udp_connect(socket, src_ip, src_port);
 
@@ -288,6 +400,10 @@ wait_pkt:
     opcode = *(uint16_t *)reply_packet_buf;
     switch (opcode) {
     case TFTP_ERROR:
+	/* Other errors don't mean the file doesn't exist */
+	if (buffersize >= 2 &&
+	    ((struct tftp_error *)reply_packet_buf)->errcode == TFTP_ENOTFOUND)
+	    errno = ENOENT;
         inode->size = 0;
 	goto done;        /* ERROR reply; don't try again */
 
@@ -425,6 +541,198 @@ done:
 }
 
 
+/*
+ * State of one request issued by tftp_probe()
+ */
+struct tftp_probe {
+    struct pxe_pvt_inode socket;
+    struct url_info *url;
+    char *rrq;
+    int rrq_len;
+    struct tftp_timer timer;
+    enum {
+	PROBE_PENDING,		/* Not sent yet */
+	PROBE_ACTIVE,		/* Waiting for the server */
+	PROBE_FOUND,
+	PROBE_MISSING,
+    } state;
+};
+
+static void tftp_probe_done(struct tftp_probe *pr, int state)
+{
+    core_udp_close(&pr->socket);
+    free(pr->rrq);
+    pr->rrq = NULL;
+    pr->state = state;
+}
+
+static void tftp_probe_send(struct tftp_probe *pr)
+{
+    core_udp_sendto(&pr->socket, pr->rrq, pr->rrq_len,
+		    pr->url->ip, pr->url->port);
+}
+
+static int tftp_probe_start(struct tftp_probe *pr)
+{
+    /* Only ask for the size, so the server has no reason to send data */
+    static const char rrq_tail[] = "octet\0""tsize\0""0";
+    struct url_info *url = pr->url;
+    char *buf;
+
+    pr->rrq = malloc(2 + strlen(url->path) + 1 + sizeof rrq_tail);
+    if (!pr->rrq)
+	return -1;
+
+    if (core_udp_open(&pr->socket)) {
+	free(pr->rrq);
+	pr->rrq = NULL;
+	return -1;
+    }
+
+    buf = pr->rrq;
+    *(uint16_t *)buf = TFTP_RRQ;
+    buf = stpcpy(buf + 2, url->path) + 1;
+    memcpy(buf, rrq_tail, sizeof rrq_tail);
+    pr->rrq_len = buf + sizeof rrq_tail - pr->rrq;
+
+    pr->state = PROBE_ACTIVE;
+    tftp_rtt_init(&pr->socket);
+    tftp_timer_start(&pr->timer);
+    tftp_probe_send(pr);
+    return 0;
+}
+
+static void tftp_probe_poll(struct tftp_probe *pr)
+{
+    static char reply_packet_buf[PKTBUF_SIZE];
+    uint16_t buf_len = sizeof reply_packet_buf;
+    uint16_t src_port;
+    uint32_t src_ip;
+    uint16_t opcode;
+
+    if (core_udp_recv(&pr->socket, reply_packet_buf, &buf_len,
+		      &src_ip, &src_port)) {
+	switch (tftp_timer_check(&pr->socket, &pr->timer)) {
+	case 1:
+	    tftp_probe_send(pr);
+	    break;
+	case -1:
+	    tftp_probe_done(pr, PROBE_MISSING);	/* Server never answered */
+	    break;
+	}
+	return;
+    }
+
+    if (src_ip != pr->url->ip || buf_len < 2)
+	return;
+
+    tftp_timer_done(&pr->socket, &pr->timer);
+
+    opcode = *(uint16_t *)reply_packet_buf;
+    switch (opcode) {
+    case TFTP_ERROR:
+	tftp_probe_done(pr, PROBE_MISSING);
+	break;
+
+    case TFTP_OACK:
+    case TFTP_DATA:
+	/* It exists; tell the server we don't want it after all */
+	core_udp_connect(&pr->socket, src_ip, src_port);
+	tftp_send_error(&pr->socket, 0, "No error, file close");
+	tftp_probe_done(pr, PROBE_FOUND);
+	break;
+
+    default:
+	break;
+    }
+}
+
+/**
+ * Find the first of a list of files which exists on its TFTP server.
+ *
+ * All the files are requested at once, on separate sockets, instead
+ * of paying a round trip (or a full timeout) for each miss in turn.
+ *
+ * @param:url, the files, in order of preference
+ * @param:count, the number of files
+ * @param:window, the maximum number of requests in flight
+ *
+ * @out: the index of the file, -1 if none exists, or -2 if the probe
+ *	 could not be carried out
+ */
+int tftp_probe(struct url_info *url, int count, int window)
+{
+    struct tftp_probe *probes, *pr;
+    int next = 0, active = 0, found = count;
+    int i, rv;
+
+    probes = calloc(count, sizeof *probes);
+    if (!probes)
+	return -2;
+
+    /*
+     * Unescape the paths here, once: a request which can't be started
+     * yet is retried later, and unescaping is not idempotent.
+     */
+    for (i = 0; i < count; i++) {
+	probes[i].url = &url[i];
+	if (url[i].type != URL_OLD_TFTP)
+	    url_unescape(url[i].path, ';');
+	if (!url[i].port)
+	    url[i].port = TFTP_PORT;
+    }
+
+    for (;;) {
+	/* Keep the window full; nothing after a hit can win, though */
+	while (active < window && next < found) {
+	    if (tftp_probe_start(&probes[next])) {
+		if (!active) {
+		    rv = -2;
+		    goto done;
+		}
+		break;
+	    }
+	    active++;
+	    next++;
+	}
+
+	/* We are done when everything ahead of the best hit has missed */
+	for (i = 0; i < count && probes[i].state == PROBE_MISSING; i++)
+	    ;
+	if (i == count) {
+	    rv = -1;
+	    goto done;
+	}
+	if (probes[i].state == PROBE_FOUND) {
+	    rv = i;
+	    goto done;
+	}
+
+	for (i = 0; i < next; i++) {
+	    pr = &probes[i];
+	    if (pr->state != PROBE_ACTIVE)
+		continue;
+
+	    tftp_probe_poll(pr);
+	    if (pr->state != PROBE_ACTIVE) {
+		active--;
+		if (pr->state == PROBE_FOUND && i < found)
+		    found = i;
+	    }
+	}
+    }
+
+done:
+    for (i = 0; i < next; i++) {
+	if (probes[i].state == PROBE_ACTIVE)
+	    tftp_probe_done(&probes[i], PROBE_PENDING);
+    }
+    free(probes);
+
+    dprintf("tftp_probe: %d of %d\n", rv, count);
+    return rv;
+}
+
 /**
  * Send a file to a TFTP  server
  *
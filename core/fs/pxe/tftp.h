@@ -28,6 +28,22 @@
 #define TFTP_BLOCKSIZE_LG2 9
 #define TFTP_BLOCKSIZE  (1 << TFTP_BLOCKSIZE_LG2)
 
+/*
+ * Retransmission timeout bounds, in milliseconds.  Until the first
+ * round trip has been measured, we start where TimeoutTable[] starts;
+ * an exchange is abandoned after about as long as TimeoutTable[] lasts.
+ *
+ * ms_timer() only advances once per timer tick (about 55 ms on BIOS,
+ * 50 ms on EFI), so a measured round trip can be short by up to a
+ * tick, and an RTO of one tick can expire at once.  TFTP_CLOCK_G is
+ * the clock granularity term of RFC 6298, and the minimum is two ticks.
+ */
+#define TFTP_CLOCK_G	 55
+#define TFTP_RTO_INITIAL 110
+#define TFTP_RTO_MIN	 (2*TFTP_CLOCK_G)
+#define TFTP_RTO_MAX	 14000
+#define TFTP_GIVEUP	 131000
+
 /*
  * TFTP operation codes
  */
@@ -61,6 +77,17 @@ struct tftp_error {
         char errmsg[0];
 } __attribute__ (( packed ));
 
+/*
+ * Counters for all TFTP transfers
+ */
+struct tftp_stats {
+    uint32_t exchanges;		/* Request/reply exchanges completed */
+    uint32_t retransmits;	/* Requests and ACKs sent again */
+    uint32_t giveups;		/* Exchanges abandoned */
+};
+
+extern struct tftp_stats tftp_stats;
+
 int tftp_put(struct url_info *url, int flags, struct inode *inode,
 	     const char **redir, char *data, int data_length);
 
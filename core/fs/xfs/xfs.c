@@ -65,6 +65,7 @@ static int xfs_readdir(struct file *file, struct dirent *dirent)
     struct fs_info *fs = file->fs;
     xfs_dinode_t *core;
     struct inode *inode = file->inode;
+    int retval = -1;
 
     xfs_debug("file %p dirent %p");
 
@@ -76,13 +77,17 @@ static int xfs_readdir(struct file *file, struct dirent *dirent)
 
     switch (core->di_format) {
     case XFS_DINODE_FMT_LOCAL:
-	return xfs_fmt_local_readdir(file, dirent, core);
+	retval = xfs_fmt_local_readdir(file, dirent, core);
+	break;
     case XFS_DINODE_FMT_EXTENTS:
     case XFS_DINODE_FMT_BTREE:
-	return xfs_fmt_extents_readdir(file, dirent, core);
+	retval = xfs_fmt_extents_readdir(file, dirent, core);
+	break;
     }
 
-    return -1;
+    xfs_dir2_dirblks_release();
+
+    return retval;
 }
 
 static uint32_t xfs_getfssec(struct file *file, char *buf, int sectors,
@@ -91,21 +96,124 @@ static uint32_t xfs_getfssec(struct file *file, char *buf, int sectors,
     return generic_getfssec(file, buf, sectors, have_more);
 }
 
-static int xfs_next_extent(struct inode *inode, uint32_t lstart)
+/*
+ * Read the whole extent list of a btree-format data fork in one pass over
+ * the bmbt leaves, so that mapping a file offset no longer walks the tree.
+ */
+static int xfs_bmbt_load_extents(struct fs_info *fs, struct inode *inode,
+				 xfs_dinode_t *core)
 {
-    struct fs_info *fs = inode->fs;
-    xfs_dinode_t *core = NULL;
-    xfs_bmbt_irec_t rec;
-    block_t bno;
+    uint32_t nextents = be32_to_cpu(core->di_nextents);
+    xfs_bmbt_irec_t *extents;
     xfs_bmdr_block_t *rblock;
     int fsize;
     xfs_bmbt_ptr_t *pp;
-    xfs_btree_block_t *blk;
-    uint16_t nextents;
-    block_t nextbno;
-    uint32_t index;
+    const xfs_btree_block_t *blk;
+    xfs_bmbt_rec_t *xp;
+    block_t bno;
+    xfs_fsblock_t nextbno;
+    uint16_t numrecs;
+    uint32_t n = 0;
+    uint16_t i;
+
+    xfs_debug("inode %p nextents %lu", inode, nextents);
+
+    extents = malloc(nextents * sizeof(*extents));
+    if (!extents) {
+	malloc_error("xfs_bmbt_irec_t array");
+	return -1;
+    }
+
+    rblock = XFS_DFORK_PTR(core, XFS_DATA_FORK);
+    fsize = XFS_DFORK_SIZE(core, fs, XFS_DATA_FORK);
+    pp = XFS_BMDR_PTR_ADDR(rblock, 1, xfs_bmdr_maxrecs(fsize, 0));
+    bno = fsblock_to_bytes(fs, be64_to_cpu(pp[0])) >> BLOCK_SHIFT(fs);
+
+    /* Find the leftmost leaf */
+    for (;;) {
+	blk = get_cache(fs->fs_dev, bno);
+	if (be16_to_cpu(blk->bb_level) == 0)
+	    break;
+
+	pp = XFS_BMBT_PTR_ADDR(fs, blk, 1,
+			       xfs_bmdr_maxrecs(XFS_INFO(fs)->blocksize, 0));
+	bno = fsblock_to_bytes(fs, be64_to_cpu(pp[0])) >> BLOCK_SHIFT(fs);
+    }
+
+    /* Collect the records of all threaded leaves */
+    for (;;) {
+	nextbno = be64_to_cpu(blk->bb_u.l.bb_rightsib);
+	numrecs = be16_to_cpu(blk->bb_numrecs);
+	xp = XFS_BMBT_REC_ADDR(fs, blk, 1);
+	for (i = 0; i < numrecs && n < nextents; i++)
+	    bmbt_irec_get(&extents[n++], xp + i);
+
+	if (nextbno == NULLFSBLOCK || n == nextents)
+	    break;
+
+	bno = fsblock_to_bytes(fs, nextbno) >> BLOCK_SHIFT(fs);
+	blk = get_cache(fs->fs_dev, bno);
+    }
+
+    XFS_PVT(inode)->i_extents = extents;
+    XFS_PVT(inode)->i_nextents = n;
+
+    return 0;
+}
+
+/*
+ * Find the extent mapping file block @fblk, or the first one past it if
+ * @fblk lies in a hole. Returns false if @fblk is past the last extent.
+ */
+static bool xfs_find_extent(struct inode *inode, xfs_dinode_t *core,
+			    xfs_fileoff_t fblk, xfs_bmbt_irec_t *rec)
+{
+    const xfs_bmbt_rec_t *recs = NULL;
+    const xfs_bmbt_irec_t *extents = NULL;
+    uint32_t lo = 0, hi, mid;
 
-    (void)lstart;
+    if (core->di_format == XFS_DINODE_FMT_EXTENTS) {
+	recs = (xfs_bmbt_rec_t *)XFS_DFORK_PTR(core, XFS_DATA_FORK);
+	hi = be32_to_cpu(core->di_nextents);
+    } else {
+	extents = XFS_PVT(inode)->i_extents;
+	hi = XFS_PVT(inode)->i_nextents;
+    }
+
+    /* First extent ending past fblk */
+    while (lo < hi) {
+	mid = (lo + hi) >> 1;
+	if (recs)
+	    bmbt_irec_get(rec, recs + mid);
+	else
+	    *rec = extents[mid];
+
+	if (rec->br_startoff + rec->br_blockcount <= fblk)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    if (lo == (recs ? be32_to_cpu(core->di_nextents) :
+	       XFS_PVT(inode)->i_nextents))
+	return false;
+
+    if (recs)
+	bmbt_irec_get(rec, recs + lo);
+    else
+	*rec = extents[lo];
+
+    return true;
+}
+
+static int xfs_next_extent(struct inode *inode, uint32_t lstart)
+{
+    struct fs_info *fs = inode->fs;
+    xfs_dinode_t *core = NULL;
+    xfs_bmbt_irec_t rec;
+    const unsigned int blk_sec_shift = BLOCK_SHIFT(fs) - SECTOR_SHIFT(fs);
+    uint32_t rstart;
+    uint32_t delta;
 
     xfs_debug("inode %p lstart %lu", inode, lstart);
 
@@ -115,68 +223,35 @@ static int xfs_next_extent(struct inode *inode, uint32_t lstart)
 	goto out;
     }
 
-    /* The data fork contains the file's data extents */
-    if (XFS_PVT(inode)->i_cur_extent == be32_to_cpu(core->di_nextents))
-        goto out;
+    if (core->di_format == XFS_DINODE_FMT_BTREE) {
+        xfs_debug("XFS_DINODE_FMT_BTREE");
+	if (!XFS_PVT(inode)->i_extents &&
+	    xfs_bmbt_load_extents(fs, inode, core))
+	    goto out;
+    } else if (core->di_format != XFS_DINODE_FMT_EXTENTS) {
+	goto out;
+    }
 
-    if (core->di_format == XFS_DINODE_FMT_EXTENTS) {
-	bmbt_irec_get(&rec, (xfs_bmbt_rec_t *)XFS_DFORK_PTR(core,
-							    XFS_DATA_FORK) +
-						XFS_PVT(inode)->i_cur_extent);
-	XFS_PVT(inode)->i_cur_extent++;
+    if (!xfs_find_extent(inode, core, lstart >> blk_sec_shift, &rec))
+	goto out;
 
-	bno = fsblock_to_bytes(fs, rec.br_startblock) >> BLOCK_SHIFT(fs);
+    rstart = rec.br_startoff << blk_sec_shift;
+    if (lstart < rstart) {
+	/* A hole up to the next extent */
+	inode->next_extent.pstart = EXTENT_ZERO;
+	inode->next_extent.len = rstart - lstart;
+	return 0;
+    }
 
-	XFS_PVT(inode)->i_offset = rec.br_startoff;
+    XFS_PVT(inode)->i_offset = rec.br_startoff;
 
-	inode->next_extent.pstart = bno << BLOCK_SHIFT(fs) >> SECTOR_SHIFT(fs);
-	inode->next_extent.len = ((rec.br_blockcount << BLOCK_SHIFT(fs)) +
-				  SECTOR_SIZE(fs) - 1) >> SECTOR_SHIFT(fs);
-    } else if (core->di_format == XFS_DINODE_FMT_BTREE) {
-        xfs_debug("XFS_DINODE_FMT_BTREE");
-        index = XFS_PVT(inode)->i_cur_extent++;
-        rblock = XFS_DFORK_PTR(core, XFS_DATA_FORK);
-        fsize = XFS_DFORK_SIZE(core, fs, XFS_DATA_FORK);
-        pp = XFS_BMDR_PTR_ADDR(rblock, 1, xfs_bmdr_maxrecs(fsize, 0));
-        bno = fsblock_to_bytes(fs, be64_to_cpu(pp[0])) >> BLOCK_SHIFT(fs);
-
-        /* Find the leaf */
-        for (;;) {
-            blk = (xfs_btree_block_t *)get_cache(fs->fs_dev, bno);
-            if (be16_to_cpu(blk->bb_level) == 0)
-                break;
-
-            pp = XFS_BMBT_PTR_ADDR(fs, blk, 1,
-                    xfs_bmdr_maxrecs(XFS_INFO(fs)->blocksize, 0));
-            bno = fsblock_to_bytes(fs, be64_to_cpu(pp[0])) >> BLOCK_SHIFT(fs);
-        }
-
-        /* Find the right extent among threaded leaves */
-        for (;;) {
-            nextbno = be64_to_cpu(blk->bb_u.l.bb_rightsib);
-            nextents = be16_to_cpu(blk->bb_numrecs);
-            if (nextents - index > 0) {
-                bmbt_irec_get(&rec, XFS_BMDR_REC_ADDR(blk, index + 1));
-
-                bno = fsblock_to_bytes(fs, rec.br_startblock)
-						>> BLOCK_SHIFT(fs);
-
-                XFS_PVT(inode)->i_offset = rec.br_startoff;
-
-                inode->next_extent.pstart = bno << BLOCK_SHIFT(fs)
-                                                >> SECTOR_SHIFT(fs);
-                inode->next_extent.len = ((rec.br_blockcount
-                                            << BLOCK_SHIFT(fs))
-                                            + SECTOR_SIZE(fs) - 1)
-                                            >> SECTOR_SHIFT(fs);
-                break;
-            }
-
-            index -= nextents;
-            bno = fsblock_to_bytes(fs, nextbno) >> BLOCK_SHIFT(fs);
-            blk = (xfs_btree_block_t *)get_cache(fs->fs_dev, bno);
-        }
-    }
+    delta = lstart - rstart;
+    inode->next_extent.len = (rec.br_blockcount << blk_sec_shift) - delta;
+    if (rec.br_state == XFS_EXT_UNWRITTEN)
+	inode->next_extent.pstart = EXTENT_ZERO;
+    else
+	inode->next_extent.pstart = (fsblock_to_bytes(fs, rec.br_startblock) >>
+				     SECTOR_SHIFT(fs)) + delta;
 
     return 0;
 
@@ -184,6 +259,13 @@ out:
     return -1;
 }
 
+/* Drop the extent list when put_inode() releases the inode */
+static void xfs_free_inode(struct inode *inode)
+{
+    free(XFS_PVT(inode)->i_extents);
+    XFS_PVT(inode)->i_extents = NULL;
+}
+
 static inline struct inode *xfs_fmt_local_find_entry(const char *dname,
 						     struct inode *parent,
 						     xfs_dinode_t *core)
@@ -236,6 +318,8 @@ static struct inode *xfs_iget(const char *dname, struct inode *parent)
         inode = xfs_fmt_btree_find_entry(dname, parent, core);
     }
 
+    xfs_dir2_dirblks_release();
+
     if (!inode) {
 	xfs_debug("Entry not found!");
 	goto out;
@@ -294,7 +378,12 @@ static int xfs_readlink(struct inode *inode, char *buf)
 	 * 4 KiB. Thus, one directory block is far enough to hold the maximum
 	 * symbolic link file content, which is only 1024 bytes long.
          */
-	memcpy(buf, dir_buf, pathlen);
+	if (dir_buf)
+	    memcpy(buf, dir_buf, pathlen);
+	else
+	    pathlen = -1;
+
+	xfs_dir2_dirblks_release();
     }
 
 out:
@@ -425,6 +514,7 @@ const struct fs_ops xfs_fs_ops = {
     .getfssec		= xfs_getfssec,
     .open_config	= generic_open_config,
     .close_file         = generic_close_file,
+    .free_inode         = xfs_free_inode,
     .mangle_name	= generic_mangle_name,
     .readdir		= xfs_readdir,
     .iget		= xfs_iget,
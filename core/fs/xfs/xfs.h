@@ -417,6 +417,8 @@ struct xfs_inode {
     uint32_t		i_cur_extent;
     uint32_t		i_btree_offset;
     uint16_t		i_leaf_ent_offset;
+    xfs_bmbt_irec_t	*i_extents;	/* btree-format data extents, in order */
+    uint32_t		i_nextents;
 };
 
 typedef struct { uint8_t i[8]; } __attribute__((__packed__)) xfs_dir2_ino8_t;
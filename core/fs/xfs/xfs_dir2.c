@@ -28,16 +28,34 @@
 
 #include "xfs_dir2.h"
 
-#define XFS_DIR2_DIRBLKS_CACHE_SIZE 128
+/*
+ * Multi-block directory buffers are kept in an LRU which is bounded both in
+ * number of buffers and in total size. A lookup may hold several buffers at
+ * once (node, leaf and data blocks), so every buffer handed out is pinned
+ * until xfs_dir2_dirblks_release() is called, and pinned buffers are never
+ * picked as victims.
+ */
+#define XFS_DIR2_DIRBLKS_CACHE_SIZE	64
+#define XFS_DIR2_DIRBLKS_CACHE_BYTES	(512 << 10)
 
 struct xfs_dir2_dirblks_cache {
+    struct xfs_dir2_dirblks_cache *dc_prev;
+    struct xfs_dir2_dirblks_cache *dc_next;
     block_t        dc_startblock;
     xfs_filblks_t  dc_blkscount;
-    void          *dc_area;
+    size_t         dc_size;
+    bool           dc_pinned;
+    void          *dc_area;	/* NULL if this slot is free */
 };
 
 static struct xfs_dir2_dirblks_cache dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE];
-static unsigned char                 dirblks_cached_count = 0;
+
+/* LRU chain head: dc_next is the least, dc_prev the most recently used */
+static struct xfs_dir2_dirblks_cache dirblks_lru = {
+    .dc_prev = &dirblks_lru,
+    .dc_next = &dirblks_lru,
+};
+static size_t dirblks_cached_bytes;
 
 uint32_t xfs_dir2_da_hashname(const uint8_t *name, int namelen)
 {
@@ -88,88 +106,120 @@ static void *get_dirblks(struct fs_info *fs, block_t startblock,
     return buf;
 }
 
-void *xfs_dir2_dirblks_get_cached(struct fs_info *fs, block_t startblock,
-				  xfs_filblks_t c)
+static inline void dirblks_lru_unlink(struct xfs_dir2_dirblks_cache *dc)
 {
-    unsigned char i;
-    void *buf;
+    dc->dc_prev->dc_next = dc->dc_next;
+    dc->dc_next->dc_prev = dc->dc_prev;
+}
 
-    xfs_debug("fs %p startblock %llu (0x%llx) blkscount %lu", fs, startblock,
-	      startblock, c);
+/* Move to the most recently used end of the LRU chain */
+static inline void dirblks_lru_touch(struct xfs_dir2_dirblks_cache *dc)
+{
+    dc->dc_prev = dirblks_lru.dc_prev;
+    dc->dc_next = &dirblks_lru;
+    dirblks_lru.dc_prev->dc_next = dc;
+    dirblks_lru.dc_prev = dc;
+}
 
-    if (!dirblks_cached_count) {
-	buf = get_dirblks(fs, startblock, c);
-	if (!buf)
-	    return NULL;
+static void dirblks_evict(struct xfs_dir2_dirblks_cache *dc)
+{
+    dirblks_lru_unlink(dc);
+    dirblks_cached_bytes -= dc->dc_size;
+    free(dc->dc_area);
+    memset(dc, 0, sizeof(*dc));
+}
 
-	dirblks_cache[dirblks_cached_count].dc_startblock = startblock;
-	dirblks_cache[dirblks_cached_count].dc_blkscount = c;
-	dirblks_cache[dirblks_cached_count].dc_area = buf;
+/*
+ * Get a free slot able to hold @len more bytes, evicting the least recently
+ * used unpinned buffers as needed. The size budget is only a soft limit: it
+ * is exceeded rather than failing when everything left is pinned.
+ */
+static struct xfs_dir2_dirblks_cache *dirblks_get_slot(size_t len)
+{
+    struct xfs_dir2_dirblks_cache *dc, *next;
+    struct xfs_dir2_dirblks_cache *slot = NULL;
+    int i;
 
-	return dirblks_cache[dirblks_cached_count++].dc_area;
-    } else if (dirblks_cached_count == XFS_DIR2_DIRBLKS_CACHE_SIZE) {
-	for (i = 0; i < XFS_DIR2_DIRBLKS_CACHE_SIZE / 2; i++) {
-	    unsigned char k = XFS_DIR2_DIRBLKS_CACHE_SIZE - (i + 1);
+    for (dc = dirblks_lru.dc_next; dc != &dirblks_lru; dc = next) {
+	next = dc->dc_next;
+	if (dirblks_cached_bytes + len <= XFS_DIR2_DIRBLKS_CACHE_BYTES)
+	    break;
+	if (!dc->dc_pinned)
+	    dirblks_evict(dc);
+    }
 
-	    free(dirblks_cache[i].dc_area);
-	    dirblks_cache[i] = dirblks_cache[k];
-	    memset(&dirblks_cache[k], 0, sizeof(dirblks_cache[k]));
+    for (i = 0; i < XFS_DIR2_DIRBLKS_CACHE_SIZE; i++) {
+	if (!dirblks_cache[i].dc_area) {
+	    slot = &dirblks_cache[i];
+	    break;
 	}
+    }
 
-	buf = get_dirblks(fs, startblock, c);
-	if (!buf)
-	    return NULL;
+    if (!slot) {
+	for (dc = dirblks_lru.dc_next; dc != &dirblks_lru; dc = dc->dc_next) {
+	    if (!dc->dc_pinned) {
+		dirblks_evict(dc);
+		slot = dc;
+		break;
+	    }
+	}
+    }
 
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_startblock =
-	    startblock;
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_blkscount = c;
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_area = buf;
+    return slot;
+}
 
-	dirblks_cached_count = XFS_DIR2_DIRBLKS_CACHE_SIZE / 2;
+void *xfs_dir2_dirblks_get_cached(struct fs_info *fs, block_t startblock,
+				  xfs_filblks_t c)
+{
+    struct xfs_dir2_dirblks_cache *dc;
+    void *buf;
 
-	return dirblks_cache[dirblks_cached_count++].dc_area;
-    } else {
-	block_t block;
-	xfs_filblks_t count;
+    xfs_debug("fs %p startblock %llu (0x%llx) blkscount %lu", fs, startblock,
+	      startblock, c);
 
-	block = dirblks_cache[dirblks_cached_count - 1].dc_startblock;
-	count = dirblks_cache[dirblks_cached_count - 1].dc_blkscount;
+    for (dc = dirblks_lru.dc_prev; dc != &dirblks_lru; dc = dc->dc_prev) {
+	if (dc->dc_startblock == startblock && dc->dc_blkscount == c)
+	    goto found;
+    }
 
-	if (block == startblock && count == c) {
-	    return dirblks_cache[dirblks_cached_count - 1].dc_area;
-	} else {
-	    for (i = 0; i < dirblks_cached_count; i++) {
-		block = dirblks_cache[i].dc_startblock;
-		count = dirblks_cache[i].dc_blkscount;
+    dc = dirblks_get_slot(c * XFS_INFO(fs)->dirblksize);
+    if (!dc) {
+	xfs_error("No room left in the directory block cache");
+	return NULL;
+    }
 
-		if (block == startblock && count == c)
-		    return dirblks_cache[i].dc_area;
-	    }
+    buf = get_dirblks(fs, startblock, c);
+    if (!buf)
+	return NULL;
 
-	    buf = get_dirblks(fs, startblock, c);
-	    if (!buf)
-		return NULL;
+    dc->dc_startblock = startblock;
+    dc->dc_blkscount = c;
+    dc->dc_size = c * XFS_INFO(fs)->dirblksize;
+    dc->dc_area = buf;
+    dirblks_cached_bytes += dc->dc_size;
+    dirblks_lru_touch(dc);
+    dc->dc_pinned = true;
 
-	    dirblks_cache[dirblks_cached_count].dc_startblock = startblock;
-	    dirblks_cache[dirblks_cached_count].dc_blkscount = c;
-	    dirblks_cache[dirblks_cached_count].dc_area = buf;
+    return dc->dc_area;
 
-	    return dirblks_cache[dirblks_cached_count++].dc_area;
-	}
-    }
-    return NULL;
+found:
+    dirblks_lru_unlink(dc);
+    dirblks_lru_touch(dc);
+    dc->dc_pinned = true;
+
+    return dc->dc_area;
 }
 
-void xfs_dir2_dirblks_flush_cache(void)
+/*
+ * Unpin all the buffers handed out by xfs_dir2_dirblks_get_cached(). Must be
+ * called once the caller is done with them; they stay cached.
+ */
+void xfs_dir2_dirblks_release(void)
 {
-    unsigned char i;
-
-    for (i = 0; i < dirblks_cached_count; i++) {
-	free(dirblks_cache[i].dc_area);
-	memset(&dirblks_cache[i], 0, sizeof(dirblks_cache[i]));
-    }
+    struct xfs_dir2_dirblks_cache *dc;
 
-    dirblks_cached_count = 0;
+    for (dc = dirblks_lru.dc_next; dc != &dirblks_lru; dc = dc->dc_next)
+	dc->dc_pinned = false;
 }
 
 struct inode *xfs_dir2_local_find_entry(const char *dname, struct inode *parent,
@@ -25,7 +25,7 @@
 
 void *xfs_dir2_dirblks_get_cached(struct fs_info *fs, block_t startblock,
 				  xfs_filblks_t c);
-void xfs_dir2_dirblks_flush_cache(void);
+void xfs_dir2_dirblks_release(void);
 
 uint32_t xfs_dir2_da_hashname(const uint8_t *name, int namelen);
 
@@ -37,6 +37,13 @@ void reset_idle(void)
 
 __export void __idle(void)
 {
+    /*
+     * Keep serial output moving rather than sleeping on it; but if the
+     * UART took nothing (e.g. stalled on flow control), idle as usual.
+     */
+    if (serial_tx_poll())
+	return;
+
     if (jiffies() - _IdleTimer < TICKS_TO_IDLE)
 	return;
 
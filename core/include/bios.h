@@ -86,6 +86,7 @@ extern void bios_adjust_screen(void);
 /* serirq.c */
 extern char *SerialHead;
 extern char *SerialTail;
+extern void sirq_tx_enable(bool enable);
 
 extern void bios_init(void);
 
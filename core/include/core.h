@@ -53,6 +53,7 @@ extern uint16_t BaudDivisor;
 extern uint8_t FlowOutput;
 extern uint8_t FlowInput;
 extern uint8_t FlowIgnore;
+extern uint8_t SerialTxFifo;
 
 extern uint8_t ScrollAttribute;
 extern uint16_t DisplayCon;
@@ -125,6 +126,9 @@ extern int start_ldlinux(int argc, char **argv);
 extern int create_args_and_load(char *);
 
 extern void write_serial(char data);
+extern void write_serial_buf(const void *buf, size_t count);
+extern unsigned int serial_tx_poll(void);
+extern void serial_flush(void);
 extern void writestr(char *str);
 extern void writechr(char data);
 extern void crlf(void);
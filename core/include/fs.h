@@ -57,6 +57,7 @@ struct fs_ops {
     void     (*searchdir)(const char *, int, struct file *);
     uint32_t (*getfssec)(struct file *, char *, int, bool *);
     void     (*close_file)(struct file *);
+    void     (*free_inode)(struct inode *);	/* Release private data */
     void     (*mangle_name)(char *, const char *);
     size_t   (*realpath)(struct fs_info *, char *, const char *, size_t);
     int      (*chdir)(struct fs_info *, const char *);
@@ -193,6 +194,7 @@ struct path_entry {
 };
 
 extern struct list_head PATH;
+extern unsigned int path_generation;
 
 extern struct path_entry *path_add(const char *str);
 
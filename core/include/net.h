@@ -26,6 +26,12 @@ void core_udp_send(struct pxe_pvt_inode *socket,
 void core_udp_sendto(struct pxe_pvt_inode *socket, const void *data, size_t len,
 		     uint32_t ip, uint16_t port);
 
+/*
+ * How many UDP sockets can be waited on side by side without dropping
+ * packets; 1 if only one socket can usefully be active at a time.
+ */
+extern const int core_udp_concurrency;
+
 void probe_undi(void);
 void pxe_init_isr(void);
 
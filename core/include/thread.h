@@ -14,6 +14,25 @@
 /* This priority should normally be used for hardware-polling threads */
 #define POLL_THREAD_PRIORITY	(INT_MAX-1)
 
+/*
+ * Runnable threads sit on one run queue per priority level, and a
+ * bitmap of the non-empty levels finds the best one at once.  The int
+ * priorities are folded into THREAD_PRIO_LEVELS levels: threads being
+ * killed first, then two priority units per level from -26 to 27
+ * (-2/-1, 0/1, 2/3, ...), with the poll and idle threads last.
+ * Threads on the same level take turns, so two priorities sharing a
+ * level (e.g. 0 and 1) are no longer strictly ordered.
+ */
+#define THREAD_PRIO_LEVELS	32
+
+#define THREAD_LEVEL(p)						\
+    ((p) == INT_MIN ? 0 :					\
+     (p) <= -27 ? 1 :						\
+     (p) == IDLE_THREAD_PRIORITY ? THREAD_PRIO_LEVELS - 1 :	\
+     (p) == POLL_THREAD_PRIORITY ? THREAD_PRIO_LEVELS - 2 :	\
+     (p) > 27 ? THREAD_PRIO_LEVELS - 3 :			\
+     ((p) + 30) >> 1)
+
 struct semaphore;
 
 struct thread_list {
@@ -36,6 +55,7 @@ struct thread_block {
     struct semaphore *semaphore;
     mstime_t block_time;
     mstime_t timeout;
+    int heap_index;		/* In the timeout heap, or -1 */
     bool timed_out;
 };
 
@@ -50,10 +70,35 @@ struct thread {
     void *stack, *rmstack;	/* Stacks, iff allocated by malloc/lmalloc */
     void *pvt; 			/* For the benefit of lwIP */
     int prio;
+    struct thread *rq_next, *rq_prev;	/* Run queue, if queued */
+    bool queued;
+    unsigned long switches;	/* Times this thread was switched to */
+};
+
+struct thread_runqueue {
+    uint32_t bitmap;		/* Non-empty levels */
+    struct thread *head[THREAD_PRIO_LEVELS];
+    struct thread *tail[THREAD_PRIO_LEVELS];
 };
 
+struct sched_stats {
+    unsigned long calls;	/* __schedule() invocations */
+    unsigned long switches;	/* Actual context switches */
+};
+
+extern struct thread_runqueue __runqueue;
+extern struct sched_stats __sched_stats;
+
 extern void (*sched_hook_func)(void);
 
+void __thread_ready(struct thread *);
+void __thread_unready(struct thread *);
+
+int __thread_timeout_reserve(void);
+void __thread_timeout_release(void);
+void __thread_timeout_add(struct thread_block *);
+void __thread_timeout_del(struct thread_block *);
+mstime_t __thread_next_timeout(void);
 void __thread_process_timeouts(void);
 void __schedule(void);
 void __switch_to(struct thread *);
@@ -110,6 +155,8 @@ struct thread *start_thread(const char *name, size_t stack_size, int prio,
 void __exit_thread(void);
 void kill_thread(struct thread *);
 
+int run_threads(void (*func)(void *), void **args, int njobs);
+
 void start_idle_thread(void);
 void test_thread(void);
 
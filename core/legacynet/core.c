@@ -16,6 +16,9 @@ const struct url_scheme url_schemes[] = {
     { NULL, NULL, 0 }
 };
 
+/* PXENV_UDP_READ drops packets for ports other than the one asked for */
+const int core_udp_concurrency = 1;
+
 /**
  * Open a socket
  *
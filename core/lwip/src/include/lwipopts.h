@@ -30,6 +30,7 @@
 #define MEMP_NUM_REASSDATA		32
 #define MEMP_NUM_SYS_TIMEOUT		8
 #define MEMP_NUM_NETCONN		64
+#define MEMP_NUM_UDP_PCB		16
 #define MEMP_NUM_TCPIP_MSG_API		64
 #define MEMP_NUM_TCPIP_MSG_INPKT	64
 #define MEMP_NUM_NETBUF			128
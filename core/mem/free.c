@@ -11,18 +11,23 @@
 
 #include <stdio.h>
 
-static struct free_arena_header *
-__free_block(struct free_arena_header *ah)
+/*
+ * Mark a block free, coalesce it with any free neighbours and put the
+ * result in its bin.
+ */
+struct free_arena_header *__free_block(struct free_arena_header *ah)
 {
     struct free_arena_header *pah, *nah;
-    struct free_arena_header *head =
-	&__core_malloc_head[ARENA_HEAP_GET(ah->a.attrs)];
+
+    ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_FREE);
+    ah->a.tag = MALLOC_FREE;
 
     pah = ah->a.prev;
     nah = ah->a.next;
     if ( ARENA_TYPE_GET(pah->a.attrs) == ARENA_TYPE_FREE &&
            (char *)pah+ARENA_SIZE_GET(pah->a.attrs) == (char *)ah ) {
         /* Coalesce into the previous block */
+        __bin_remove(pah);
         ARENA_SIZE_SET(pah->a.attrs, ARENA_SIZE_GET(pah->a.attrs) +
 		ARENA_SIZE_GET(ah->a.attrs));
         pah->a.next = nah;
@@ -33,28 +38,16 @@ __free_block(struct free_arena_header *ah)
 #endif
 
         ah = pah;
-        pah = ah->a.prev;
-    } else {
-        /* Need to add this block to the free chain */
-        ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_FREE);
-        ah->a.tag = MALLOC_FREE;
-
-        ah->next_free = head->next_free;
-        ah->prev_free = head;
-        head->next_free = ah;
-        ah->next_free->prev_free = ah;
     }
 
-    /* In either of the previous cases, we might be able to merge
-       with the subsequent block... */
+    /* In either case, we might be able to merge with the subsequent block */
     if ( ARENA_TYPE_GET(nah->a.attrs) == ARENA_TYPE_FREE &&
            (char *)ah+ARENA_SIZE_GET(ah->a.attrs) == (char *)nah ) {
+        __bin_remove(nah);
         ARENA_SIZE_SET(ah->a.attrs, ARENA_SIZE_GET(ah->a.attrs) +
 		ARENA_SIZE_GET(nah->a.attrs));
 
-        /* Remove the old block from the chains */
-        nah->next_free->prev_free = nah->prev_free;
-        nah->prev_free->next_free = nah->next_free;
+        /* Remove the old block from the chain */
         ah->a.next = nah->a.next;
         nah->a.next->a.prev = ah;
 
@@ -63,10 +56,51 @@ __free_block(struct free_arena_header *ah)
 #endif
     }
 
+    __bin_insert(ah, false);
+
     /* Return the block that contains the called block */
     return ah;
 }
 
+/*
+ * Merge all runs of adjacent free blocks in a heap, i.e. the small
+ * blocks whose coalescing bios_free() deferred.
+ */
+void __malloc_consolidate(enum heap heap)
+{
+    struct free_arena_header *head = &__core_malloc_head[heap];
+    struct free_arena_header *fp, *nah;
+    bool merged;
+
+    for (fp = head->a.next ; fp != head ; fp = fp->a.next) {
+	if (ARENA_TYPE_GET(fp->a.attrs) != ARENA_TYPE_FREE)
+	    continue;
+
+	merged = false;
+	nah = fp->a.next;
+	while (ARENA_TYPE_GET(nah->a.attrs) == ARENA_TYPE_FREE &&
+	       (char *)fp + ARENA_SIZE_GET(fp->a.attrs) == (char *)nah) {
+	    if (!merged) {
+		__bin_remove(fp);
+		merged = true;
+	    }
+	    __bin_remove(nah);
+	    ARENA_SIZE_SET(fp->a.attrs, ARENA_SIZE_GET(fp->a.attrs) +
+			   ARENA_SIZE_GET(nah->a.attrs));
+	    fp->a.next = nah->a.next;
+	    nah->a.next->a.prev = fp;
+
+#ifdef DEBUG_MALLOC
+	    ARENA_TYPE_SET(nah->a.attrs, ARENA_TYPE_DEAD);
+#endif
+	    nah = fp->a.next;
+	}
+
+	if (merged)
+	    __bin_insert(fp, false);
+    }
+}
+
 void bios_free(void *ptr)
 {
     struct free_arena_header *ah;
@@ -82,6 +116,16 @@ void bios_free(void *ptr)
 	dprintf("invalid arena type: %d\n", ARENA_TYPE_GET(ah->a.attrs));
 #endif
 
+    __mem_uncharge(ah);
+
+    if (ARENA_SIZE_GET(ah->a.attrs) <= MALLOC_SMALL_MAX) {
+	/* Likely to be wanted again soon; don't coalesce */
+	ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_FREE);
+	ah->a.tag = MALLOC_FREE;
+	__bin_insert(ah, false);
+	return;
+    }
+
     __free_block(ah);
 }
 
@@ -163,8 +207,10 @@ static void __free_tagged(malloc_tag_t tag) {
 	head = &__core_malloc_head[i];
 	for (fp = head->a.next ; fp != head ; fp = fp->a.next) {
 	    if (ARENA_TYPE_GET(fp->a.attrs) == ARENA_TYPE_USED &&
-		fp->a.tag == tag)
+		fp->a.tag == tag) {
+		__mem_uncharge(fp);
 		fp = __free_block(fp);
+	    }
 	}
     }
 
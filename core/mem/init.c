@@ -7,6 +7,7 @@
 #include <dprintf.h>
 
 struct free_arena_header __core_malloc_head[NHEAP];
+struct malloc_heap __malloc_heap[NHEAP];
 
 //static __hugebss char main_heap[128 << 10];
 extern char __lowmem_heap[];
@@ -69,22 +70,37 @@ static void mpool_dump(enum heap heap)
 }
 #endif
 
-uint16_t *bios_free_mem;
-void mem_init(void)
+/*
+ * Initialize the head nodes and the (empty) free bins
+ */
+void __init_malloc_heads(void)
 {
-	struct free_arena_header *fp;
-	int i;
-
-	//dprintf("enter");
+	struct free_arena_header *fp, *bp;
+	int i, bin;
 
-	/* Initialize the head nodes */
 	fp = &__core_malloc_head[0];
 	for (i = 0 ; i < NHEAP ; i++) {
 	fp->a.next = fp->a.prev = fp->next_free = fp->prev_free = fp;
 	fp->a.attrs = ARENA_TYPE_HEAD | (i << ARENA_HEAP_POS);
 	fp->a.tag = MALLOC_HEAD;
 	fp++;
+
+	for (bin = 0 ; bin < MALLOC_BINS ; bin++) {
+		bp = __malloc_bin_head(i, bin);
+		bp->next_free = bp->prev_free = bp;
 	}
+	memset(__malloc_heap[i].binmap, 0, sizeof __malloc_heap[i].binmap);
+	}
+}
+
+uint16_t *bios_free_mem;
+void mem_init(void)
+{
+	struct free_arena_header *fp;
+
+	//dprintf("enter");
+
+	__init_malloc_heads();
 	
 	//dprintf("__lowmem_heap = 0x%p bios_free = 0x%p",
 	//	__lowmem_heap, *bios_free_mem);
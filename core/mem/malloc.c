@@ -1,7 +1,8 @@
 /*
  * malloc.c
  *
- * Very simple linked-list based malloc()/free().
+ * Linked-list based malloc()/free(), with size-segregated free bins
+ * (see malloc.h).
  */
 
 #include <syslinux/firmware.h>
@@ -17,75 +18,277 @@
 
 DECLARE_INIT_SEMAPHORE(__malloc_semaphore, 1);
 
+/* Tag for new blocks: the running module, if any */
+malloc_tag_t __mem_tag_global = MALLOC_CORE;
+
+__export malloc_tag_t __mem_get_tag_global(void)
+{
+    return __mem_tag_global;
+}
+
+__export void __mem_set_tag_global(malloc_tag_t tag)
+{
+    __mem_tag_global = tag;
+}
+
+/*
+ * Split the (unbinned) block fp after size bytes; the tail becomes a
+ * new free block, which is returned without being put in a bin.
+ */
+static struct free_arena_header *
+__split_block(struct free_arena_header *fp, size_t size)
+{
+    struct free_arena_header *nfp, *na;
+    size_t fsize = ARENA_SIZE_GET(fp->a.attrs);
+
+    nfp = (struct free_arena_header *)((char *)fp + size);
+    na = fp->a.next;
+
+    ARENA_TYPE_SET(nfp->a.attrs, ARENA_TYPE_FREE);
+    ARENA_HEAP_SET(nfp->a.attrs, ARENA_HEAP_GET(fp->a.attrs));
+    ARENA_SIZE_SET(nfp->a.attrs, fsize-size);
+    nfp->a.tag = MALLOC_FREE;
+#ifdef DEBUG_MALLOC
+    nfp->a.magic = ARENA_MAGIC;
+#endif
+    ARENA_SIZE_SET(fp->a.attrs, size);
+
+    /* Insert into all-block chain */
+    nfp->a.prev = fp;
+    nfp->a.next = na;
+    na->a.prev = nfp;
+    fp->a.next = nfp;
+
+    return nfp;
+}
+
 static void *__malloc_from_block(struct free_arena_header *fp,
 				 size_t size, malloc_tag_t tag)
 {
     size_t fsize;
-    struct free_arena_header *nfp, *na;
-    unsigned int heap = ARENA_HEAP_GET(fp->a.attrs);
 
     fsize = ARENA_SIZE_GET(fp->a.attrs);
+    __bin_remove(fp);
 
     /* We need the 2* to account for the larger requirements of a free block */
     if ( fsize >= size+2*sizeof(struct arena_header) ) {
         /* Bigger block than required -- split block */
-        nfp = (struct free_arena_header *)((char *)fp + size);
-        na = fp->a.next;
+        __bin_insert(__split_block(fp, size), false);
+    }
 
-        ARENA_TYPE_SET(nfp->a.attrs, ARENA_TYPE_FREE);
-	ARENA_HEAP_SET(nfp->a.attrs, heap);
-        ARENA_SIZE_SET(nfp->a.attrs, fsize-size);
-        nfp->a.tag = MALLOC_FREE;
-#ifdef DEBUG_MALLOC
-	nfp->a.magic = ARENA_MAGIC;
-#endif
-        ARENA_TYPE_SET(fp->a.attrs, ARENA_TYPE_USED);
-        ARENA_SIZE_SET(fp->a.attrs, size);
-        fp->a.tag = tag;
-
-        /* Insert into all-block chain */
-        nfp->a.prev = fp;
-        nfp->a.next = na;
-        na->a.prev = nfp;
-        fp->a.next = nfp;
-
-        /* Replace current block on free chain */
-        nfp->next_free = fp->next_free;
-        nfp->prev_free = fp->prev_free;
-        fp->next_free->prev_free = nfp;
-        fp->prev_free->next_free = nfp;
-    } else {
-        /* Allocate the whole block */
-        ARENA_TYPE_SET(fp->a.attrs, ARENA_TYPE_USED);
-        fp->a.tag = tag;
+    ARENA_TYPE_SET(fp->a.attrs, ARENA_TYPE_USED);
+    fp->a.tag = tag;
 
-        /* Remove from free chain */
-        fp->next_free->prev_free = fp->prev_free;
-        fp->prev_free->next_free = fp->next_free;
+    return (void *)(&fp->a + 1);
+}
+
+/*
+ * Carve a slab of blocks of the given (small) size out of fp: the
+ * first one is allocated, the others go to the bin for that size.
+ */
+static void *__malloc_slab(struct free_arena_header *fp,
+			   size_t size, malloc_tag_t tag)
+{
+    struct free_arena_header *op;
+    int n;
+
+    __bin_remove(fp);
+
+    op = fp;
+    fp = __split_block(fp, size);
+    for (n = 1; n < MALLOC_SLAB_OBJS &&
+	     ARENA_SIZE_GET(fp->a.attrs) >= 2*size + 2*sizeof(struct arena_header);
+	 n++) {
+	struct free_arena_header *sp = fp;
+
+	fp = __split_block(sp, size);
+	__bin_insert(sp, true);
     }
+    __bin_insert(fp, false);
 
-    return (void *)(&fp->a + 1);
+    ARENA_TYPE_SET(op->a.attrs, ARENA_TYPE_USED);
+    op->a.tag = tag;
+
+    return (void *)(&op->a + 1);
 }
 
-void *bios_malloc(size_t size, enum heap heap, malloc_tag_t tag)
+/*
+ * Find a free block of at least size bytes in the smallest non-empty
+ * bin which can hold one.  Only the first bin may hold blocks which
+ * are too small, and only the first few of those are looked at unless
+ * nothing else will do.
+ */
+#define MALLOC_FIT_SCAN	8
+
+static struct free_arena_header *
+__find_in_bin(enum heap heap, unsigned int bin, size_t size, int scan)
+{
+    struct free_arena_header *fp, *head = __malloc_bin_head(heap, bin);
+
+    for ( fp = head->next_free ; fp != head && scan-- ; fp = fp->next_free ) {
+	if ( ARENA_SIZE_GET(fp->a.attrs) >= size )
+	    return fp;
+    }
+
+    return NULL;
+}
+
+static struct free_arena_header *__find_block(enum heap heap, size_t size)
 {
+    struct malloc_heap *mh = &__malloc_heap[heap];
     struct free_arena_header *fp;
-    struct free_arena_header *head = &__core_malloc_head[heap];
+    unsigned int first = __malloc_bin_index(size);
+    unsigned int bin = first;
+    uint32_t map;
+
+    if (bin >= MALLOC_SMALL_BINS) {
+	/* Blocks in this bin may be too small */
+	fp = __find_in_bin(heap, bin, size, MALLOC_FIT_SCAN);
+	if (fp)
+	    return fp;
+	bin++;
+    }
+
+    while (bin < MALLOC_BINS) {
+	map = mh->binmap[bin >> 5] & (~0U << (bin & 31));
+	if (!map) {
+	    bin = (bin | 31) + 1;
+	    continue;
+	}
+	bin = (bin & ~31) + __builtin_ctz(map);
+	if (bin >= MALLOC_BINS)
+	    break;
+
+	/* Everything in here is big enough */
+	return __malloc_bin_head(heap, bin)->next_free;
+    }
+
+    /* Nothing bigger; try harder in the first bin */
+    if (first >= MALLOC_SMALL_BINS)
+	return __find_in_bin(heap, first, size, -1);
+
+    return NULL;
+}
+
+static void *__malloc(size_t size, enum heap heap, malloc_tag_t tag)
+{
+    struct free_arena_header *fp;
+    unsigned int bin = __malloc_bin_index(size);
+
+    /* Out of blocks of a small size?  Make a batch of them. */
+    if (heap == HEAP_MAIN && size <= MALLOC_SMALL_MAX &&
+	!(__malloc_heap[heap].binmap[bin >> 5] & (1U << (bin & 31)))) {
+	fp = __find_block(heap, size * MALLOC_SLAB_OBJS);
+	if (fp)
+	    return __malloc_slab(fp, size, tag);
+    }
+
+    fp = __find_block(heap, size);
+    if (fp)
+	return __malloc_from_block(fp, size, tag);
+
+    return NULL;
+}
+
+void *bios_malloc(size_t size, enum heap heap, malloc_tag_t tag)
+{
     void *p = NULL;
 
     if (size) {
 	/* Add the obligatory arena header, and round up */
 	size = (size + 2 * sizeof(struct arena_header) - 1) & ARENA_SIZE_MASK;
 
-	for ( fp = head->next_free ; fp != head ; fp = fp->next_free ) {
-	    if ( ARENA_SIZE_GET(fp->a.attrs) >= size ) {
-		/* Found fit -- allocate out of this block */
-		p = __malloc_from_block(fp, size, tag);
-		break;
-	    }
-        }
+	p = __malloc(size, heap, tag);
+	if (!p) {
+	    /* Merge the small free blocks and try again */
+	    __malloc_consolidate(heap);
+	    p = __malloc(size, heap, tag);
+	}
+
+	if (p)
+	    __mem_charge((struct free_arena_header *)
+			 ((struct arena_header *)p - 1));
+	else
+	    __mem_failed(heap);
+    }
+
+    return p;
+}
+
+static void *__malloc_high(size_t size, size_t align, uintptr_t limit,
+			   malloc_tag_t tag)
+{
+    struct free_arena_header *head = &__core_malloc_head[HEAP_MAIN];
+    struct free_arena_header *fp, *ah;
+    uintptr_t start, end, data, bstart;
+    size_t bsize;
+
+    /* The block chain is in address order */
+    for (fp = head->a.prev; fp != head; fp = fp->a.prev) {
+	if (ARENA_TYPE_GET(fp->a.attrs) != ARENA_TYPE_FREE)
+	    continue;
+
+	start = (uintptr_t)fp;
+	end = start + ARENA_SIZE_GET(fp->a.attrs);
+	if (end > limit)
+	    end = limit;
+	if (end < start + size + sizeof(struct arena_header))
+	    continue;
+
+	data = (end - size) & ~(align - 1);
+	bstart = data - sizeof(struct arena_header);
+	if (bstart < start ||
+	    (bstart > start && bstart - start < 2*ARENA_UNIT))
+	    continue;		/* No room for the free block in front */
+
+	__bin_remove(fp);
+
+	ah = fp;
+	if (bstart > start) {
+	    ah = __split_block(fp, bstart - start);
+	    __bin_insert(fp, false);
+	}
+
+	bsize = (data + size - bstart + ARENA_UNIT - 1) & ARENA_SIZE_MASK;
+	if (ARENA_SIZE_GET(ah->a.attrs) >= bsize + 2*ARENA_UNIT)
+	    __bin_insert(__split_block(ah, bsize), false);
+
+	ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_USED);
+	ah->a.tag = tag;
+	__mem_charge(ah);
+
+	return (void *)(&ah->a + 1);
+    }
+
+    return NULL;
+}
+
+/*
+ * Allocate size bytes in the main heap, as high as possible with the
+ * data ending at or below limit and starting on an align boundary.
+ * This is for buffers which get handed over in place when booting,
+ * like the initramfs, which is put at the top of memory anyway.
+ */
+void *bios_malloc_high(size_t size, size_t align, uintptr_t limit,
+		       malloc_tag_t tag)
+{
+    void *p;
+
+    if (!size || (align & (align - 1)))
+	return NULL;
+    if (align < ARENA_UNIT)
+	align = ARENA_UNIT;
+
+    p = __malloc_high(size, align, limit, tag);
+    if (!p) {
+	/* Merge the small free blocks and try again, as bios_malloc() */
+	__malloc_consolidate(HEAP_MAIN);
+	p = __malloc_high(size, align, limit, tag);
     }
 
+    if (!p)
+	__mem_failed(HEAP_MAIN);
+
     return p;
 }
 
@@ -110,19 +313,32 @@ static void *_malloc(size_t size, enum heap heap, malloc_tag_t tag)
 
 __export void *malloc(size_t size)
 {
-    return _malloc(size, HEAP_MAIN, MALLOC_CORE);
+    return _malloc(size, HEAP_MAIN, __mem_tag_global);
 }
 
 __export void *lmalloc(size_t size)
 {
     void *p;
 
-    p = _malloc(size, HEAP_LOWMEM, MALLOC_CORE);
+    p = _malloc(size, HEAP_LOWMEM, __mem_tag_global);
     if (!p)
 	errno = ENOMEM;
     return p;
 }
 
+__export void *malloc_high(size_t size, size_t align, uintptr_t limit)
+{
+    void *p = NULL;
+
+    if (firmware->mem->malloc_high) {
+	sem_down(&__malloc_semaphore, 0);
+	p = firmware->mem->malloc_high(size, align, limit, __mem_tag_global);
+	sem_up(&__malloc_semaphore);
+    }
+
+    return p;
+}
+
 void *pmapi_lmalloc(size_t size)
 {
     return _malloc(size, HEAP_LOWMEM, MALLOC_MODULE);
@@ -131,7 +347,6 @@ void *pmapi_lmalloc(size_t size)
 void *bios_realloc(void *ptr, size_t size)
 {
     struct free_arena_header *ah, *nah;
-    struct free_arena_header *head;
 
     void *newptr;
     size_t newsize, oldsize, xsize;
@@ -147,8 +362,6 @@ void *bios_realloc(void *ptr, size_t size)
     ah = (struct free_arena_header *)
 	((struct arena_header *)ptr - 1);
 
-	head = &__core_malloc_head[ARENA_HEAP_GET(ah->a.attrs)];
-
 #ifdef DEBUG_MALLOC
     if (ah->a.magic != ARENA_MAGIC)
 	dprintf("failed realloc() magic check: %p\n", ptr);
@@ -175,10 +388,9 @@ void *bios_realloc(void *ptr, size_t size)
 	    //nah->a.type == ARENA_TYPE_FREE &&
 	    //oldsize + nah->a.size >= newsize) {
 	    /* Merge in subsequent free block */
+	    __bin_remove(nah);
 	    ah->a.next = nah->a.next;
 	    ah->a.next->a.prev = ah;
-	    nah->next_free->prev_free = nah->prev_free;
-	    nah->prev_free->next_free = nah->next_free;
 	    ARENA_SIZE_SET(ah->a.attrs, ARENA_SIZE_GET(ah->a.attrs) +
 			   ARENA_SIZE_GET(nah->a.attrs));
 	    xsize = ARENA_SIZE_GET(ah->a.attrs);
@@ -190,6 +402,7 @@ void *bios_realloc(void *ptr, size_t size)
 		/* Residual free block at end */
 		nah = (struct free_arena_header *)((char *)ah + newsize);
 		ARENA_TYPE_SET(nah->a.attrs, ARENA_TYPE_FREE);
+		nah->a.tag = MALLOC_FREE;
 		ARENA_SIZE_SET(nah->a.attrs, xsize - newsize);
 		ARENA_SIZE_SET(ah->a.attrs, newsize);
 		ARENA_HEAP_SET(nah->a.attrs, ARENA_HEAP_GET(ah->a.attrs));
@@ -208,29 +421,22 @@ void *bios_realloc(void *ptr, size_t size)
 		nah->a.next->a.prev = nah;
 		nah->a.prev = ah;
 
-		/* Insert into free list */
-		if (newsize > oldsize) {
-		    /* Hack: this free block is in the path of a memory object
-		       which has already been grown at least once.  As such, put
-		       it at the *end* of the freelist instead of the beginning;
-		       trying to save it for future realloc()s of the same block. */
-		    nah->prev_free = head->prev_free;
-		    nah->next_free = head;
-		    head->prev_free = nah;
-		    nah->prev_free->next_free = nah;
-		} else {
-		    nah->next_free = head->next_free;
-		    nah->prev_free = head;
-		    head->next_free = nah;
-		    nah->next_free->prev_free = nah;
-		}
+		/*
+		 * Insert into free list.  Hack: if this free block is in
+		 * the path of a memory object which has already been grown
+		 * at least once, put it at the *end* of its bin instead of
+		 * the beginning; trying to save it for future realloc()s
+		 * of the same block.
+		 */
+		__bin_insert(nah, newsize > oldsize);
    	    }
 	    /* otherwise, use up the whole block */
+	    __mem_resize(ah, oldsize);
 	    return ptr;
 	} else {
 	    /* Last resort: need to allocate a new block and copy */
 	    oldsize -= sizeof(struct arena_header);
-	    newptr = malloc(size);
+	    newptr = _malloc(size, HEAP_MAIN, ah->a.tag);
 	    if (newptr) {
 		memcpy(newptr, ptr, min(size, oldsize));
 		free(ptr);
@@ -4,8 +4,12 @@
  * Internals for the memory allocator
  */
 
+#ifndef _CORE_MEM_MALLOC_H
+#define _CORE_MEM_MALLOC_H
+
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "core.h"
 #include "thread.h"
 
@@ -94,5 +98,123 @@ struct free_arena_header {
 	((attrs) = ((attrs) & ~ARENA_TYPE_MASK) | \
 	 ((type) & ARENA_TYPE_MASK))
 
+/*
+ * Free blocks are kept in size-segregated bins, one set per heap.  A
+ * small bin holds blocks of exactly one size, so small allocations are
+ * a list pop; a large bin holds a power-of-two range of sizes.  A bitmap
+ * of the non-empty bins finds the smallest usable bin without a walk.
+ */
+#define ARENA_UNIT		sizeof(struct arena_header)
+#define MALLOC_SMALL_BINS	32
+#define MALLOC_SMALL_MAX	((MALLOC_SMALL_BINS + 1) * ARENA_UNIT)
+#define MALLOC_LARGE_BINS	24
+#define MALLOC_LARGE_SHIFT	5	/* ilog2(MALLOC_SMALL_BINS + 2) */
+#define MALLOC_BINS		(MALLOC_SMALL_BINS + MALLOC_LARGE_BINS)
+#define MALLOC_BINMAP_WORDS	((MALLOC_BINS + 31) >> 5)
+
+/*
+ * When a small bin of the main heap runs dry, this many blocks of its
+ * size are carved at once from a single free block (a "slab"), which
+ * keeps objects of the same size together.  Freed small blocks go
+ * straight back to their bin without being coalesced;
+ * __malloc_consolidate() merges them when an allocation would
+ * otherwise fail.
+ */
+#define MALLOC_SLAB_OBJS	16
+
+struct malloc_bin {
+    struct free_arena_header *next_free, *prev_free;
+};
+
+struct malloc_heap {
+    struct malloc_bin bin[MALLOC_BINS];
+    uint32_t binmap[MALLOC_BINMAP_WORDS];
+};
+
 extern struct free_arena_header __core_malloc_head[NHEAP];
+extern struct malloc_heap __malloc_heap[NHEAP];
+
+/*
+ * Heap accounting (stats.c)
+ */
+#define MEM_MAX_OWNERS	32	/* Owners (tags) tracked individually */
+
+extern malloc_tag_t __mem_tag_global;
+
+void __mem_charge(struct free_arena_header *ah);
+void __mem_uncharge(struct free_arena_header *ah);
+void __mem_resize(struct free_arena_header *ah, size_t oldsize);
+void __mem_failed(enum heap heap);
+
+void __init_malloc_heads(void);
 void __inject_free_block(struct free_arena_header *ah);
+struct free_arena_header *__free_block(struct free_arena_header *ah);
+void __malloc_consolidate(enum heap heap);
+
+static inline unsigned int __malloc_bin_index(size_t size)
+{
+    size_t units = size / ARENA_UNIT;
+    unsigned int bin;
+
+    if (units <= MALLOC_SMALL_BINS + 1)
+	return units - 2;
+
+    bin = MALLOC_SMALL_BINS - MALLOC_LARGE_SHIFT +
+	(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(units);
+
+    return bin < MALLOC_BINS ? bin : MALLOC_BINS - 1;
+}
+
+/*
+ * A bin is the free-list links of a fake free_arena_header, so it can
+ * head a free chain like __core_malloc_head[] used to.
+ */
+static inline struct free_arena_header *__malloc_bin_head(enum heap heap,
+							   unsigned int bin)
+{
+    return (struct free_arena_header *)
+	((char *)&__malloc_heap[heap].bin[bin] -
+	 offsetof(struct free_arena_header, next_free));
+}
+
+/*
+ * Put a free block at the front (or back) of the bin for its size.
+ */
+static inline void __bin_insert(struct free_arena_header *ah, bool tail)
+{
+    enum heap heap = ARENA_HEAP_GET(ah->a.attrs);
+    unsigned int bin = __malloc_bin_index(ARENA_SIZE_GET(ah->a.attrs));
+    struct free_arena_header *head = __malloc_bin_head(heap, bin);
+
+    if (tail) {
+	ah->prev_free = head->prev_free;
+	ah->next_free = head;
+	head->prev_free = ah;
+	ah->prev_free->next_free = ah;
+    } else {
+	ah->next_free = head->next_free;
+	ah->prev_free = head;
+	head->next_free = ah;
+	ah->next_free->prev_free = ah;
+    }
+
+    __malloc_heap[heap].binmap[bin >> 5] |= 1U << (bin & 31);
+}
+
+/*
+ * Take a free block off its bin; call before changing its size.
+ */
+static inline void __bin_remove(struct free_arena_header *ah)
+{
+    enum heap heap = ARENA_HEAP_GET(ah->a.attrs);
+    unsigned int bin = __malloc_bin_index(ARENA_SIZE_GET(ah->a.attrs));
+    struct free_arena_header *head = __malloc_bin_head(heap, bin);
+
+    ah->next_free->prev_free = ah->prev_free;
+    ah->prev_free->next_free = ah->next_free;
+
+    if (head->next_free == head)
+	__malloc_heap[heap].binmap[bin >> 5] &= ~(1U << (bin & 31));
+}
+
+#endif /* _CORE_MEM_MALLOC_H */
@@ -0,0 +1,241 @@
+/*
+ * stats.c
+ *
+ * Heap accounting: per heap, and per owner (block tag).  The tag of a
+ * block is one of the fixed MALLOC_* values, or the module which was
+ * running when it was allocated.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <minmax.h>
+#include <sys/module.h>
+#include <syslinux/memstats.h>
+#include "malloc.h"
+
+/*
+ * Owners which don't fit in the table are lumped together, under the
+ * tag of the heap heads since no block ever carries that.
+ */
+#define MALLOC_OTHER	MALLOC_HEAD
+
+struct mem_owner_stats {
+    malloc_tag_t tag;		/* MALLOC_FREE if unused */
+    size_t bytes, blocks, peak;
+};
+
+struct mem_heap_stats {
+    size_t bytes, blocks, peak;
+    unsigned long mallocs, frees, failures;
+};
+
+static struct mem_owner_stats mem_owners[MEM_MAX_OWNERS];
+static struct mem_owner_stats mem_other = { .tag = MALLOC_OTHER };
+static struct mem_heap_stats mem_heaps[NHEAP];
+
+static struct mem_owner_stats *mem_owner(malloc_tag_t tag, bool create)
+{
+    static struct mem_owner_stats *last = &mem_other;
+    struct mem_owner_stats *mo, *slot = NULL;
+
+    if (last->tag == tag)
+	return last;
+
+    for (mo = mem_owners; mo < &mem_owners[MEM_MAX_OWNERS]; mo++) {
+	if (mo->tag == tag)
+	    return last = mo;
+
+	/* Prefer a never used slot, else one which owns nothing now */
+	if (mo->tag == MALLOC_FREE) {
+	    if (!slot || slot->tag != MALLOC_FREE)
+		slot = mo;
+	} else if (!mo->blocks && !slot) {
+	    slot = mo;
+	}
+    }
+
+    if (!create || !slot)
+	return &mem_other;
+
+    memset(slot, 0, sizeof *slot);
+    slot->tag = tag;
+    return last = slot;
+}
+
+/*
+ * Account for a block which has just been allocated (or resized)
+ */
+void __mem_charge(struct free_arena_header *ah)
+{
+    struct mem_heap_stats *hs = &mem_heaps[ARENA_HEAP_GET(ah->a.attrs)];
+    struct mem_owner_stats *mo = mem_owner(ah->a.tag, true);
+    size_t size = ARENA_SIZE_GET(ah->a.attrs);
+
+    hs->bytes += size;
+    hs->blocks++;
+    hs->mallocs++;
+    if (hs->bytes > hs->peak)
+	hs->peak = hs->bytes;
+
+    mo->bytes += size;
+    mo->blocks++;
+    if (mo->bytes > mo->peak)
+	mo->peak = mo->bytes;
+}
+
+/*
+ * Account for a block which is about to be freed (or resized)
+ */
+void __mem_uncharge(struct free_arena_header *ah)
+{
+    struct mem_heap_stats *hs = &mem_heaps[ARENA_HEAP_GET(ah->a.attrs)];
+    struct mem_owner_stats *mo = mem_owner(ah->a.tag, false);
+    size_t size = ARENA_SIZE_GET(ah->a.attrs);
+
+    hs->bytes -= size;
+    hs->blocks--;
+    hs->frees++;
+
+    /* Blocks may have been charged to "other" before the owner got a slot */
+    mo->bytes -= min(mo->bytes, size);
+    if (mo->blocks)
+	mo->blocks--;
+}
+
+/*
+ * Account for a block which was resized in place
+ */
+void __mem_resize(struct free_arena_header *ah, size_t oldsize)
+{
+    struct mem_heap_stats *hs = &mem_heaps[ARENA_HEAP_GET(ah->a.attrs)];
+    struct mem_owner_stats *mo = mem_owner(ah->a.tag, false);
+    size_t size = ARENA_SIZE_GET(ah->a.attrs);
+
+    hs->bytes += size - oldsize;
+    if (hs->bytes > hs->peak)
+	hs->peak = hs->bytes;
+
+    if (size < oldsize) {
+	mo->bytes -= min(mo->bytes, oldsize - size);
+    } else {
+	mo->bytes += size - oldsize;
+	if (mo->bytes > mo->peak)
+	    mo->peak = mo->bytes;
+    }
+}
+
+void __mem_failed(enum heap heap)
+{
+    mem_heaps[heap].failures++;
+}
+
+__export int syslinux_heap_stats(enum syslinux_heap which,
+				 struct syslinux_heap_stats *stats)
+{
+    enum heap heap = (enum heap)which;
+    struct mem_heap_stats *hs;
+    struct free_arena_header *head, *fp;
+    size_t size;
+    int bin;
+
+    if ((unsigned int)heap >= NHEAP)
+	return -1;
+
+    memset(stats, 0, sizeof *stats);
+
+    sem_down(&__malloc_semaphore, 0);
+
+    hs = &mem_heaps[heap];
+    stats->used_bytes  = hs->bytes;
+    stats->used_blocks = hs->blocks;
+    stats->peak_bytes  = hs->peak;
+    stats->mallocs     = hs->mallocs;
+    stats->frees       = hs->frees;
+    stats->failures    = hs->failures;
+
+    for (bin = 0; bin < MALLOC_BINS; bin++) {
+	head = __malloc_bin_head(heap, bin);
+	for (fp = head->next_free; fp != head; fp = fp->next_free) {
+	    size = ARENA_SIZE_GET(fp->a.attrs);
+	    stats->free_bytes += size;
+	    stats->free_blocks++;
+	    if (size > stats->largest_free)
+		stats->largest_free = size;
+	}
+    }
+
+    sem_up(&__malloc_semaphore);
+
+    /* What the largest block can hold */
+    if (stats->largest_free)
+	stats->largest_free -= sizeof(struct arena_header);
+
+    return 0;
+}
+
+static const char *mem_owner_name(malloc_tag_t tag)
+{
+    struct elf_module *m;
+
+    switch (tag) {
+    case MALLOC_CORE:
+	return "core";
+    case MALLOC_MODULE:
+	return "comboot";
+    case MALLOC_OTHER:
+	return "other";
+    }
+
+    for_each_module(m) {
+	if ((malloc_tag_t)m == tag)
+	    return m->name;
+    }
+
+    return "(unloaded)";
+}
+
+/*
+ * Insert an owner into the array, sorted on bytes, dropping the
+ * smallest if it's full.  Returns the new number of entries.
+ */
+static int mem_owner_add(struct syslinux_mem_owner *owners, int max, int n,
+			 const struct mem_owner_stats *mo)
+{
+    int i;
+
+    if (mo->tag == MALLOC_FREE || !mo->peak)
+	return n;
+
+    for (i = n; i > 0 && owners[i-1].bytes < mo->bytes; i--) {
+	if (i < max)
+	    owners[i] = owners[i-1];
+    }
+    if (i >= max)
+	return n;
+
+    owners[i].tag    = mo->tag;
+    owners[i].name   = mem_owner_name(mo->tag);
+    owners[i].bytes  = mo->bytes;
+    owners[i].blocks = mo->blocks;
+    owners[i].peak   = mo->peak;
+
+    return n < max ? n + 1 : n;
+}
+
+/*
+ * Fill in up to max owners, biggest first.  Returns how many.
+ */
+__export int syslinux_mem_owners(struct syslinux_mem_owner *owners, int max)
+{
+    struct mem_owner_stats *mo;
+    int n = 0;
+
+    sem_down(&__malloc_semaphore, 0);
+
+    for (mo = mem_owners; mo < &mem_owners[MEM_MAX_OWNERS]; mo++)
+	n = mem_owner_add(owners, max, n, mo);
+    n = mem_owner_add(owners, max, n, &mem_other);
+
+    sem_up(&__malloc_semaphore);
+    return n;
+}
@@ -0,0 +1,428 @@
+#include "unittest/unittest.h"
+#include "unittest/memmap.h"
+
+#include <string.h>
+#include <time.h>
+#include <com32.h>
+
+/*
+ * Replay an allocation trace against the core allocator, checking the
+ * heap after every operation batch and reporting the speed and the
+ * fragmentation left behind.
+ *
+ * With no argument, a synthetic trace modelled on a boot session is
+ * replayed: lots of short strings and small structures (config parser,
+ * refstrings), network buffers, file buffers and the odd module image.
+ * Otherwise the argument names a trace file of lines
+ *
+ *	m <slot> <size>		malloc
+ *	l <slot> <size>		lmalloc
+ *	r <slot> <size>		realloc
+ *	f <slot>		free
+ */
+
+/* Keep the allocator under test out of the way of the host's */
+#define malloc	core_malloc
+#define free	core_free
+#define realloc	core_realloc
+#define zalloc	core_zalloc
+#define lmalloc	core_lmalloc
+
+void *malloc(size_t);
+void free(void *);
+
+struct semaphore {
+    int count;
+};
+
+#define DECLARE_INIT_SEMAPHORE(name, cnt)	\
+	struct semaphore name = { cnt }
+
+static inline int sem_down(struct semaphore *sem, int timeout)
+{
+    (void)timeout;
+    return --sem->count;
+}
+
+static inline void sem_up(struct semaphore *sem)
+{
+    sem->count++;
+}
+
+/*
+ * Fake data objects.
+ *
+ * These are the dependencies required by init.c.
+ */
+struct com32_sys_args __com32;
+char __lowmem_heap[32];
+char free_high_memory[32];
+
+#include "../init.c"
+#include "../malloc.c"
+#include "../free.c"
+#include "../stats.c"
+
+LIST_HEAD(modules_head);
+
+int syslinux_scan_memory(scan_memory_callback_t callback, void *data)
+{
+    return 0;
+}
+
+static struct mem_ops bench_mem_ops = {
+    .malloc = bios_malloc,
+    .realloc = bios_realloc,
+    .free = bios_free,
+};
+
+static struct firmware bench_firmware = {
+    .mem = &bench_mem_ops,
+};
+
+struct firmware *firmware = &bench_firmware;
+
+#define MAIN_HEAP_SIZE	(32 << 20)
+#define LOW_HEAP_SIZE	(256 << 10)
+#define NSLOTS		4096
+#define NOPS		400000
+
+static char main_heap[MAIN_HEAP_SIZE] __attribute__((aligned(64)));
+static char low_heap[LOW_HEAP_SIZE] __attribute__((aligned(64)));
+
+static struct slot {
+    unsigned char *p;
+    size_t size;
+} slots[NSLOTS];
+
+static unsigned long nfailed;
+
+static void add_heap(char *mem, size_t len, enum heap heap)
+{
+    struct free_arena_header *fp = (struct free_arena_header *)mem;
+
+    fp->a.attrs = ARENA_TYPE_USED | (heap << ARENA_HEAP_POS);
+    ARENA_SIZE_SET(fp->a.attrs, len);
+    __inject_free_block(fp);
+}
+
+/* Only the start of each block is stamped, to keep the replay fast */
+#define STAMP_SIZE	64
+
+static size_t slot_stamp(int n)
+{
+    return slots[n].size < STAMP_SIZE ? slots[n].size : STAMP_SIZE;
+}
+
+static void slot_fill(int n)
+{
+    memset(slots[n].p, n & 0xff, slot_stamp(n));
+}
+
+static int slot_check(int n)
+{
+    size_t i;
+
+    for (i = 0; i < slot_stamp(n); i++) {
+	if (slots[n].p[i] != (n & 0xff))
+	    return -1;
+    }
+
+    return 0;
+}
+
+static void do_free(int n)
+{
+    if (!slots[n].p)
+	return;
+
+    syslinux_assert_str(!slot_check(n), "Slot %d corrupted", n);
+    free(slots[n].p);
+    slots[n].p = NULL;
+}
+
+static void do_malloc(int n, size_t size, bool low)
+{
+    do_free(n);
+
+    slots[n].p = low ? lmalloc(size) : malloc(size);
+    slots[n].size = slots[n].p ? size : 0;
+    if (!slots[n].p)
+	nfailed++;
+    else
+	slot_fill(n);
+}
+
+static void do_realloc(int n, size_t size)
+{
+    unsigned char *p;
+    size_t i, keep;
+
+    if (!slots[n].p) {
+	do_malloc(n, size, false);
+	return;
+    }
+
+    keep = slot_stamp(n) < size ? slot_stamp(n) : size;
+    p = realloc(slots[n].p, size);
+    if (!p) {
+	nfailed++;
+	return;
+    }
+
+    for (i = 0; i < keep; i++)
+	syslinux_assert_str(p[i] == (n & 0xff), "realloc lost slot %d", n);
+
+    slots[n].p = p;
+    slots[n].size = size;
+    slot_fill(n);
+}
+
+/*
+ * Walk a heap and make sure the block chain, the bins and the
+ * accounting agree.  Returns the largest free block.
+ */
+static size_t check_heap(enum heap heap, size_t *total_free)
+{
+    struct free_arena_header *head = &__core_malloc_head[heap];
+    struct free_arena_header *fp, *bp;
+    struct syslinux_heap_stats hs;
+    size_t nfree = 0, nbinned = 0, largest = 0;
+    size_t used_bytes = 0, used_blocks = 0;
+    int bin;
+    bool used;
+
+    *total_free = 0;
+    for (fp = head->a.next; fp != head; fp = fp->a.next) {
+	syslinux_assert_str(fp->a.next->a.prev == fp, "Broken block chain");
+	syslinux_assert_str(fp->a.next == head ||
+			    (char *)fp + ARENA_SIZE_GET(fp->a.attrs) <=
+			    (char *)fp->a.next, "Overlapping blocks");
+
+	if (ARENA_TYPE_GET(fp->a.attrs) == ARENA_TYPE_FREE) {
+	    nfree++;
+	    *total_free += ARENA_SIZE_GET(fp->a.attrs);
+	    if (ARENA_SIZE_GET(fp->a.attrs) > largest)
+		largest = ARENA_SIZE_GET(fp->a.attrs);
+	} else {
+	    used_blocks++;
+	    used_bytes += ARENA_SIZE_GET(fp->a.attrs);
+	}
+    }
+
+    for (bin = 0; bin < MALLOC_BINS; bin++) {
+	bp = __malloc_bin_head(heap, bin);
+	used = bp->next_free != bp;
+	syslinux_assert_str(used ==
+			    !!(__malloc_heap[heap].binmap[bin >> 5] &
+			       (1U << (bin & 31))), "Stale bin bitmap");
+
+	for (fp = bp->next_free; fp != bp; fp = fp->next_free) {
+	    syslinux_assert_str(fp->next_free->prev_free == fp,
+				"Broken free list");
+	    syslinux_assert_str(__malloc_bin_index(ARENA_SIZE_GET(fp->a.attrs))
+				== bin, "Block in the wrong bin");
+	    syslinux_assert_str(ARENA_TYPE_GET(fp->a.attrs) == ARENA_TYPE_FREE,
+				"Allocated block in a bin");
+	    nbinned++;
+	}
+    }
+
+    syslinux_assert_str(nfree == nbinned, "%zu free blocks but %zu binned",
+			nfree, nbinned);
+
+    syslinux_heap_stats((enum syslinux_heap)heap, &hs);
+    syslinux_assert_str(hs.used_bytes == used_bytes &&
+			hs.used_blocks == used_blocks &&
+			hs.free_bytes == *total_free && hs.free_blocks == nfree,
+			"Heap %d accounting is off", heap);
+
+    return largest;
+}
+
+static unsigned long rand_state = 1;
+
+static unsigned long rnd(unsigned long n)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return ((rand_state >> 8) & 0xffffff) % n;
+}
+
+/*
+ * Pick a size the way a boot session would
+ */
+static size_t rnd_size(void)
+{
+    unsigned long r = rnd(1000);
+
+    if (r < 600)
+	return 4 + rnd(60);		/* Strings, refstrings */
+    if (r < 850)
+	return 64 + rnd(448);		/* Menu entries, small structures */
+    if (r < 950)
+	return 1514 + rnd(600);		/* Network buffers */
+    if (r < 995)
+	return 4096 + rnd(60 << 10);	/* File buffers */
+
+    return (64 << 10) + rnd(448 << 10);	/* Module images */
+}
+
+/* Modules the synthetic allocations are made on behalf of */
+static struct elf_module modules[4] = {
+    { .name = "ldlinux.c32" },
+    { .name = "libcom32.c32" },
+    { .name = "menu.c32" },
+    { .name = "pxechn.c32" },
+};
+
+static unsigned long synthetic_trace(void)
+{
+    unsigned long op;
+    unsigned long r;
+    int n;
+
+    for (n = 0; n < 4; n++)
+	list_add_tail(&modules[n].list, &modules_head);
+
+    for (op = 0; op < NOPS; op++) {
+	r = rnd(100);
+	n = rnd(NSLOTS);
+
+	if (!(op & 0xff))
+	    __mem_set_tag_global((malloc_tag_t)&modules[rnd(4)]);
+
+	if (r < 55)
+	    do_malloc(n, rnd_size(), false);
+	else if (r < 56)
+	    do_malloc(n, 2048 + rnd(2048), true);
+	else if (r < 61)
+	    do_realloc(n, slots[n].size + rnd(256));
+	else
+	    do_free(n);
+
+	if (!(op & 0xffff)) {
+	    size_t dummy;
+
+	    check_heap(HEAP_MAIN, &dummy);
+	    check_heap(HEAP_LOWMEM, &dummy);
+	}
+    }
+
+    return op;
+}
+
+static unsigned long file_trace(const char *path)
+{
+    FILE *f;
+    char cmd;
+    int n;
+    size_t size;
+    unsigned long op = 0;
+    char line[128];
+
+    f = fopen(path, "r");
+    if (!f) {
+	perror(path);
+	exit(1);
+    }
+
+    while (fgets(line, sizeof line, f)) {
+	size = 0;
+	if (sscanf(line, " %c %d %zu", &cmd, &n, &size) < 2 ||
+	    n < 0 || n >= NSLOTS)
+	    continue;
+
+	switch (cmd) {
+	case 'm':
+	    do_malloc(n, size, false);
+	    break;
+	case 'l':
+	    do_malloc(n, size, true);
+	    break;
+	case 'r':
+	    do_realloc(n, size);
+	    break;
+	case 'f':
+	    do_free(n);
+	    break;
+	default:
+	    continue;
+	}
+	op++;
+    }
+
+    fclose(f);
+    return op;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    struct syslinux_mem_owner owners[8];
+    struct syslinux_heap_stats hs;
+    unsigned long ops;
+    size_t total_free, largest, owned;
+    double secs;
+    int n, nowners;
+
+    __init_malloc_heads();
+    add_heap(main_heap, sizeof main_heap, HEAP_MAIN);
+    add_heap(low_heap, sizeof low_heap, HEAP_LOWMEM);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ops = argc > 1 ? file_trace(argv[1]) : synthetic_trace();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    check_heap(HEAP_MAIN, &total_free);
+    __malloc_consolidate(HEAP_MAIN);
+    largest = check_heap(HEAP_MAIN, &total_free);
+
+    printf("\t%lu ops, %.0f ns/op, %lu failed; %zu bytes free, "
+	   "largest block %zu (%.1f%% fragmented)\n",
+	   ops, secs * 1e9 / (ops ? ops : 1), nfailed, total_free, largest,
+	   total_free ? 100.0 * (total_free - largest) / total_free : 0.0);
+
+    /* Every allocated byte belongs to somebody */
+    nowners = syslinux_mem_owners(owners, 8);
+    for (owned = 0, n = 0; n < nowners; n++) {
+	printf("\t  %-16s %9zu bytes in %6zu blocks, peak %9zu\n",
+	       owners[n].name, owners[n].bytes, owners[n].blocks,
+	       owners[n].peak);
+	owned += owners[n].bytes;
+    }
+
+    syslinux_heap_stats(SYSLINUX_HEAP_MAIN, &hs);
+    owned -= hs.used_bytes;
+    syslinux_heap_stats(SYSLINUX_HEAP_LOWMEM, &hs);
+    syslinux_assert_str(owned == hs.used_bytes, "Owners don't add up");
+
+    /* A top-of-memory buffer, as used for the initramfs */
+    {
+	uintptr_t limit = (uintptr_t)main_heap + MAIN_HEAP_SIZE - 12345;
+	char *hp = bios_malloc_high(1 << 20, 4096, limit, MALLOC_CORE);
+	size_t dummy;
+
+	syslinux_assert_str(hp, "No high block");
+	syslinux_assert_str(!((uintptr_t)hp & 4095) &&
+			    (uintptr_t)hp + (1 << 20) <= limit &&
+			    (uintptr_t)hp + (1 << 20) + 4096 > limit,
+			    "High block at the wrong place: %p", hp);
+	check_heap(HEAP_MAIN, &dummy);
+	free(hp);
+    }
+
+    /* Everything must merge back into the original blocks */
+    for (n = 0; n < NSLOTS; n++)
+	do_free(n);
+    __malloc_consolidate(HEAP_MAIN);
+    __malloc_consolidate(HEAP_LOWMEM);
+
+    syslinux_assert_str(check_heap(HEAP_MAIN, &total_free) ==
+			sizeof main_heap, "Main heap didn't merge back");
+    syslinux_assert_str(check_heap(HEAP_LOWMEM, &total_free) ==
+			sizeof low_heap, "Low heap didn't merge back");
+
+    return 0;
+}
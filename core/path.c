@@ -17,6 +17,9 @@
 
 __export LIST_HEAD(PATH);
 
+/* Changes whenever PATH lookups may resolve differently */
+__export unsigned int path_generation;
+
 __export struct path_entry *path_add(const char *str)
 {
     struct path_entry *entry;
@@ -33,6 +36,7 @@ __export struct path_entry *path_add(const char *str)
 	goto bail;
 
     list_add(&entry->list, &PATH);
+    path_generation++;
 
     return entry;
 
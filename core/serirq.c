@@ -26,6 +26,7 @@
 static char serial_buf[serial_buf_size];
 
 static unsigned short SerialIRQPort; /* Serial port w IRQ service */
+static bool SerialTxIRQ;	     /* Transmit interrupt enabled */
 char *SerialHead = serial_buf;    /* Head of serial port rx buffer */
 char *SerialTail = serial_buf;    /* Tail of serial port rx buffer */
 
@@ -65,6 +66,9 @@ static void irq_common(unsigned short old_irq)
 		}
 	}
 
+	/* Transmitter empty; send more, if we have it */
+	serial_tx_poll();
+
 	/* Chain to next handler */
 	next();
 }
@@ -123,6 +127,20 @@ static inline void install_irq_vectors(uint32_t *dst, int first)
 	}
 }
 
+/*
+ * Ask for an interrupt when the transmitter empties only while there is
+ * output queued, else it would keep firing.
+ */
+void sirq_tx_enable(bool enable)
+{
+	if (!SerialIRQPort || enable == SerialTxIRQ)
+		return;
+
+	/* Receive interrupt, plus THRE if requested */
+	outb(enable ? 0x3 : 0x1, SerialIRQPort + 1);
+	SerialTxIRQ = enable;
+}
+
 __export void sirq_install(void)
 {
 	char val, val2;
@@ -144,6 +162,7 @@ __export void sirq_install(void)
 	/* Enable receive interrupt */
 	outb(0x1, SerialIRQPort + 1);
 	io_delay();
+	SerialTxIRQ = false;
 
 	/*
 	 * Enable all the interrupt lines at the PIC. Some BIOSes only
@@ -179,6 +198,7 @@ __export void sirq_cleanup_nowipe(void)
 	/* Clear IER */
 	outb(0x0, SerialIRQPort + 1);
 	io_delay();
+	SerialTxIRQ = false;
 
 	/* Restore PIC masks */
 	outb(IRQMask[0], 0x21);
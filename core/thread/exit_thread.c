@@ -10,9 +10,11 @@ __noreturn __exit_thread(void)
 
     cli();
 
-    /* Remove from the linked list */
+    /* Remove from the linked list and the run queue */
     curr->list.prev->next = curr->list.next;
     curr->list.next->prev = curr->list.prev;
+    __thread_unready(curr);
+    __thread_timeout_release();
 
     /* Free allocated stacks (note: free(NULL) is permitted and safe). */
     free(curr->stack);
@@ -20,8 +22,7 @@ __noreturn __exit_thread(void)
 
     /*
      * Note: __schedule() can explictly handle the case where
-     * curr isn't part of the linked list anymore, as long as
-     * curr->list.next is still valid.
+     * curr isn't on the run queue anymore.
      */
     __schedule();
 
@@ -10,13 +10,22 @@ void (*idle_thread_hook)(void) = default_idle_thread_hook;
 
 static void idle_thread_func(void *dummy)
 {
+    mstime_t next;
+
     (void)dummy;
 
     for (;;) {
 	cli();
 	idle_thread_hook();
+	__thread_process_timeouts();
 	__schedule();
-	asm volatile("sti ; hlt" : : : "memory");
+
+	/* Don't sleep through a deadline which has already come due */
+	next = __thread_next_timeout();
+	if (next && (mstimediff_t)(next - ms_timer()) <= 0)
+	    sti();
+	else
+	    asm volatile("sti ; hlt" : : : "memory");
     }
 }
 
@@ -19,6 +19,7 @@ void kill_thread(struct thread *thread)
      * we end up going to __exit_thread.
      */
     thread->esp->eip = __exit_thread;
+    __thread_unready(thread);
     thread->prio = INT_MIN;
 
     block = thread->blocked;
@@ -28,10 +29,12 @@ void kill_thread(struct thread *thread)
 	block->list.next->prev = block->list.prev;
 	block->list.prev->next = block->list.next;
 	sem->count++;
+	__thread_timeout_del(block);
 
 	thread->blocked = NULL;
 	block->timed_out = true; /* Fake an immediate timeout */
     }
+    __thread_ready(thread);
 
     __schedule();
 
@@ -6,6 +6,14 @@ struct thread __root_thread = {
     .list = { .next = &__root_thread.list, .prev = &__root_thread.list },
     .blocked = NULL,
     .prio = 0,
+    .queued = true,
 };
 
 struct thread *__current = &__root_thread;
+
+/* Initially, the root thread is the only runnable one */
+struct thread_runqueue __runqueue = {
+    .bitmap = 1U << THREAD_LEVEL(0),
+    .head = { [THREAD_LEVEL(0)] = &__root_thread },
+    .tail = { [THREAD_LEVEL(0)] = &__root_thread },
+};
@@ -0,0 +1,57 @@
+/*
+ * run_threads.c
+ *
+ * Run a batch of jobs concurrently and wait for all of them, on behalf
+ * of modules (see firmware->run_threads).  Jobs only overlap where they
+ * block, i.e. on the network; anything else simply runs in turn.
+ */
+
+#include <stdlib.h>
+#include "thread.h"
+#include "core.h"
+
+#define RUN_THREADS_STACK	16384
+
+struct run_job {
+    void (*func)(void *);
+    void *arg;
+    struct semaphore *done;
+};
+
+static void run_job_func(void *data)
+{
+    struct run_job *job = data;
+
+    job->func(job->arg);
+    sem_up(job->done);
+}
+
+int run_threads(void (*func)(void *), void **args, int njobs)
+{
+    struct semaphore done;
+    struct run_job *jobs;
+    int i, started = 0;
+
+    jobs = malloc(njobs * sizeof *jobs);
+    if (!jobs)
+	return -1;
+
+    sem_init(&done, 0);
+
+    for (i = 0; i < njobs; i++) {
+	jobs[i].func = func;
+	jobs[i].arg  = args[i];
+	jobs[i].done = &done;
+
+	if (start_thread("job", RUN_THREADS_STACK, 0, run_job_func, &jobs[i]))
+	    started++;
+	else
+	    func(args[i]);	/* Out of memory for a thread, do it here */
+    }
+
+    while (started--)
+	sem_down(&done, 0);
+
+    free(jobs);
+    return 0;
+}
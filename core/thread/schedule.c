@@ -10,6 +10,59 @@
 
 void (*sched_hook_func)(void);
 
+struct sched_stats __sched_stats;
+
+/*
+ * Put a runnable thread at the end of the run queue for its priority.
+ * Call with interrupts locked out.
+ */
+void __thread_ready(struct thread *t)
+{
+    struct thread_runqueue *rq = &__runqueue;
+    unsigned int level = THREAD_LEVEL(t->prio);
+
+    if (t->queued)
+	return;
+
+    t->rq_next = NULL;
+    t->rq_prev = rq->tail[level];
+    if (t->rq_prev)
+	t->rq_prev->rq_next = t;
+    else
+	rq->head[level] = t;
+    rq->tail[level] = t;
+
+    rq->bitmap |= 1U << level;
+    t->queued = true;
+}
+
+/*
+ * Take a thread which blocks or dies off its run queue.  Call with
+ * interrupts locked out, and before changing its priority.
+ */
+void __thread_unready(struct thread *t)
+{
+    struct thread_runqueue *rq = &__runqueue;
+    unsigned int level = THREAD_LEVEL(t->prio);
+
+    if (!t->queued)
+	return;
+
+    if (t->rq_prev)
+	t->rq_prev->rq_next = t->rq_next;
+    else
+	rq->head[level] = t->rq_next;
+
+    if (t->rq_next)
+	t->rq_next->rq_prev = t->rq_prev;
+    else
+	rq->tail[level] = t->rq_prev;
+
+    if (!rq->head[level])
+	rq->bitmap &= ~(1U << level);
+    t->queued = false;
+}
+
 /*
  * __schedule() should only be called with interrupts locked out!
  */
@@ -17,7 +70,7 @@ void __schedule(void)
 {
     static bool in_sched_hook;
     struct thread *curr = current();
-    struct thread *st, *nt, *best;
+    struct thread *best;
 
 #if DEBUG
     if (__unlikely(irq_state() & 0x200)) {
@@ -34,6 +87,7 @@ void __schedule(void)
 	return;
 
     dprintf("Schedule ");
+    __sched_stats.calls++;
 
     /* Possibly update the information on which we make
      * scheduling decisions.
@@ -45,39 +99,35 @@ void __schedule(void)
     }
 
     /*
-     * The unusual form of this walk is because we have to start with
-     * the thread *following* curr, and curr may not actually be part
-     * of the list anymore (in the case of __exit_thread).
+     * If we are still runnable, go to the back of our queue, so that
+     * threads of the same priority take turns.  curr may not be on
+     * any queue (blocked, or in the case of __exit_thread, dead).
      */
-    best = NULL;
-    nt = st = container_of(curr->list.next, struct thread, list);
-    do {
-	if (__unlikely(nt->thread_magic != THREAD_MAGIC)) {
-	    dprintf("Invalid thread on thread list %p magic = 0x%08x\n",
-		    nt, nt->thread_magic);
-	    kaboom();
-	}
-
-	dprintf("Thread %p (%s) ", nt, nt->name);
-	if (!nt->blocked) {
-	    dprintf("runnable priority %d\n", nt->prio);
-	    if (!best || nt->prio < best->prio)
-		best = nt;
-	} else {
-	    dprintf("blocked\n");
-	}
-	nt = container_of(nt->list.next, struct thread, list);
-    } while (nt != st);
-
-    if (!best)
+    if (curr->queued) {
+	__thread_unready(curr);
+	__thread_ready(curr);
+    }
+
+    if (__unlikely(!__runqueue.bitmap))
 	kaboom();		/* No runnable thread */
 
+    best = __runqueue.head[__builtin_ctz(__runqueue.bitmap)];
+
+    if (__unlikely(best->thread_magic != THREAD_MAGIC)) {
+	dprintf("Invalid thread on run queue %p magic = 0x%08x\n",
+		best, best->thread_magic);
+	kaboom();
+    }
+
     if (best != curr) {
 	uint64_t tsc;
 	
 	asm volatile("rdtsc" : "=A" (tsc));
 	
-	dprintf("@ %llu -> %p (%s)\n", tsc, best, best->name);
+	dprintf("@ %llu -> %p (%s) priority %d\n",
+		tsc, best, best->name, best->prio);
+	__sched_stats.switches++;
+	best->switches++;
 	__switch_to(best);
     } else {
 	dprintf("no change\n");
@@ -36,9 +36,13 @@ mstime_t __sem_down_slow(struct semaphore *sem, mstime_t timeout)
 	block.semaphore  = sem;
 	block.block_time = now;
 	block.timeout    = timeout ? now+timeout : 0;
+	block.heap_index = -1;
 	block.timed_out  = false;
 
 	curr->blocked    = &block;
+	__thread_unready(curr);
+	if (block.timeout)
+	    __thread_timeout_add(&block);
 
 	/* Add to the end of the wakeup list */
 	block.list.prev       = sem->list.prev;
@@ -77,7 +81,9 @@ void __sem_up_slow(struct semaphore *sem)
 	    sem->list.next = block->list.next;
 	    block->list.next->prev = &sem->list;
 
+	    __thread_timeout_del(block);
 	    block->thread->blocked = NULL;
+	    __thread_ready(block->thread);
 
 	    __schedule();
 	}
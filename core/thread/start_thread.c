@@ -31,6 +31,11 @@ struct thread *start_thread(const char *name, size_t stack_size, int prio,
 	free(stack);
 	return NULL;
     }
+    if (__thread_timeout_reserve()) {
+	free(rmstack);
+	free(stack);
+	return NULL;
+    }
 
     t = (struct thread *)stack;
     memset(t, 0, sizeof *t);
@@ -62,6 +67,7 @@ struct thread *start_thread(const char *name, size_t stack_size, int prio,
     curr->list.next    = &t->list;
     t->list.next->prev = &t->list;
 
+    __thread_ready(t);
     __schedule();
 
     irq_restore(irq);
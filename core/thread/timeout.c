@@ -3,39 +3,201 @@
  *
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "thread.h"
+#include "core.h"
+
+/*
+ * Threads sleeping with a timeout are kept in a binary min-heap ordered
+ * by deadline, so a timer tick only has to look at the ones which are
+ * actually due.  A thread sleeps on at most one semaphore at a time, so
+ * the heap never needs more slots than there are threads;
+ * start_thread() reserves one before the new thread can block.
+ */
+#define TIMEOUT_HEAP_STATIC	16
+
+static struct thread_block *timeout_heap_static[TIMEOUT_HEAP_STATIC];
+static struct thread_block **timeout_heap = timeout_heap_static;
+static int timeout_heap_size = TIMEOUT_HEAP_STATIC;
+static int timeout_count;
+static int timeout_reserved = 1;	/* The root thread */
+
+static inline bool timeout_before(const struct thread_block *a,
+				  const struct thread_block *b)
+{
+    return (mstimediff_t)(a->timeout - b->timeout) < 0;
+}
+
+static inline void heap_set(int i, struct thread_block *block)
+{
+    timeout_heap[i] = block;
+    block->heap_index = i;
+}
+
+static void heap_sift_up(int i)
+{
+    struct thread_block *block = timeout_heap[i];
+    int parent;
+
+    while (i) {
+	parent = (i - 1) >> 1;
+	if (!timeout_before(block, timeout_heap[parent]))
+	    break;
+	heap_set(i, timeout_heap[parent]);
+	i = parent;
+    }
+    heap_set(i, block);
+}
+
+static void heap_sift_down(int i)
+{
+    struct thread_block *block = timeout_heap[i];
+    int child;
+
+    while ((child = 2*i + 1) < timeout_count) {
+	if (child + 1 < timeout_count &&
+	    timeout_before(timeout_heap[child + 1], timeout_heap[child]))
+	    child++;
+	if (!timeout_before(timeout_heap[child], block))
+	    break;
+	heap_set(i, timeout_heap[child]);
+	i = child;
+    }
+    heap_set(i, block);
+}
+
+/*
+ * __thread_timeout_reserve()
+ *
+ * Make room in the timeout heap for one more thread.  Call with
+ * interrupts enabled, as this may need to allocate memory.
+ */
+int __thread_timeout_reserve(void)
+{
+    struct thread_block **heap, **old;
+    irq_state_t irq;
+    int size;
+
+    for (;;) {
+	irq = irq_save();
+	size = timeout_heap_size;
+	if (timeout_reserved < size) {
+	    timeout_reserved++;
+	    irq_restore(irq);
+	    return 0;
+	}
+	irq_restore(irq);
+
+	heap = malloc(2 * size * sizeof *heap);
+	if (!heap)
+	    return -1;
+
+	irq = irq_save();
+	old = heap;		/* In case someone else grew it meanwhile */
+	if (timeout_heap_size == size) {
+	    memcpy(heap, timeout_heap, timeout_count * sizeof *heap);
+	    old = timeout_heap;
+	    timeout_heap = heap;
+	    timeout_heap_size = 2 * size;
+	}
+	irq_restore(irq);
+
+	if (old != timeout_heap_static)
+	    free(old);
+    }
+}
+
+/*
+ * __thread_timeout_release()
+ *
+ * Give back the slot of a thread which is going away.  Call with
+ * interrupts locked out.
+ */
+void __thread_timeout_release(void)
+{
+    timeout_reserved--;
+}
+
+/*
+ * __thread_timeout_add()
+ *
+ * Arm the timeout of a thread about to block.  Call under interrupt
+ * lock, with block->timeout set.
+ */
+void __thread_timeout_add(struct thread_block *block)
+{
+    if (__unlikely(timeout_count >= timeout_heap_size))
+	kaboom();		/* A thread which didn't reserve a slot */
+
+    timeout_heap[timeout_count] = block;
+    heap_sift_up(timeout_count++);
+}
+
+/*
+ * __thread_timeout_del()
+ *
+ * Disarm the timeout of a thread which is being woken up.  Call under
+ * interrupt lock.  Harmless if the timeout isn't armed.
+ */
+void __thread_timeout_del(struct thread_block *block)
+{
+    int i = block->heap_index;
+
+    if (i < 0)
+	return;
+
+    block->heap_index = -1;
+    if (i == --timeout_count)
+	return;
+
+    heap_set(i, timeout_heap[timeout_count]);
+    if (i && timeout_before(timeout_heap[i], timeout_heap[(i - 1) >> 1]))
+	heap_sift_up(i);
+    else
+	heap_sift_down(i);
+}
+
+/*
+ * __thread_next_timeout()
+ *
+ * The earliest deadline of any sleeping thread, or 0 if there is none.
+ * Call under interrupt lock.
+ */
+mstime_t __thread_next_timeout(void)
+{
+    return timeout_count ? timeout_heap[0]->timeout : 0;
+}
 
 /*
  * __thread_process_timeouts()
  *
- * Look for threads that have timed out.  This should be called
+ * Wake up the threads that have timed out.  This should be called
  * under interrupt lock, before calling __schedule().
  */
 void __thread_process_timeouts(void)
 {
-    struct thread *curr = current();
-    struct thread_list *tp;
-    struct thread *t;
     mstime_t now = ms_timer();
     struct thread_block *block;
-    mstime_t timeout;
-
-    /* The current thread is obviously running, so no need to check... */
-    for (tp = curr->list.next; tp != &curr->list; tp = tp->next) {
-	t = container_of(tp, struct thread, list);
-	if ((block = t->blocked) && (timeout = block->timeout)) {
-	    if ((mstimediff_t)(timeout - now) <= 0) {
-		struct semaphore *sem = block->semaphore;
-		/* Remove us from the queue and increase the count */
-		block->list.next->prev = block->list.prev;
-		block->list.prev->next = block->list.next;
-		sem->count++;
-
-		t->blocked = NULL;
-		block->timed_out = true;
-
-		__schedule();	/* Normally sets just __need_schedule */
-	    }
-	}
+    struct semaphore *sem;
+
+    while (timeout_count) {
+	block = timeout_heap[0];
+	if ((mstimediff_t)(block->timeout - now) > 0)
+	    break;
+
+	__thread_timeout_del(block);
+
+	/* Remove us from the queue and increase the count */
+	sem = block->semaphore;
+	block->list.next->prev = block->list.prev;
+	block->list.prev->next = block->list.next;
+	sem->count++;
+
+	block->thread->blocked = NULL;
+	block->timed_out = true;
+	__thread_ready(block->thread);
+
+	__schedule();	/* Normally sets just __need_schedule */
     }
 }
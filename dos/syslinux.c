@@ -387,11 +387,11 @@ void set_attributes(const char *file, int attributes)
 /*
  * Version of the read_device function suitable for libfat
  */
-int libfat_xpread(intptr_t pp, void *buf, size_t secsize,
+int libfat_xpread(intptr_t pp, void *buf, size_t size,
 		  libfat_sector_t sector)
 {
-    read_device(pp, buf, 1, sector);
-    return secsize;
+    read_device(pp, buf, size >> LIBFAT_SECTOR_SHIFT, sector);
+    return size;
 }
 
 static inline void get_dos_version(void)
@@ -15,6 +15,9 @@ const struct url_scheme url_schemes[] = {
     { NULL, NULL, 0 },
 };
 
+/* Receives complete through a single shared callback status */
+const int core_udp_concurrency = 1;
+
 /**
  * Network stack-specific initialization
  */
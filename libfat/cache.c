@@ -13,53 +13,185 @@
 /*
  * cache.c
  *
- * Simple sector cache
+ * Sector cache: a fixed number of sectors, hashed by sector number and
+ * recycled in LRU order.  A pointer returned by libfat_get_sector()
+ * remains valid until enough other sectors have been brought in to push
+ * it out of the cache, which is never the case for the next few calls.
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "libfatint.h"
 
-void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n)
+static inline struct libfat_sector **hash_bucket(struct libfat_filesystem *fs,
+						 libfat_sector_t n)
+{
+    return &fs->hash[n & (LIBFAT_CACHE_HASH - 1)];
+}
+
+static struct libfat_sector *cache_lookup(struct libfat_filesystem *fs,
+					  libfat_sector_t n)
 {
     struct libfat_sector *ls;
 
-    for (ls = fs->sectors; ls; ls = ls->next) {
+    for (ls = *hash_bucket(fs, n); ls; ls = ls->next) {
 	if (ls->n == n)
-	    return ls->data;	/* Found in cache */
+	    return ls;
     }
 
-    /* Not found in cache */
-    ls = malloc(sizeof(struct libfat_sector));
-    if (!ls) {
-	libfat_flush(fs);
+    return NULL;
+}
+
+static void lru_unlink(struct libfat_filesystem *fs, struct libfat_sector *ls)
+{
+    if (ls->lru_prev)
+	ls->lru_prev->lru_next = ls->lru_next;
+    else
+	fs->lru_first = ls->lru_next;
+
+    if (ls->lru_next)
+	ls->lru_next->lru_prev = ls->lru_prev;
+    else
+	fs->lru_last = ls->lru_prev;
+}
+
+static void lru_push(struct libfat_filesystem *fs, struct libfat_sector *ls)
+{
+    ls->lru_prev = NULL;
+    ls->lru_next = fs->lru_first;
+    if (fs->lru_first)
+	fs->lru_first->lru_prev = ls;
+    else
+	fs->lru_last = ls;
+    fs->lru_first = ls;
+}
+
+/*
+ * Get a free cache entry, either a new one if we are still within budget,
+ * or by recycling the least recently used one.
+ */
+static struct libfat_sector *cache_alloc(struct libfat_filesystem *fs)
+{
+    struct libfat_sector *ls, **lsp;
+
+    if (fs->nsectors < LIBFAT_CACHE_SECTORS) {
 	ls = malloc(sizeof(struct libfat_sector));
+	if (ls) {
+	    fs->nsectors++;
+	    return ls;
+	}
+    }
+
+    ls = fs->lru_last;
+    if (!ls)
+	return NULL;		/* Can't allocate memory */
+
+    lru_unlink(fs, ls);
+    for (lsp = hash_bucket(fs, ls->n); *lsp != ls; lsp = &(*lsp)->next) ;
+    *lsp = ls->next;
+
+    return ls;
+}
+
+static void cache_insert(struct libfat_filesystem *fs,
+			 struct libfat_sector *ls, libfat_sector_t n)
+{
+    struct libfat_sector **bucket = hash_bucket(fs, n);
 
+    ls->n = n;
+    ls->next = *bucket;
+    *bucket = ls;
+    lru_push(fs, ls);
+}
+
+/*
+ * Read sectors n..n+count-1, which are not in the cache, with a single
+ * call to the read function, and add them to the cache.  Sector n ends
+ * up as the most recently used one.
+ */
+static struct libfat_sector *cache_fill(struct libfat_filesystem *fs,
+					libfat_sector_t n, unsigned int count)
+{
+    struct libfat_sector *ls;
+    size_t bytes = (size_t)count << LIBFAT_SECTOR_SHIFT;
+    unsigned int i;
+
+    if (count == 1) {
+	ls = cache_alloc(fs);
 	if (!ls)
-	    return NULL;	/* Can't allocate memory */
+	    return NULL;
+
+	if (fs->read(fs->readptr, ls->data, LIBFAT_SECTOR_SIZE, n)
+	    != LIBFAT_SECTOR_SIZE) {
+	    free(ls);
+	    fs->nsectors--;
+	    return NULL;	/* I/O error */
+	}
+
+	cache_insert(fs, ls, n);
+	return ls;
     }
 
-    if (fs->read(fs->readptr, ls->data, LIBFAT_SECTOR_SIZE, n)
-	!= LIBFAT_SECTOR_SIZE) {
-	free(ls);
-	return NULL;		/* I/O error */
+    if (fs->read(fs->readptr, fs->readbuf, bytes, n) != (int)bytes)
+	return cache_fill(fs, n, 1);	/* Don't let readahead fail us */
+
+    ls = NULL;
+    for (i = count; i--;) {
+	ls = cache_alloc(fs);
+	if (!ls)
+	    return NULL;
+
+	memcpy(ls->data, fs->readbuf + (i << LIBFAT_SECTOR_SHIFT),
+	       LIBFAT_SECTOR_SIZE);
+	cache_insert(fs, ls, n + i);
     }
 
-    ls->n = n;
-    ls->next = fs->sectors;
-    fs->sectors = ls;
+    return ls;
+}
+
+void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n)
+{
+    struct libfat_sector *ls;
+    unsigned int count;
+
+    ls = cache_lookup(fs, n);
+    if (ls) {
+	/* Found in cache */
+	if (ls != fs->lru_first) {
+	    lru_unlink(fs, ls);
+	    lru_push(fs, ls);
+	}
+	return ls->data;
+    }
+
+    /*
+     * Not found in cache; read ahead up to the next cached sector or
+     * the end of the filesystem (unknown until libfat_open() is done).
+     */
+    count = 1;
+    if (fs->end && !fs->readbuf)
+	fs->readbuf = malloc(LIBFAT_READAHEAD << LIBFAT_SECTOR_SHIFT);
+    if (fs->end && fs->readbuf) {
+	while (count < LIBFAT_READAHEAD && n + count < fs->end &&
+	       !cache_lookup(fs, n + count))
+	    count++;
+    }
 
-    return ls->data;
+    ls = cache_fill(fs, n, count);
+    return ls ? ls->data : NULL;
 }
 
 void libfat_flush(struct libfat_filesystem *fs)
 {
     struct libfat_sector *ls, *lsnext;
 
-    lsnext = fs->sectors;
-    fs->sectors = NULL;
+    lsnext = fs->lru_first;
+    fs->lru_first = fs->lru_last = NULL;
+    fs->nsectors = 0;
+    memset(fs->hash, 0, sizeof fs->hash);
 
     for (ls = lsnext; ls; ls = lsnext) {
-	lsnext = ls->next;
+	lsnext = ls->lru_next;
 	free(ls);
     }
 }
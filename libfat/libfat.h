@@ -38,12 +38,13 @@ struct libfat_direntry {
 /*
  * Open the filesystem.  The readfunc is the function to read
  * sectors, in the format:
- * int readfunc(intptr_t readptr, void *buf, size_t secsize,
+ * int readfunc(intptr_t readptr, void *buf, size_t size,
  *              libfat_sector_t secno)
  *
- * ... where readptr is a private argument.
+ * ... where readptr is a private argument.  size is a multiple of
+ * LIBFAT_SECTOR_SIZE, as consecutive sectors may be read at once.
  *
- * A return value of != secsize is treated as error.
+ * A return value of != size is treated as error.
  */
 struct libfat_filesystem
     *libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
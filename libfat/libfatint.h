@@ -22,9 +22,18 @@
 #include "libfat.h"
 #include "fat.h"
 
+/*
+ * Sector cache parameters: at most LIBFAT_CACHE_SECTORS sectors are kept,
+ * and a miss reads up to LIBFAT_READAHEAD consecutive sectors at once.
+ */
+#define LIBFAT_CACHE_SECTORS	256
+#define LIBFAT_CACHE_HASH	64	/* Power of 2 */
+#define LIBFAT_READAHEAD	8
+
 struct libfat_sector {
     libfat_sector_t n;		/* Sector number */
-    struct libfat_sector *next;	/* Next in list */
+    struct libfat_sector *next;	/* Next in hash chain */
+    struct libfat_sector *lru_prev, *lru_next;
     char data[LIBFAT_SECTOR_SIZE];
 };
 
@@ -49,7 +58,12 @@ struct libfat_filesystem {
     libfat_sector_t data;	/* Start of data area */
     libfat_sector_t end;	/* End of filesystem */
 
-    struct libfat_sector *sectors;
+    /* Sector cache */
+    struct libfat_sector *hash[LIBFAT_CACHE_HASH];
+    struct libfat_sector *lru_first;	/* Most recently used */
+    struct libfat_sector *lru_last;	/* Least recently used */
+    unsigned int nsectors;
+    char *readbuf;		/* LIBFAT_READAHEAD sectors */
 };
 
 #endif /* LIBFATINT_H */
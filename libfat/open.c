@@ -31,11 +31,10 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     uint32_t sectors, fatsize, minfatsize, rootdirsize;
     uint32_t nclusters;
 
-    fs = malloc(sizeof(struct libfat_filesystem));
+    fs = calloc(1, sizeof(struct libfat_filesystem));
     if (!fs)
 	goto barf;
 
-    fs->sectors = NULL;
     fs->read = readfunc;
     fs->readptr = readptr;
 
@@ -106,12 +105,13 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
 
 barf:
     if (fs)
-	free(fs);
+	libfat_close(fs);
     return NULL;
 }
 
 void libfat_close(struct libfat_filesystem *fs)
 {
     libfat_flush(fs);
+    free(fs->readbuf);
     free(fs);
 }
@@ -103,7 +103,7 @@ LIBOTHER_OBJS = \
 	\
 	sys/ansicon_write.o sys/ansiserial_write.o			\
 	\
-	pci/cfgtype.o pci/scan.o pci/bios.o					\
+	pci/cfgtype.o pci/scan.o pci/bios.o pci/ecam.o pci/pcidb.o		\
 	pci/readb.o pci/readw.o pci/readl.o			\
 	pci/writeb.o pci/writew.o pci/writel.o	\
 	\
@@ -160,6 +160,7 @@ LIBLOAD_OBJS = \
 	syslinux/cleanup.o syslinux/localboot.o	syslinux/runimage.o	\
 	\
 	syslinux/loadfile.o syslinux/floadfile.o syslinux/zloadfile.o	\
+	syslinux/loadfiles.o						\
 	\
 	syslinux/load_linux.o syslinux/initramfs.o			\
 	syslinux/initramfs_file.o syslinux/initramfs_loadfile.o		\
@@ -168,7 +169,8 @@ LIBLOAD_OBJS = \
 LIBMODULE_OBJS = \
 	sys/module/common.o sys/module/$(ARCH)/elf_module.o		\
 	sys/module/elfutils.o	\
-	sys/module/exec.o sys/module/elf_module.o
+	sys/module/exec.o sys/module/elf_module.o			\
+	sys/module/bundle.o
 
 # ZIP library object files
 LIBZLIB_OBJS = \
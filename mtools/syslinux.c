@@ -62,11 +62,11 @@ void __attribute__ ((noreturn)) die_err(const char *msg)
 /*
  * Version of the read function suitable for libfat
  */
-int libfat_xpread(intptr_t pp, void *buf, size_t secsize,
+int libfat_xpread(intptr_t pp, void *buf, size_t size,
 		  libfat_sector_t sector)
 {
-    off_t offset = (off_t) sector * secsize + opt.offset;
-    return xpread(pp, buf, secsize, offset);
+    off_t offset = (off_t) sector * LIBFAT_SECTOR_SIZE + opt.offset;
+    return xpread(pp, buf, size, offset);
 }
 
 static int move_file(char *filename)
@@ -0,0 +1,20 @@
+#ifndef _SYS_MODULE_H
+#define _SYS_MODULE_H
+
+#include <linux/list.h>
+
+/*
+ * Just enough of the module loader for code which looks modules up
+ */
+#define MODULE_NAME_SIZE	256
+
+struct elf_module {
+    char name[MODULE_NAME_SIZE];
+    struct list_head list;
+};
+
+extern struct list_head modules_head;
+
+#define for_each_module(m)	list_for_each_entry(m, &modules_head, list)
+
+#endif /* _SYS_MODULE_H */
@@ -216,10 +216,10 @@ void error(char *msg)
 /*
  * Wrapper for ReadFile suitable for libfat
  */
-int libfat_readfile(intptr_t pp, void *buf, size_t secsize,
+int libfat_readfile(intptr_t pp, void *buf, size_t size,
 		    libfat_sector_t sector)
 {
-    uint64_t offset = (uint64_t) sector * secsize;
+    uint64_t offset = (uint64_t) sector * LIBFAT_SECTOR_SIZE;
     LONG loword = (LONG) offset;
     LONG hiword = (LONG) (offset >> 32);
     LONG hiwordx = hiword;
@@ -227,13 +227,13 @@ int libfat_readfile(intptr_t pp, void *buf, size_t secsize,
 
     if (SetFilePointer((HANDLE) pp, loword, &hiwordx, FILE_BEGIN) != loword ||
 	hiword != hiwordx ||
-	!ReadFile((HANDLE) pp, buf, secsize, &bytes_read, NULL) ||
-	bytes_read != secsize) {
+	!ReadFile((HANDLE) pp, buf, size, &bytes_read, NULL) ||
+	bytes_read != size) {
 	fprintf(stderr, "Cannot read sector %u\n", sector);
 	exit(1);
     }
 
-    return secsize;
+    return size;
 }
 
 static void move_file(char *pathname, char *filename)